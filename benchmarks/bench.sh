@@ -0,0 +1,75 @@
+#!/bin/sh
+# Benchmark harness: compiles every benchmark, runs it in the simulator and
+# appends one tab separated line per benchmark to the results file.
+# usage: bench.sh VYPE MIPSSIM [RESULTS] [RUNS]
+#
+# Columns: build label, benchmark name, compile wall time (microseconds, best
+# of RUNS), compiler peak RSS (kB), emitted instructions, data segment bytes,
+# simulated dynamic instructions and cycles, and the output check (ok, wrong,
+# fail or - if there is no expected output).
+
+vype=$1
+sim=$2
+results=${3:-bench.tsv}
+runs=${4:-3}
+label=${BENCH_LABEL:-$(git describe --always --dirty 2>/dev/null || echo unknown)}
+dir=$(dirname "$0")
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+if [ -z "$vype" ] || [ -z "$sim" ]; then
+        echo "usage: $0 VYPE MIPSSIM [RESULTS] [RUNS]" >&2
+        exit 1
+fi
+
+"$dir/gen_large.sh" > "$tmp/large.c" || exit 1
+
+if [ ! -s "$results" ]; then
+        printf 'build\tbenchmark\tcompile_us\tpeak_rss_kb\ttext_instructions\tdata_bytes\tinstructions\tcycles\tstatus\n' > "$results"
+fi
+
+stat_value() {
+        sed -n "s/^$1=//p" "$2"
+}
+
+for src in "$dir"/*.c "$tmp/large.c"; do
+        name=$(basename "$src" .c)
+        input=/dev/null
+        [ -f "$dir/$name.in" ] && input=$dir/$name.in
+
+        best=
+        rss=
+        status=ok
+        run=0
+        while [ $run -lt "$runs" ]; do
+                if ! "$vype" -s "$src" "$tmp/$name.asm" 2> "$tmp/$name.log"; then
+                        status=fail
+                        break
+                fi
+                wall=$(sed -n 's/^compile wall us *//p' "$tmp/$name.log")
+                peak=$(sed -n 's/^compile peak rss kb *//p' "$tmp/$name.log")
+                [ -z "$best" ] || [ "$wall" -lt "$best" ] && best=$wall
+                [ -z "$rss" ] || [ "$peak" -gt "$rss" ] && rss=$peak
+                run=$((run + 1))
+        done
+
+        if [ $status = ok ] && "$sim" -q -s "$tmp/$name.stats" "$tmp/$name.asm" \
+                        < "$input" > "$tmp/$name.out"; then
+                if [ ! -f "$dir/$name.out" ]; then
+                        status=-
+                elif ! cmp -s "$tmp/$name.out" "$dir/$name.out"; then
+                        status=wrong
+                fi
+                text=$(($(stat_value text_size "$tmp/$name.stats") / 4))
+                data=$(stat_value data_size "$tmp/$name.stats")
+                insns=$(stat_value instructions "$tmp/$name.stats")
+                cycles=$(stat_value cycles "$tmp/$name.stats")
+        else
+                status=fail
+                text=- data=- insns=- cycles=-
+        fi
+
+        printf '%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n' "$label" "$name" \
+                "${best:--}" "${rss:--}" "$text" "$data" "$insns" "$cycles" \
+                "$status" | tee -a "$results"
+done
@@ -0,0 +1,61 @@
+/* Call-heavy code: small functions called in a loop, some of them through
+ * several levels. */
+
+int max(int a, int b) {
+        if (a > b) {
+                return a;
+        } else {
+                return b;
+        }
+}
+
+int min(int a, int b) {
+        if (a < b) {
+                return a;
+        } else {
+                return b;
+        }
+}
+
+int clamp(int x, int lo, int hi) {
+        return max(lo, min(x, hi));
+}
+
+int abs(int x) {
+        if (x < 0) {
+                return 0 - x;
+        } else {
+                return x;
+        }
+}
+
+int hash(int h, int x) {
+        return (h * 31 + x) % 1000003;
+}
+
+int mix(int h, int i) {
+        return hash(hash(h, clamp(i % 100, 10, 90)), abs(50 - i % 100));
+}
+
+char digit(int x) {
+        return (char)(48 + abs(x) % 10);
+}
+
+int main(void) {
+        int h, i;
+        string tail;
+
+        h = 7;
+        i = 0;
+        tail = "";
+        while (i < 5000) {
+                h = mix(h, i);
+                if (i % 500 == 0) {
+                        tail = strcat(tail, (string)digit(h));
+                } else {
+                }
+                i = i + 1;
+        }
+        print(h, ' ', tail, '\n');
+        return 0;
+}
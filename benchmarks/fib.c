@@ -0,0 +1,20 @@
+/* Recursion: naive Fibonacci numbers. */
+
+int fib(int n) {
+        if (n < 2) {
+                return n;
+        } else {
+                return fib(n - 1) + fib(n - 2);
+        }
+}
+
+int main(void) {
+        int i;
+
+        i = 15;
+        while (i <= 22) {
+                print("fib(", i, ") = ", fib(i), '\n');
+                i = i + 1;
+        }
+        return 0;
+}
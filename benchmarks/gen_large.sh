@@ -0,0 +1,52 @@
+#!/bin/sh
+# Writes a large VYPe program to standard output: N functions with loops,
+# branches and string operations, and a main function calling all of them.
+# usage: gen_large.sh [N]
+
+n=${1:-250}
+
+i=0
+while [ $i -lt $n ]; do
+        cat <<END
+int f$i(int x, string s) {
+        int i, acc;
+        string t;
+
+        acc = x + $i;
+        i = 0;
+        while (i < $((i % 7 + 3))) {
+                if (acc % 2 == 0) {
+                        acc = acc / 2 + i * $((i % 13 + 1));
+                } else {
+                        acc = acc * 3 + $((i % 5));
+                }
+                i = i + 1;
+        }
+        t = strcat(s, "f$i");
+        if (get_at(t, 0) == 'f') {
+                acc = acc + (int)get_at(t, 1);
+        } else {
+        }
+        return acc % 10007;
+}
+
+END
+        i=$((i + 1))
+done
+
+cat <<END
+int main(void) {
+        int acc;
+
+        acc = 1;
+END
+i=0
+while [ $i -lt $n ]; do
+        echo "        acc = f$i(acc, \"\");"
+        i=$((i + 1))
+done
+cat <<END
+        print(acc, '\n');
+        return 0;
+}
+END
@@ -0,0 +1,29 @@
+/* Recursion with several arguments: towers of Hanoi, moves are counted
+ * per peg instead of printed. */
+
+int hanoi(int n, char from, char to, char via, int peg) {
+        int moves;
+
+        if (n == 0) {
+                return 0;
+        } else {
+                moves = hanoi(n - 1, from, via, to, peg);
+                if (to == (char)(97 + peg)) {
+                        moves = moves + 1;
+                } else {
+                }
+                return moves + hanoi(n - 1, via, to, from, peg);
+        }
+}
+
+int main(void) {
+        int peg;
+
+        peg = 0;
+        while (peg < 3) {
+                print("moves to ", (char)(97 + peg), ": ",
+                      hanoi(15, 'a', 'c', 'b', peg), '\n');
+                peg = peg + 1;
+        }
+        return 0;
+}
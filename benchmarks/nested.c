@@ -0,0 +1,52 @@
+/* Nested loops: coprime pairs by Euclid's algorithm and the longest Collatz
+ * sequence. */
+
+int main(void) {
+        int i, j, a, b, t, coprime, n, steps, best, best_n;
+
+        coprime = 0;
+        i = 1;
+        while (i <= 80) {
+                j = 1;
+                while (j <= 80) {
+                        a = i;
+                        b = j;
+                        while (b != 0) {
+                                t = a % b;
+                                a = b;
+                                b = t;
+                        }
+                        if (a == 1) {
+                                coprime = coprime + 1;
+                        } else {
+                        }
+                        j = j + 1;
+                }
+                i = i + 1;
+        }
+
+        best = 0;
+        best_n = 0;
+        i = 1;
+        while (i < 3000) {
+                n = i;
+                steps = 0;
+                while (n != 1) {
+                        if (n % 2 == 0) {
+                                n = n / 2;
+                        } else {
+                                n = 3 * n + 1;
+                        }
+                        steps = steps + 1;
+                }
+                if (steps > best) {
+                        best = steps;
+                        best_n = i;
+                } else {
+                }
+                i = i + 1;
+        }
+        print(coprime, " coprime pairs, longest Collatz sequence from ", best_n,
+              " (", best, " steps)\n");
+        return 0;
+}
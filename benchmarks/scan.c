@@ -0,0 +1,57 @@
+/* Character scanning: lines are read until an empty one and their words,
+ * vowels, digits and the alphabetically last word are counted. */
+
+int is_letter(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+int is_vowel(char c) {
+        return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u' ||
+               c == 'A' || c == 'E' || c == 'I' || c == 'O' || c == 'U';
+}
+
+int main(void) {
+        string line, longest, word;
+        int lines, words, vowels, digits, i;
+        char c;
+
+        lines = 0; words = 0; vowels = 0; digits = 0;
+        longest = "";
+        line = read_string();
+        while (line != "") {
+                lines = lines + 1;
+                word = "";
+                i = 0;
+                c = get_at(line, 0);
+                while ((int)c != 0) {
+                        if (is_letter(c)) {
+                                word = strcat(word, (string)c);
+                                vowels = vowels + is_vowel(c);
+                        } else {
+                                if (c >= '0' && c <= '9') {
+                                        digits = digits + 1;
+                                } else {
+                                }
+                                if (word != "") {
+                                        words = words + 1;
+                                        if (word > longest) {
+                                                longest = word;
+                                        } else {
+                                        }
+                                        word = "";
+                                } else {
+                                }
+                        }
+                        i = i + 1;
+                        c = get_at(line, i);
+                }
+                if (word != "") {
+                        words = words + 1;
+                } else {
+                }
+                line = read_string();
+        }
+        print(lines, " lines, ", words, " words, ", vowels, " vowels, ",
+              digits, " digits, last word ", longest, '\n');
+        return 0;
+}
@@ -0,0 +1,45 @@
+/* String used as an array: sieve of Eratosthenes on a string of flags. */
+
+string fill(int n, char c) {
+        string s;
+
+        s = (string)c;
+        while (n > 1) {
+                s = strcat(s, s);
+                n = n / 2;
+        }
+        return s;
+}
+
+int main(void) {
+        string flags;
+        int n, i, j, count, last;
+
+        n = 4096;
+        flags = fill(n, '1');
+        i = 2;
+        while (i * i < n) {
+                if (get_at(flags, i) == '1') {
+                        j = i * i;
+                        while (j < n) {
+                                flags = set_at(flags, j, '0');
+                                j = j + i;
+                        }
+                } else {
+                }
+                i = i + 1;
+        }
+        count = 0;
+        last = 0;
+        i = 2;
+        while (i < n) {
+                if (get_at(flags, i) == '1') {
+                        count = count + 1;
+                        last = i;
+                } else {
+                }
+                i = i + 1;
+        }
+        print(count, " primes below ", n, ", the last one is ", last, '\n');
+        return 0;
+}
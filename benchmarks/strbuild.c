@@ -0,0 +1,54 @@
+/* String building: a long string is built character by character, reversed
+ * and rebuilt from words. */
+
+string build(int n) {
+        string s;
+        int i;
+
+        s = "";
+        i = 0;
+        while (i < n) {
+                s = strcat(s, (string)(char)(97 + (i * 7) % 26));
+                i = i + 1;
+        }
+        return s;
+}
+
+string reverse(string s, int n) {
+        string r;
+        int i;
+
+        r = s;
+        i = 0;
+        while (i < n) {
+                r = set_at(r, i, get_at(s, n - 1 - i));
+                i = i + 1;
+        }
+        return r;
+}
+
+int main(void) {
+        string s, r, words;
+        int i, n, same;
+
+        n = 1500;
+        s = build(n);
+        r = reverse(s, n);
+        r = reverse(r, n);
+        same = s == r;
+
+        words = "";
+        i = 0;
+        while (i < 300) {
+                words = strcat(strcat(words, "word"), (string)(char)(48 + i % 10));
+                if (i % 50 == 49) {
+                        print(words, '\n');
+                        words = "";
+                } else {
+                        words = strcat(words, " ");
+                }
+                i = i + 1;
+        }
+        print(get_at(s, 0), get_at(s, n - 1), get_at(r, n / 2), ' ', same, '\n');
+        return 0;
+}
@@ -11,6 +11,19 @@
 #include "data_type.h"
 
 
+/* Three address code labels of main and of the builtin functions. */
+#define MAIN_LABEL 1
+#define PRINT_LABEL 2
+#define READ_CHAR_LABEL 3
+#define READ_INT_LABEL 4
+#define READ_STRING_LABEL 5
+#define GET_AT_LABEL 6 //builtins from get_at on take arguments in registers
+#define SET_AT_LABEL 7
+#define STRCAT_LABEL 8
+#define SET_AT_IN_PLACE_LABEL 9 //set_at changing its argument, see tac_opt.c
+#define FIRST_BUILTIN_LABEL PRINT_LABEL
+#define LAST_BUILTIN_LABEL SET_AT_IN_PLACE_LABEL //user functions follow
+
 struct function {
         const char *id;
         unsigned tac_num;
@@ -10,8 +10,31 @@
 
 #include "gen_code.h"
 #include "reg_alloc.h"
+#include "builtins.h"
+
+#define FRAME_HEADER_SIZE 8 // saved $ra and $fp
+#define STACK_TOP 0x00800000
+#define HEAP_GROWTH 0x10000 // heap size allowed above the used memory
 
 unsigned generic_label_id;
+int uses_heap; // some string is allocated at run time
+int length_prefix; // length of a string is stored in the word before it
+
+// string builtins emitted as shared routines
+enum routine {
+	RT_READ_STRING,
+	RT_SET_AT,
+	RT_STRCAT,
+	RT_STRCMP,
+	RT_STREQ, // comparison for equality only
+	RT_COUNT
+};
+const char * routine_names[RT_COUNT] = {
+	"rt_read_string", "rt_set_at", "rt_strcat", "rt_strcmp", "rt_streq"
+};
+unsigned routine_refs[RT_COUNT]; // number of uses in the code
+int routine_called[RT_COUNT]; // some use calls the routine
+unsigned runtime_threshold; // more uses than this call the routine
 
 int get_op_val(struct tac_instruction inst, short op) {
 	switch (inst.data_type) {
@@ -26,21 +49,184 @@ int get_op_val(struct tac_instruction inst, short op) {
 	}
 }
 
-unsigned count_string_literals(struct tac * tac) {
-	unsigned n_strings = 0;
-	for (unsigned i = 0; i < tac->instructions_cnt; i++) {
-		if (tac->instructions[i].operator == OPERATOR_ASSIGN && 
-			tac->instructions[i].data_type == DATA_TYPE_STRING &&
-				tac->instructions[i].op1.type == OPERAND_TYPE_LITERAL) {
-			n_strings++;
+// register holding the operand, literals are loaded into register 25
+int get_operand_register(struct reg_alloc * ra, struct tac_instruction inst,
+			short op, FILE * f_out) {
+	const struct tac_operand * operand = (op == 1) ? &inst.op1 : &inst.op2;
+	if (operand->type == OPERAND_TYPE_LITERAL) {
+		int val = get_op_val(inst, op);
+		if (val == 0) {
+			return 0;
 		}
-		if (tac->instructions[i].operator == OPERATOR_RETURN && 
-			tac->instructions[i].data_type == DATA_TYPE_STRING &&
-				tac->instructions[i].op1.type == OPERAND_TYPE_LITERAL) {
-			n_strings++;
+		fprintf(f_out, "\tli $25,%d\n", val);
+		return 25;
+	}
+	return get_register(ra, operand->value.num, f_out);
+}
+
+// literal operand of a binary instruction fitting the 16-bit immediate field
+// of the instruction emitted for it, the other operand is a variable
+int generate_immediate(struct reg_alloc * ra, struct tac_instruction inst,
+			FILE * f_out) {
+	operator_t operator = inst.operator;
+	short lit;
+	if (inst.data_type == DATA_TYPE_STRING) return 0;
+	if (inst.op2.type == OPERAND_TYPE_LITERAL &&
+	    inst.op1.type == OPERAND_TYPE_VARIABLE) {
+		lit = 2;
+	}
+	else if (inst.op1.type == OPERAND_TYPE_LITERAL &&
+		 inst.op2.type == OPERAND_TYPE_VARIABLE) {
+		// c < x is x > c etc., the other operators are commutative
+		lit = 1;
+		switch (operator) {
+			case OPERATOR_SUB: return 0;
+			case OPERATOR_SLT: operator = OPERATOR_SGT; break;
+			case OPERATOR_SLET: operator = OPERATOR_SGET; break;
+			case OPERATOR_SGT: operator = OPERATOR_SLT; break;
+			case OPERATOR_SGET: operator = OPERATOR_SLET; break;
+			default: break;
+		}
+	}
+	else {
+		return 0;
+	}
+
+	// from now on the instruction is x operator c
+	long long c = get_op_val(inst, lit);
+	long long imm;
+	const char * op = NULL;
+	int negate = 0;
+	switch (operator) {
+		case OPERATOR_ADD: op = "addi"; imm = c; break;
+		case OPERATOR_SUB: op = "addi"; imm = -c; break;
+		case OPERATOR_MUL:
+			// power of two only, other literals go through register 25
+			if (c <= 0 || (c & (c - 1)) != 0) return 0;
+			op = "sll";
+			for (imm = 0; (1LL << imm) < c; imm++);
+			break;
+		case OPERATOR_SLT: op = "slti"; imm = c; break;
+		case OPERATOR_SLET: op = "slti"; imm = c + 1; break;
+		case OPERATOR_SGT:
+			// x > 0 is a single slt with register 0
+			if (c == 0) return 0;
+			op = "slti"; imm = c + 1; negate = 1;
+			break;
+		case OPERATOR_SGET: op = "slti"; imm = c; negate = 1; break;
+		case OPERATOR_SE:
+		case OPERATOR_SNE:
+			// xori zero-extends its immediate
+			if (c < 0 || c > 0xFFFF) return 0;
+			op = "xori"; imm = c;
+			break;
+		case OPERATOR_AND:
+		case OPERATOR_OR:
+			op = "ori"; imm = 0;
+			break;
+		default:
+			return 0;
+	}
+	if (imm < -32768 || imm > 32767) return 0;
+
+	int op_reg = get_operand_register(ra, inst, 3 - lit, f_out);
+	int res_reg = get_result_register(ra, inst.res_num, f_out);
+	switch (operator) {
+		case OPERATOR_SE:
+			if (c != 0) {
+				fprintf(f_out, "\txori $%d,$%d,%lld\n", res_reg, op_reg, c);
+				op_reg = res_reg;
+			}
+			fprintf(f_out, "\tsltiu $%d,$%d,1\n", res_reg, op_reg);
+			break;
+		case OPERATOR_SNE:
+			if (c != 0) {
+				fprintf(f_out, "\txori $%d,$%d,%lld\n", res_reg, op_reg, c);
+				op_reg = res_reg;
+			}
+			fprintf(f_out, "\tsltu $%d,$zero,$%d\n", res_reg, op_reg);
+			break;
+		case OPERATOR_AND:
+			// x && c is either 0 or x != 0
+			if (c == 0) {
+				fprintf(f_out, "\tori $%d,$zero,0\n", res_reg);
+			}
+			else {
+				fprintf(f_out, "\tsltu $%d,$zero,$%d\n", res_reg, op_reg);
+			}
+			break;
+		case OPERATOR_OR:
+			// x || c is either 1 or x != 0
+			if (c != 0) {
+				fprintf(f_out, "\tori $%d,$zero,1\n", res_reg);
+			}
+			else {
+				fprintf(f_out, "\tsltu $%d,$zero,$%d\n", res_reg, op_reg);
+			}
+			break;
+		default:
+			fprintf(f_out, "\t%s $%d,$%d,%lld\n", op, res_reg, op_reg, imm);
+			if (negate) {
+				fprintf(f_out, "\txori $%d,$%d,1\n", res_reg, res_reg);
+			}
+			break;
+	}
+	return 1;
+}
+
+// string literal of the instruction, NULL if it has none
+char * string_literal(struct tac_instruction inst) {
+	if ((inst.operator == OPERATOR_ASSIGN || inst.operator == OPERATOR_RETURN ||
+	     inst.operator == OPERATOR_PUSH) &&
+	    inst.data_type == DATA_TYPE_STRING && inst.op1.type == OPERAND_TYPE_LITERAL) {
+		return inst.op1.value.string_val;
+	}
+	return NULL;
+}
+
+// compares strings from their last characters, a string goes right before
+// the strings it is a suffix of
+int compare_reversed(const void * a, const void * b) {
+	const char * s = *(char * const *)a;
+	const char * t = *(char * const *)b;
+	size_t i = strlen(s), j = strlen(t);
+	while (i > 0 && j > 0) {
+		i--; j--;
+		if (s[i] != t[j]) return (unsigned char)s[i] - (unsigned char)t[j];
+	}
+	return (i > 0) - (j > 0);
+}
+
+int is_suffix(const char * s, const char * t) {
+	size_t ls = strlen(s), lt = strlen(t);
+	return ls <= lt && strcmp(t + lt - ls, s) == 0;
+}
+
+// distinct string literals of the program sorted by compare_reversed,
+// the literal with index i is labeled stri
+void collect_string_literals(struct tac * tac, char *** p_strings,
+			unsigned * n_strings) {
+	unsigned n = 0;
+	*p_strings = malloc(sizeof(char*) * (tac->instructions_cnt + 1));
+	for (unsigned i = 0; i < tac->instructions_cnt; i++) {
+		char * str = string_literal(tac->instructions[i]);
+		if (str != NULL) (*p_strings)[n++] = str;
+	}
+	qsort(*p_strings, n, sizeof(char*), compare_reversed);
+	*n_strings = 0;
+	for (unsigned i = 0; i < n; i++) {
+		if (*n_strings == 0 ||
+		    strcmp((*p_strings)[*n_strings - 1], (*p_strings)[i]) != 0) {
+			(*p_strings)[(*n_strings)++] = (*p_strings)[i];
 		}
 	}
-	return n_strings;
+}
+
+// label number of the pooled literal equal to the string
+unsigned string_label(char ** p_strings, unsigned n_strings, const char * str) {
+	char ** found = bsearch(&str, p_strings, n_strings, sizeof(char*),
+				compare_reversed);
+	return found - p_strings;
 }
 
 unsigned count_vars(struct tac * tac) {
@@ -58,175 +244,833 @@ unsigned count_vars(struct tac * tac) {
 	return ++n_vars;
 }
 
-void print_string_literals(FILE * f_out, char ** p_lit_strings, unsigned n_strings) {
+void print_string_chars(FILE * f_out, const char * str, size_t len) {
+	for (size_t c = 0; c < len; c++) {
+		if (str[c] == '"') fprintf(f_out, "\\\"");
+		else if (str[c] == '\\') fprintf(f_out, "\\\\");
+		else fprintf(f_out, "%c", str[c]);
+	}
+}
+
+// a literal which is a suffix of the following one is not stored separately,
+// its label is placed inside the longer literal, e.g. "\n" in "foo\n",
+// literals preceded by their lengths are only deduplicated
+void print_string_literals(FILE * f_out, char ** p_strings, unsigned n_strings) {
+	unsigned first = 0;
 	for (unsigned i = 0; i < n_strings; i++) {
-		fprintf(f_out, "\tstr%d:\t.asciz\t\"",i);
-		int c = 0;
-		while (p_lit_strings[i][c] != 0) {
-			if (p_lit_strings[i][c] == '"') fprintf(f_out, "\\\"");	
-			else if (p_lit_strings[i][c] == '\\') fprintf(f_out, "\\\\");	
-			else fprintf(f_out, "%c", p_lit_strings[i][c]);
-			c++;
+		if (length_prefix) {
+			fprintf(f_out, "\t.word\t%u\n", (unsigned)strlen(p_strings[i]));
 		}
-		fprintf(f_out,"\"\n");
+		else if (i + 1 < n_strings && is_suffix(p_strings[i], p_strings[i + 1])) {
+			continue;
+		}
+		// literals first..i share the storage of the literal i
+		size_t start = 0, len = strlen(p_strings[i]);
+		for (unsigned j = i; j > first; j--) {
+			size_t end = len - strlen(p_strings[j - 1]);
+			fprintf(f_out, "\tstr%u:\t.ascii\t\"", j);
+			print_string_chars(f_out, p_strings[i] + start, end - start);
+			fprintf(f_out, "\"\n");
+			start = end;
+		}
+		fprintf(f_out, "\tstr%u:\t.asciz\t\"", first);
+		print_string_chars(f_out, p_strings[i] + start, len - start);
+		fprintf(f_out, "\"\n");
+		first = i + 1;
 	}
 }
 
-void print_vars(FILE * f_out, unsigned n_vars) {
-	for (unsigned i = 0; i < n_vars; i++) {
-		fprintf(f_out, "\tvar%d:\t.int\t0\n",i);
+// how a push of a print argument is generated, arguments are printed right
+// at their push if nothing between it and the call can be observed, the ones
+// pushed before such an instruction wait on the stack until the first
+// argument printed directly (or the call) prints them
+struct print_arg {
+	unsigned call; // call of print, 0 for pushes of other calls
+	unsigned prev; // push of the previous argument
+	int flush; // waiting arguments printed first, -1 if this one waits
+};
+
+// instruction after which a pushed argument cannot be printed early
+int is_print_barrier(struct tac_instruction inst) {
+	switch (inst.operator) {
+		case OPERATOR_CALL:
+			// get_at, set_at and strcat have no visible effects
+			return inst.op1.value.num < GET_AT_LABEL ||
+				inst.op1.value.num > LAST_BUILTIN_LABEL;
+		case OPERATOR_DIV:
+		case OPERATOR_MOD:
+		case OPERATOR_LABEL:
+		case OPERATOR_JUMP:
+		case OPERATOR_BZERO:
+		case OPERATOR_RETURN:
+			return 1;
+		default:
+			return 0;
 	}
 }
 
-void print_one(int n_param, struct tac * tac, int i_tac, int offset, int * func_params, FILE * f_out) {
-	// find the type in tac
-	//   go back through tac
-	//   if call then ignore func_params[label] pushes before
-	//   if push and ignore == 0, we have the type
-	int ignore_pushes = 0;
-	data_type_t type;
-	for (i_tac; ; i_tac--) {
-		struct tac_instruction inst = tac->instructions[i_tac];
-		if (inst.operator == OPERATOR_CALL) {
-			ignore_pushes += func_params[inst.op1.value.num];	
+// pairs pushes with the calls of print, the number of arguments is recorded
+// on the call, so a single pass with a stack of pending pushes is enough
+struct print_arg * match_print_args(struct tac * tac, const int * func_params) {
+	unsigned cnt = tac->instructions_cnt;
+	struct print_arg * args = calloc(cnt + 1, sizeof(struct print_arg));
+	unsigned * pending = malloc(sizeof(unsigned) * (cnt + 1));
+	unsigned * next_barrier = malloc(sizeof(unsigned) * (cnt + 1));
+	unsigned top = 0;
+
+	next_barrier[cnt] = cnt;
+	for (unsigned i = cnt; i-- > 0; ) {
+		next_barrier[i] = is_print_barrier(tac->instructions[i]) ?
+					i : next_barrier[i + 1];
+	}
+
+	for (unsigned i = 0; i < cnt; i++) {
+		struct tac_instruction inst = tac->instructions[i];
+		if (inst.operator == OPERATOR_PUSH) {
+			pending[top++] = i;
+			continue;
 		}
-		else if (inst.operator == OPERATOR_PUSH) {
-			if (ignore_pushes > 0) {
-				ignore_pushes--;
+		if (inst.operator != OPERATOR_CALL) continue;
+		unsigned label = inst.op1.value.num;
+		unsigned n = (label == 2) ? (unsigned)inst.op2.value.int_val :
+					    (unsigned)func_params[label];
+		if (n > top) n = top;
+		top -= n;
+		if (label != 2) continue;
+
+		int waiting = 0;
+		unsigned prev = 0;
+		for (unsigned k = top; k < top + n; k++) {
+			unsigned push = pending[k];
+			args[push].call = i;
+			args[push].prev = prev;
+			if (next_barrier[push + 1] == i) {
+				args[push].flush = waiting;
+				waiting = 0;
 			}
 			else {
-				type = inst.data_type;
-				i_tac--;
-				break;
+				args[push].flush = -1;
+				waiting++;
 			}
+			prev = push;
 		}
+		// the last argument has waited
+		args[i].prev = prev;
+		args[i].flush = waiting;
 	}
 
-	if (n_param > 0) {
-		print_one(n_param - 1, tac, i_tac, offset + 4, func_params, f_out);
+	free(pending);
+	free(next_barrier);
+	return args;
+}
+
+void generate_print(FILE * f_out, data_type_t type, int reg) {
+	switch (type) {
+		case DATA_TYPE_INT:
+			fprintf(f_out, "\tprint_int $%d\n", reg);
+			break;
+		case DATA_TYPE_CHAR:
+			fprintf(f_out, "\tprint_char $%d\n", reg);
+			break;
+		case DATA_TYPE_STRING:
+			fprintf(f_out, "\tprint_string $%d\n", reg);
+			break;
+		default:
+			break;
 	}
+}
 
-	// print the param on SP + offset of type 'type'
+// prints n waiting arguments, the last one pushed by instruction i is
+// on the top of the stack
+void print_waiting(struct tac * tac, const struct print_arg * args,
+			unsigned i, int n, int offset, FILE * f_out) {
+	if (n > 1) {
+		print_waiting(tac, args, args[i].prev, n - 1, offset + 4, f_out);
+	}
 	fprintf(f_out, "\tlw $25,%d($sp)\n", offset);
-	switch (type) {
-        	case DATA_TYPE_INT:
-			fprintf(f_out, "\tprint_int $25\n");
+	generate_print(f_out, tac->instructions[i].data_type, 25);
+}
+
+// prints the arguments waiting before instruction i, returns their number
+int flush_print_args(struct tac * tac, const struct print_arg * args,
+			unsigned i, FILE * f_out) {
+	int n = args[i].flush;
+	if (n <= 0) return 0;
+	print_waiting(tac, args, args[i].prev, n, 0, f_out);
+	fprintf(f_out, "\taddi $sp,$sp,%d\n", 4 * n);
+	return n;
+}
+
+/*
+ * Run-time string heap, strings are allocated by rt_alloc called with the
+ * string size (including the terminating zero and the length) in $4, address
+ * of the block is returned in $2. Only $2, $4-$7 and $31 are changed.
+ *
+ * Every block starts with a header holding its size in bytes, free blocks
+ * keep a pointer to the next free block after the header. Blocks of up to
+ * 64 bytes are kept in free lists by their size, the last list holds all the
+ * bigger ones and is searched for the first block big enough, which is split,
+ * also when the list of the exact size is empty. When no block is found, the
+ * block is taken from the top of the heap ($28).
+ *
+ * When the top of the heap reaches the limit, garbage is collected. The
+ * collector is conservative, every word on the stack (registers are saved
+ * there first) pointing to the string of a block marks the block as used.
+ * Starts of the blocks are remembered in a bitmap placed above the top of the
+ * heap and the requested block, so only real blocks are marked. Unmarked
+ * neighbouring blocks are merged and put into the free lists. The limit is
+ * then set to twice the size of the used blocks plus HEAP_GROWTH, so the time
+ * spent in collections is proportional to the allocated memory.
+ */
+void generate_runtime(FILE * f_out) {
+	fprintf(f_out, "\nrt_alloc:\n");
+	fprintf(f_out, "\taddi $4,$4,7\n");
+	fprintf(f_out, "\tsrl $4,$4,2\n");
+	fprintf(f_out, "\tsll $4,$4,2\n");
+	fprintf(f_out, "\nrt_alloc_retry:\n");
+	fprintf(f_out, "\tsrl $6,$4,2\n");
+	fprintf(f_out, "\taddi $6,$6,-2\n");
+	fprintf(f_out, "\tslti $7,$6,15\n");
+	fprintf(f_out, "\tbeq $7,$0,rt_alloc_large\n");
+	fprintf(f_out, "\tsll $6,$6,2\n");
+	fprintf(f_out, "\tla $5,rt_free\n");
+	fprintf(f_out, "\tadd $5,$5,$6\n");
+	fprintf(f_out, "\tlw $2,0($5)\n");
+	fprintf(f_out, "\tbeq $2,$0,rt_alloc_large\n");
+	fprintf(f_out, "\tlw $6,4($2)\n");
+	fprintf(f_out, "\tsw $6,0($5)\n");
+	fprintf(f_out, "\taddi $2,$2,4\n");
+	fprintf(f_out, "\tjr $31\n");
+	// first fit from the list of big blocks
+	fprintf(f_out, "\nrt_alloc_large:\n");
+	fprintf(f_out, "\tla $5,rt_free\n");
+	fprintf(f_out, "\taddi $5,$5,60\n");
+	fprintf(f_out, "\nrt_alloc_fit:\n");
+	fprintf(f_out, "\tlw $2,0($5)\n");
+	fprintf(f_out, "\tbeq $2,$0,rt_alloc_bump\n");
+	fprintf(f_out, "\tlw $6,0($2)\n");
+	fprintf(f_out, "\tslt $7,$6,$4\n");
+	fprintf(f_out, "\tbeq $7,$0,rt_alloc_found\n");
+	fprintf(f_out, "\taddi $5,$2,4\n");
+	fprintf(f_out, "\tj rt_alloc_fit\n");
+	fprintf(f_out, "\nrt_alloc_found:\n");
+	fprintf(f_out, "\tlw $7,4($2)\n");
+	fprintf(f_out, "\tsw $7,0($5)\n");
+	fprintf(f_out, "\tsub $6,$6,$4\n");
+	fprintf(f_out, "\tslti $7,$6,8\n");
+	fprintf(f_out, "\tbne $7,$0,rt_alloc_whole\n");
+	fprintf(f_out, "\tsw $4,0($2)\n");
+	fprintf(f_out, "\tadd $7,$2,$4\n");
+	fprintf(f_out, "\tsw $6,0($7)\n");
+	fprintf(f_out, "\tsrl $6,$6,2\n");
+	fprintf(f_out, "\taddi $6,$6,-2\n");
+	fprintf(f_out, "\tslti $5,$6,15\n");
+	fprintf(f_out, "\tbne $5,$0,rt_alloc_split\n");
+	fprintf(f_out, "\taddi $6,$0,15\n");
+	fprintf(f_out, "\nrt_alloc_split:\n");
+	fprintf(f_out, "\tsll $6,$6,2\n");
+	fprintf(f_out, "\tla $5,rt_free\n");
+	fprintf(f_out, "\tadd $5,$5,$6\n");
+	fprintf(f_out, "\tlw $6,0($5)\n");
+	fprintf(f_out, "\tsw $6,4($7)\n");
+	fprintf(f_out, "\tsw $7,0($5)\n");
+	fprintf(f_out, "\nrt_alloc_whole:\n");
+	fprintf(f_out, "\taddi $2,$2,4\n");
+	fprintf(f_out, "\tjr $31\n");
+	// top of the heap
+	fprintf(f_out, "\nrt_alloc_bump:\n");
+	fprintf(f_out, "\tadd $6,$28,$4\n");
+	fprintf(f_out, "\tla $5,rt_limit\n");
+	fprintf(f_out, "\tlw $5,0($5)\n");
+	fprintf(f_out, "\tslt $7,$5,$6\n");
+	fprintf(f_out, "\tbne $7,$0,rt_collect\n");
+	fprintf(f_out, "\tsw $4,0($28)\n");
+	fprintf(f_out, "\taddi $2,$28,4\n");
+	fprintf(f_out, "\taddi $28,$6,0\n");
+	fprintf(f_out, "\tjr $31\n");
+
+	// collector, saves registers which may hold strings
+	fprintf(f_out, "\nrt_collect:\n");
+	fprintf(f_out, "\taddi $sp,$sp,-68\n");
+	for (int r = 8; r <= 24; r++) {
+		fprintf(f_out, "\tsw $%d,%d($sp)\n", r, 4 * (r - 8));
+	}
+	// clear the bitmap of block starts
+	fprintf(f_out, "\tla $8,heap\n");
+	fprintf(f_out, "\tsub $9,$28,$8\n");
+	fprintf(f_out, "\tsrl $9,$9,7\n");
+	fprintf(f_out, "\taddi $9,$9,1\n");
+	fprintf(f_out, "\tsll $9,$9,2\n");
+	fprintf(f_out, "\tadd $10,$28,$4\n");
+	fprintf(f_out, "\tadd $11,$10,$9\n");
+	fprintf(f_out, "\nrt_collect_clear:\n");
+	fprintf(f_out, "\taddi $11,$11,-4\n");
+	fprintf(f_out, "\tsw $0,0($11)\n");
+	fprintf(f_out, "\tbne $11,$10,rt_collect_clear\n");
+	fprintf(f_out, "\taddi $11,$8,0\n");
+	fprintf(f_out, "\taddi $14,$0,1\n");
+	fprintf(f_out, "\nrt_collect_starts:\n");
+	fprintf(f_out, "\tbeq $11,$28,rt_collect_roots\n");
+	fprintf(f_out, "\tsub $12,$11,$8\n");
+	fprintf(f_out, "\tsrl $12,$12,2\n");
+	fprintf(f_out, "\tsrl $13,$12,5\n");
+	fprintf(f_out, "\tsll $13,$13,2\n");
+	fprintf(f_out, "\tadd $13,$13,$10\n");
+	fprintf(f_out, "\tandi $12,$12,31\n");
+	fprintf(f_out, "\tsllv $12,$14,$12\n");
+	fprintf(f_out, "\tlw $15,0($13)\n");
+	fprintf(f_out, "\tor $15,$15,$12\n");
+	fprintf(f_out, "\tsw $15,0($13)\n");
+	fprintf(f_out, "\tlw $12,0($11)\n");
+	fprintf(f_out, "\tadd $11,$11,$12\n");
+	fprintf(f_out, "\tj rt_collect_starts\n");
+	// mark blocks referenced from the stack
+	fprintf(f_out, "\nrt_collect_roots:\n");
+	fprintf(f_out, "\taddi $11,$sp,0\n");
+	fprintf(f_out, "\tli $9,0x%08X\n", STACK_TOP);
+	fprintf(f_out, "\nrt_collect_root:\n");
+	fprintf(f_out, "\tbeq $11,$9,rt_collect_sweep\n");
+	fprintf(f_out, "\tlw $12,0($11)\n");
+	fprintf(f_out, "\taddi $11,$11,4\n");
+	fprintf(f_out, "\taddi $12,$12,%d\n", length_prefix ? -8 : -4);
+	fprintf(f_out, "\tslt $13,$12,$8\n");
+	fprintf(f_out, "\tbne $13,$0,rt_collect_root\n");
+	fprintf(f_out, "\tslt $13,$12,$28\n");
+	fprintf(f_out, "\tbeq $13,$0,rt_collect_root\n");
+	fprintf(f_out, "\tandi $13,$12,3\n");
+	fprintf(f_out, "\tbne $13,$0,rt_collect_root\n");
+	fprintf(f_out, "\tsub $13,$12,$8\n");
+	fprintf(f_out, "\tsrl $13,$13,2\n");
+	fprintf(f_out, "\tsrl $15,$13,5\n");
+	fprintf(f_out, "\tsll $15,$15,2\n");
+	fprintf(f_out, "\tadd $15,$15,$10\n");
+	fprintf(f_out, "\tlw $15,0($15)\n");
+	fprintf(f_out, "\tandi $13,$13,31\n");
+	fprintf(f_out, "\tsrlv $15,$15,$13\n");
+	fprintf(f_out, "\tandi $15,$15,1\n");
+	fprintf(f_out, "\tbeq $15,$0,rt_collect_root\n");
+	fprintf(f_out, "\tlw $13,0($12)\n");
+	fprintf(f_out, "\tori $13,$13,1\n");
+	fprintf(f_out, "\tsw $13,0($12)\n");
+	fprintf(f_out, "\tj rt_collect_root\n");
+	// rebuild the free lists from unmarked blocks
+	fprintf(f_out, "\nrt_collect_sweep:\n");
+	fprintf(f_out, "\tla $9,rt_free\n");
+	fprintf(f_out, "\taddi $11,$9,64\n");
+	fprintf(f_out, "\nrt_collect_lists:\n");
+	fprintf(f_out, "\taddi $11,$11,-4\n");
+	fprintf(f_out, "\tsw $0,0($11)\n");
+	fprintf(f_out, "\tbne $11,$9,rt_collect_lists\n");
+	fprintf(f_out, "\taddi $10,$8,0\n");
+	fprintf(f_out, "\taddi $13,$0,0\n");
+	fprintf(f_out, "\nrt_collect_block:\n");
+	fprintf(f_out, "\tbeq $10,$28,rt_collect_done\n");
+	fprintf(f_out, "\tlw $11,0($10)\n");
+	fprintf(f_out, "\tandi $12,$11,1\n");
+	fprintf(f_out, "\tbeq $12,$0,rt_collect_free\n");
+	fprintf(f_out, "\taddi $11,$11,-1\n");
+	fprintf(f_out, "\tsw $11,0($10)\n");
+	fprintf(f_out, "\tadd $13,$13,$11\n");
+	fprintf(f_out, "\tadd $10,$10,$11\n");
+	fprintf(f_out, "\tj rt_collect_block\n");
+	fprintf(f_out, "\nrt_collect_free:\n");
+	fprintf(f_out, "\taddi $14,$10,0\n");
+	fprintf(f_out, "\nrt_collect_run:\n");
+	fprintf(f_out, "\tadd $10,$10,$11\n");
+	fprintf(f_out, "\tbeq $10,$28,rt_collect_top\n");
+	fprintf(f_out, "\tlw $11,0($10)\n");
+	fprintf(f_out, "\tandi $12,$11,1\n");
+	fprintf(f_out, "\tbeq $12,$0,rt_collect_run\n");
+	fprintf(f_out, "\tsub $11,$10,$14\n");
+	fprintf(f_out, "\tsw $11,0($14)\n");
+	fprintf(f_out, "\tsrl $11,$11,2\n");
+	fprintf(f_out, "\taddi $11,$11,-2\n");
+	fprintf(f_out, "\tslti $12,$11,15\n");
+	fprintf(f_out, "\tbne $12,$0,rt_collect_push\n");
+	fprintf(f_out, "\taddi $11,$0,15\n");
+	fprintf(f_out, "\nrt_collect_push:\n");
+	fprintf(f_out, "\tsll $11,$11,2\n");
+	fprintf(f_out, "\tadd $11,$11,$9\n");
+	fprintf(f_out, "\tlw $12,0($11)\n");
+	fprintf(f_out, "\tsw $12,4($14)\n");
+	fprintf(f_out, "\tsw $14,0($11)\n");
+	fprintf(f_out, "\tj rt_collect_block\n");
+	// free blocks at the top are returned to the top
+	fprintf(f_out, "\nrt_collect_top:\n");
+	fprintf(f_out, "\taddi $28,$14,0\n");
+	// the heap may hold twice as much as is used, at least the current top
+	fprintf(f_out, "\nrt_collect_done:\n");
+	fprintf(f_out, "\tadd $13,$13,$13\n");
+	fprintf(f_out, "\tadd $13,$13,$8\n");
+	fprintf(f_out, "\tli $12,%d\n", HEAP_GROWTH);
+	fprintf(f_out, "\tadd $13,$13,$12\n");
+	fprintf(f_out, "\tslt $12,$13,$28\n");
+	fprintf(f_out, "\tbeq $12,$0,rt_collect_limit\n");
+	fprintf(f_out, "\taddi $13,$28,0\n");
+	fprintf(f_out, "\nrt_collect_limit:\n");
+	fprintf(f_out, "\tadd $13,$13,$4\n");
+	fprintf(f_out, "\tla $12,rt_limit\n");
+	fprintf(f_out, "\tsw $13,0($12)\n");
+	for (int r = 8; r <= 24; r++) {
+		fprintf(f_out, "\tlw $%d,%d($sp)\n", r, 4 * (r - 8));
+	}
+	fprintf(f_out, "\taddi $sp,$sp,68\n");
+	fprintf(f_out, "\tj rt_alloc_retry\n");
+}
+
+// loads 0x01010101 and 0x80808080 used to find a zero byte in a word
+void generate_byte_masks(FILE * f_out) {
+	fprintf(f_out, "\tli $6,0x01010101\n");
+	fprintf(f_out, "\tli $7,0x80808080\n");
+}
+
+// branches to label if the word in reg has a zero byte, which is the case
+// iff (x - 0x01010101) & ~x & 0x80808080 is not zero, reg and tmp are changed
+void generate_zero_byte_test(FILE * f_out, int reg, int tmp, const char * label) {
+	fprintf(f_out, "\tsubu $%d,$%d,$6\n", tmp, reg);
+	fprintf(f_out, "\tnor $%d,$%d,$0\n", reg, reg);
+	fprintf(f_out, "\tand $%d,$%d,$%d\n", reg, reg, tmp);
+	fprintf(f_out, "\tand $%d,$%d,$7\n", reg, reg);
+	fprintf(f_out, "\tbne $%d,$0,%s%d\n", reg, label, generic_label_id);
+}
+
+// adds length of the string at $3 to $4, $3 then points to its end,
+// aligned words are searched for the terminator, bytes before and in
+// the word containing it one by one
+void generate_strlen(FILE * f_out) {
+	generate_byte_masks(f_out);
+	fprintf(f_out, "label_lenstr%d:\n", generic_label_id);
+	fprintf(f_out, "\tandi $25,$3,3\n");
+	fprintf(f_out, "\tbeq $25,$0,label_lenstr_word%d\n", generic_label_id);
+	fprintf(f_out, "\tlb $25,0($3)\n");
+	fprintf(f_out, "\tbeq $25,$0,label_endlenstr%d\n", generic_label_id);
+	fprintf(f_out, "\taddi $3,$3,1\n");
+	fprintf(f_out, "\taddi $4,$4,1\n");
+	fprintf(f_out, "\tj label_lenstr%d\n", generic_label_id);
+	fprintf(f_out, "label_lenstr_word%d:\n", generic_label_id);
+	fprintf(f_out, "\tlw $25,0($3)\n");
+	generate_zero_byte_test(f_out, 25, 5, "label_lenstr_tail");
+	fprintf(f_out, "\taddi $3,$3,4\n");
+	fprintf(f_out, "\taddi $4,$4,4\n");
+	fprintf(f_out, "\tj label_lenstr_word%d\n", generic_label_id);
+	fprintf(f_out, "label_lenstr_tail%d:\n", generic_label_id);
+	fprintf(f_out, "\tlb $25,0($3)\n");
+	fprintf(f_out, "\tbeq $25,$0,label_endlenstr%d\n", generic_label_id);
+	fprintf(f_out, "\taddi $3,$3,1\n");
+	fprintf(f_out, "\taddi $4,$4,1\n");
+	fprintf(f_out, "\tj label_lenstr_tail%d\n", generic_label_id);
+	fprintf(f_out, "label_endlenstr%d:\n", generic_label_id);
+	generic_label_id++;
+}
+
+// copies $4 bytes from $3 to $2, both then point after the copied bytes,
+// bytes are copied until $2 is aligned, then whole words, which are
+// shifted together from two aligned words if $3 is not aligned as well
+void generate_memcpy(FILE * f_out) {
+	fprintf(f_out, "label_copystr%d:\n", generic_label_id);
+	fprintf(f_out, "\tandi $25,$2,3\n");
+	fprintf(f_out, "\tbeq $25,$0,label_copystr_words%d\n", generic_label_id);
+	fprintf(f_out, "\tbeq $4,$0,label_endcopystr%d\n", generic_label_id);
+	fprintf(f_out, "\tlb $25,0($3)\n");
+	fprintf(f_out, "\tsb $25,0($2)\n");
+	fprintf(f_out, "\taddi $3,$3,1\n");
+	fprintf(f_out, "\taddi $2,$2,1\n");
+	fprintf(f_out, "\taddi $4,$4,-1\n");
+	fprintf(f_out, "\tj label_copystr%d\n", generic_label_id);
+	fprintf(f_out, "label_copystr_words%d:\n", generic_label_id);
+	fprintf(f_out, "\tslti $25,$4,4\n");
+	fprintf(f_out, "\tbne $25,$0,label_copystr_tail%d\n", generic_label_id);
+	fprintf(f_out, "\tandi $5,$3,3\n");
+	fprintf(f_out, "\tbne $5,$0,label_copystr_shift%d\n", generic_label_id);
+	fprintf(f_out, "label_copystr_word%d:\n", generic_label_id);
+	fprintf(f_out, "\tlw $25,0($3)\n");
+	fprintf(f_out, "\tsw $25,0($2)\n");
+	fprintf(f_out, "\taddi $3,$3,4\n");
+	fprintf(f_out, "\taddi $2,$2,4\n");
+	fprintf(f_out, "\taddi $4,$4,-4\n");
+	fprintf(f_out, "\tslti $25,$4,4\n");
+	fprintf(f_out, "\tbeq $25,$0,label_copystr_word%d\n", generic_label_id);
+	fprintf(f_out, "\tj label_copystr_tail%d\n", generic_label_id);
+	// $5 and $6 are the shifts of the two words, srlv uses only 5 bits
+	fprintf(f_out, "label_copystr_shift%d:\n", generic_label_id);
+	fprintf(f_out, "\tsub $3,$3,$5\n");
+	fprintf(f_out, "\tsll $5,$5,3\n");
+	fprintf(f_out, "\tsub $6,$0,$5\n");
+	fprintf(f_out, "label_copystr_shiftword%d:\n", generic_label_id);
+	fprintf(f_out, "\tlw $7,0($3)\n");
+	fprintf(f_out, "\tlw $25,4($3)\n");
+	fprintf(f_out, "\tsllv $7,$7,$5\n");
+	fprintf(f_out, "\tsrlv $25,$25,$6\n");
+	fprintf(f_out, "\tor $7,$7,$25\n");
+	fprintf(f_out, "\tsw $7,0($2)\n");
+	fprintf(f_out, "\taddi $3,$3,4\n");
+	fprintf(f_out, "\taddi $2,$2,4\n");
+	fprintf(f_out, "\taddi $4,$4,-4\n");
+	fprintf(f_out, "\tslti $25,$4,4\n");
+	fprintf(f_out, "\tbeq $25,$0,label_copystr_shiftword%d\n", generic_label_id);
+	fprintf(f_out, "\tsrl $5,$5,3\n");
+	fprintf(f_out, "\tadd $3,$3,$5\n");
+	fprintf(f_out, "label_copystr_tail%d:\n", generic_label_id);
+	fprintf(f_out, "\tbeq $4,$0,label_endcopystr%d\n", generic_label_id);
+	fprintf(f_out, "\tlb $25,0($3)\n");
+	fprintf(f_out, "\tsb $25,0($2)\n");
+	fprintf(f_out, "\taddi $3,$3,1\n");
+	fprintf(f_out, "\taddi $2,$2,1\n");
+	fprintf(f_out, "\taddi $4,$4,-1\n");
+	fprintf(f_out, "\tj label_copystr_tail%d\n", generic_label_id);
+	fprintf(f_out, "label_endcopystr%d:\n", generic_label_id);
+	generic_label_id++;
+}
+
+/*
+ * String builtins take their arguments in $4-$6 and return the result in $2,
+ * they change only $2-$7, $25 and $31. The ones creating strings keep their
+ * arguments on the stack while rt_alloc is called, so the strings are not
+ * collected.
+ */
+void generate_read_string(FILE * f_out) {
+	// read above the top of the heap, then move to the new string
+	if (length_prefix) {
+		fprintf(f_out, "\taddi $3,$28,8\n");
+		fprintf(f_out, "\tread_string $3,$4\n");
+		fprintf(f_out, "\tadd $25,$3,$4\n");
+		fprintf(f_out, "\tsb $0,0($25)\n");
+		fprintf(f_out, "\tsw $4,-4($3)\n");
+		fprintf(f_out, "\taddi $4,$4,5\n");
+		fprintf(f_out, "\tjal rt_alloc\n");
+		fprintf(f_out, "\taddi $sp,$sp,-4\n");
+		fprintf(f_out, "\taddi $25,$2,4\n");
+		fprintf(f_out, "\tsw $25,0($sp)\n");
+		fprintf(f_out, "\tlw $4,-4($3)\n");
+		fprintf(f_out, "\taddi $4,$4,5\n");
+		fprintf(f_out, "\taddi $3,$3,-4\n");
+		generate_memcpy(f_out);
+		fprintf(f_out, "\tlw $2,0($sp)\n");
+		fprintf(f_out, "\taddi $sp,$sp,4\n");
+		return;
+	}
+	fprintf(f_out, "\taddi $3,$28,4\n");
+	fprintf(f_out, "\tread_string $3,$4\n");
+	fprintf(f_out, "\tadd $25,$3,$4\n");
+	fprintf(f_out, "\tsb $0,0($25)\n");
+	fprintf(f_out, "\taddi $4,$4,1\n");
+	fprintf(f_out, "\taddi $sp,$sp,-8\n");
+	fprintf(f_out, "\tsw $4,4($sp)\n");
+	fprintf(f_out, "\tjal rt_alloc\n");
+	fprintf(f_out, "\tsw $2,0($sp)\n");
+	fprintf(f_out, "\tlw $4,4($sp)\n");
+	generate_memcpy(f_out);
+	fprintf(f_out, "\tlw $2,0($sp)\n");
+	fprintf(f_out, "\taddi $sp,$sp,8\n");
+}
+
+// copy of the string $4 with character $6 at index $5
+void generate_set_at(FILE * f_out) {
+	fprintf(f_out, "\taddi $sp,$sp,-12\n");
+	fprintf(f_out, "\tsw $4,8($sp)\n");
+	fprintf(f_out, "\tsw $5,4($sp)\n");
+	fprintf(f_out, "\tsw $6,0($sp)\n");
+	if (length_prefix) {
+		fprintf(f_out, "\tlw $3,-4($4)\n");
+		fprintf(f_out, "\taddi $4,$3,5\n");
+		fprintf(f_out, "\tjal rt_alloc\n");
+		fprintf(f_out, "\tsw $3,0($2)\n");
+		fprintf(f_out, "\taddi $2,$2,4\n");
+		fprintf(f_out, "\taddi $4,$3,1\n");
+	}
+	else {
+		fprintf(f_out, "\taddi $3,$4,0\n");
+		fprintf(f_out, "\taddi $4,$0,1\n");
+		generate_strlen(f_out);
+		fprintf(f_out, "\taddi $3,$4,0\n");
+		fprintf(f_out, "\tjal rt_alloc\n");
+		fprintf(f_out, "\taddi $4,$3,0\n");
+	}
+	fprintf(f_out, "\tlw $3,8($sp)\n");
+	fprintf(f_out, "\tsw $2,8($sp)\n");
+	generate_memcpy(f_out);
+	// change the character
+	fprintf(f_out, "\tlw $2,8($sp)\n");
+	fprintf(f_out, "\tlw $25,4($sp)\n");
+	fprintf(f_out, "\tadd $25,$25,$2\n");
+	fprintf(f_out, "\tlw $3,0($sp)\n");
+	fprintf(f_out, "\tsb $3,0($25)\n");
+	fprintf(f_out, "\taddi $sp,$sp,12\n");
+}
+
+// concatenation of the strings $4 and $5
+void generate_strcat(FILE * f_out) {
+	if (length_prefix) {
+		// lengths are known, no terminator is searched
+		fprintf(f_out, "\taddi $sp,$sp,-8\n");
+		fprintf(f_out, "\tsw $4,4($sp)\n");
+		fprintf(f_out, "\tsw $5,0($sp)\n");
+		fprintf(f_out, "\tlw $4,-4($4)\n");
+		fprintf(f_out, "\tlw $3,-4($5)\n");
+		fprintf(f_out, "\tadd $3,$3,$4\n");
+		fprintf(f_out, "\taddi $4,$3,5\n");
+		fprintf(f_out, "\tjal rt_alloc\n");
+		fprintf(f_out, "\tsw $3,0($2)\n");
+		fprintf(f_out, "\taddi $2,$2,4\n");
+		fprintf(f_out, "\tlw $3,4($sp)\n");
+		fprintf(f_out, "\tsw $2,4($sp)\n");
+		fprintf(f_out, "\tlw $4,-4($3)\n");
+		generate_memcpy(f_out);
+		fprintf(f_out, "\tlw $3,0($sp)\n");
+		fprintf(f_out, "\tlw $4,-4($3)\n");
+		fprintf(f_out, "\taddi $4,$4,1\n");
+		generate_memcpy(f_out);
+		fprintf(f_out, "\tlw $2,4($sp)\n");
+		fprintf(f_out, "\taddi $sp,$sp,8\n");
+		return;
+	}
+	// both lengths are kept for the copies, the first one on the stack
+	fprintf(f_out, "\taddi $sp,$sp,-12\n");
+	fprintf(f_out, "\tsw $4,8($sp)\n");
+	fprintf(f_out, "\tsw $5,4($sp)\n");
+	fprintf(f_out, "\taddi $3,$4,0\n");
+	fprintf(f_out, "\taddi $4,$0,0\n");
+	generate_strlen(f_out);
+	fprintf(f_out, "\tsw $4,0($sp)\n");
+	fprintf(f_out, "\tlw $3,4($sp)\n");
+	fprintf(f_out, "\taddi $4,$4,1\n");
+	generate_strlen(f_out);
+	fprintf(f_out, "\taddi $3,$4,0\n");
+	fprintf(f_out, "\tjal rt_alloc\n");
+	fprintf(f_out, "\tlw $4,0($sp)\n");
+	fprintf(f_out, "\tsub $3,$3,$4\n");
+	fprintf(f_out, "\tsw $3,0($sp)\n");
+	fprintf(f_out, "\tlw $3,8($sp)\n");
+	fprintf(f_out, "\tsw $2,8($sp)\n");
+	generate_memcpy(f_out);
+	fprintf(f_out, "\tlw $4,0($sp)\n");
+	fprintf(f_out, "\tlw $3,4($sp)\n");
+	generate_memcpy(f_out);
+	fprintf(f_out, "\tlw $2,8($sp)\n");
+	fprintf(f_out, "\taddi $sp,$sp,12\n");
+}
+
+// difference of the first differing characters of the strings $4 and $5,
+// zero if they are equal, any nonzero value for different lengths if only
+// equality is asked for
+void generate_strcmp(FILE * f_out, int equality) {
+	// strings of different lengths are not equal
+	if (length_prefix && equality) {
+		fprintf(f_out, "\tlw $25,-4($4)\n");
+		fprintf(f_out, "\tlw $2,-4($5)\n");
+		fprintf(f_out, "\tsub $25,$25,$2\n");
+		fprintf(f_out, "\tbne $25,$0,label_compstr_end%d\n", generic_label_id);
+	}
+
+	// strings aligned alike are compared by words up to the word where they
+	// differ or end, the rest is compared by bytes
+	fprintf(f_out, "\txor $25,$4,$5\n");
+	fprintf(f_out, "\tandi $25,$25,3\n");
+	fprintf(f_out, "\tbne $25,$0,label_compstr%d\n", generic_label_id);
+	generate_byte_masks(f_out);
+	fprintf(f_out, "label_compstr_head%d:\n", generic_label_id);
+	fprintf(f_out, "\tandi $25,$4,3\n");
+	fprintf(f_out, "\tbeq $25,$0,label_compstr_word%d\n", generic_label_id);
+	fprintf(f_out, "\tlb $25,0($4)\n");
+	fprintf(f_out, "\tlb $2,0($5)\n");
+	fprintf(f_out, "\tsub $25,$25,$2\n");
+	fprintf(f_out, "\tbne $25,$0,label_compstr_end%d\n", generic_label_id);
+	fprintf(f_out, "\tbeq $2,$0,label_compstr_end%d\n", generic_label_id);
+	fprintf(f_out, "\taddi $4,$4,1\n");
+	fprintf(f_out, "\taddi $5,$5,1\n");
+	fprintf(f_out, "\tj label_compstr_head%d\n", generic_label_id);
+	fprintf(f_out, "label_compstr_word%d:\n", generic_label_id);
+	fprintf(f_out, "\tlw $25,0($4)\n");
+	fprintf(f_out, "\tlw $2,0($5)\n");
+	fprintf(f_out, "\tbne $25,$2,label_compstr%d\n", generic_label_id);
+	generate_zero_byte_test(f_out, 25, 3, "label_compstr");
+	fprintf(f_out, "\taddi $4,$4,4\n");
+	fprintf(f_out, "\taddi $5,$5,4\n");
+	fprintf(f_out, "\tj label_compstr_word%d\n", generic_label_id);
+
+	fprintf(f_out, "label_compstr%d:\n", generic_label_id);
+	fprintf(f_out, "\tlb $25,0($4)\n");
+	fprintf(f_out, "\tlb $2,0($5)\n");
+	fprintf(f_out, "\tsub $25,$25,$2\n");
+	fprintf(f_out, "\tbne $25,$0,label_compstr_end%d\n", generic_label_id);
+	fprintf(f_out, "\tbeq $2,$0,label_compstr_end%d\n", generic_label_id);
+	fprintf(f_out, "\taddi $4,$4,1\n");
+	fprintf(f_out, "\taddi $5,$5,1\n");
+	fprintf(f_out, "\tj label_compstr%d\n", generic_label_id);
+	fprintf(f_out, "label_compstr_end%d:\n", generic_label_id);
+	fprintf(f_out, "\taddi $2,$25,0\n");
+	generic_label_id++;
+}
+
+void generate_routine_body(enum routine r, FILE * f_out) {
+	switch (r) {
+		case RT_READ_STRING:
+			generate_read_string(f_out);
+			break;
+		case RT_SET_AT:
+			generate_set_at(f_out);
+			break;
+		case RT_STRCAT:
+			generate_strcat(f_out);
 			break;
-        	case DATA_TYPE_CHAR:
-			fprintf(f_out, "\tprint_char $25\n");
+		case RT_STRCMP:
+			generate_strcmp(f_out, 0);
 			break;
-        	case DATA_TYPE_STRING:
-			fprintf(f_out, "\tprint_string $25\n");
+		case RT_STREQ:
+			generate_strcmp(f_out, 1);
 			break;
 		default:
 			break;
 	}
-	
 }
 
-void generate_built_in(int code, int n_params, struct tac * tac, int i_tac, 
-			int * func_params, FILE * f_out, int * reg_mapping, int * var_mapping) {
+// one copy of each routine called is placed after the code, the ones
+// allocating strings save $ra for the call of rt_alloc
+void generate_routine(enum routine r, FILE * f_out) {
+	int allocates = (r == RT_READ_STRING || r == RT_SET_AT || r == RT_STRCAT);
+	fprintf(f_out, "\n%s:\n", routine_names[r]);
+	if (allocates) {
+		fprintf(f_out, "\taddi $sp,$sp,-4\n");
+		fprintf(f_out, "\tsw $ra,0($sp)\n");
+	}
+	generate_routine_body(r, f_out);
+	if (allocates) {
+		fprintf(f_out, "\tlw $ra,0($sp)\n");
+		fprintf(f_out, "\taddi $sp,$sp,4\n");
+	}
+	fprintf(f_out, "\tjr $ra\n");
+}
+
+// builtins used more often than the threshold are called, the others are
+// expanded inline
+void generate_routine_call(enum routine r, FILE * f_out) {
+	if (routine_refs[r] > runtime_threshold) {
+		fprintf(f_out, "\tjal %s\n", routine_names[r]);
+		routine_called[r] = 1;
+	}
+	else {
+		generate_routine_body(r, f_out);
+	}
+}
+
+// counts uses of the routines in the code
+void count_routine_refs(struct tac * tac) {
+	for (int r = 0; r < RT_COUNT; r++) {
+		routine_refs[r] = 0;
+		routine_called[r] = 0;
+	}
+	for (unsigned i = 0; i < tac->instructions_cnt; i++) {
+		struct tac_instruction inst = tac->instructions[i];
+		if (inst.operator == OPERATOR_CALL) {
+			switch (inst.op1.value.num) {
+				case READ_STRING_LABEL: routine_refs[RT_READ_STRING]++; break;
+				case SET_AT_LABEL: routine_refs[RT_SET_AT]++; break;
+				case STRCAT_LABEL: routine_refs[RT_STRCAT]++; break;
+			}
+		}
+		else if (inst.operator >= OPERATOR_SE &&
+			 inst.operator <= OPERATOR_SGET &&
+			 inst.data_type == DATA_TYPE_STRING) {
+			if (length_prefix && (inst.operator == OPERATOR_SE ||
+					      inst.operator == OPERATOR_SNE)) {
+				routine_refs[RT_STREQ]++;
+			}
+			else {
+				routine_refs[RT_STRCMP]++;
+			}
+		}
+	}
+}
+
+void generate_built_in(int code, struct tac * tac, int i_tac, FILE * f_out,
+			struct reg_alloc * ra) {
 	struct tac_instruction inst = tac->instructions[i_tac];
 	int res_reg;
 	switch (code) {
-		case 2: // print
-			print_one(n_params-1, tac, i_tac-1, 0, func_params, f_out);	
-			fprintf(f_out, "\taddi $sp,$sp,%d\n", n_params*4);
+		case PRINT_LABEL: // print, arguments are printed by their pushes
 			break;
-		case 3: // read char
-			res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
+		case READ_CHAR_LABEL: // read char
+			res_reg = get_result_register(ra, inst.res_num, f_out);
 			fprintf(f_out, "\tread_char $%d\n", res_reg);
 			break;
-		case 4: // read int
-			res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
+		case READ_INT_LABEL: // read int
+			res_reg = get_result_register(ra, inst.res_num, f_out);
 			fprintf(f_out, "\tread_int $%d\n", res_reg);
 			break;
-		case 5: // read string
-			res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-			fprintf(f_out, "\taddi $%d,$28,0\n", res_reg);
-			fprintf(f_out, "\tread_string $%d,$25\n", res_reg);
-			fprintf(f_out, "\tadd $28,$28,$25\n");
-			fprintf(f_out, "\tsb $0,0($28)\n");
-			fprintf(f_out, "\taddi $28,$28,1\n");
-			break;
-		case 6: // get_at
-			res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-			fprintf(f_out, "\tlw $%d,0($sp)\n",res_reg);
-			fprintf(f_out, "\tlw $25,4($sp)\n");
-			fprintf(f_out, "\tadd $25,$25,$%d\n", res_reg);
+		case READ_STRING_LABEL: // read string
+			generate_routine_call(RT_READ_STRING, f_out);
+			res_reg = get_result_register(ra, inst.res_num, f_out);
+			fprintf(f_out, "\taddi $%d,$2,0\n", res_reg);
+			uses_heap = 1;
+			break;
+		case GET_AT_LABEL: // get_at
+			res_reg = get_result_register(ra, inst.res_num, f_out);
+			fprintf(f_out, "\tadd $25,$4,$5\n");
 			fprintf(f_out, "\tlb $%d,0($25)\n", res_reg);
-			fprintf(f_out, "\taddi $sp,$sp,8\n");
-			break;
-		case 7: // set_at
-			res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-			// store adresses of strings
-			fprintf(f_out, "\taddi $%d,$28,0\n", res_reg); 
-			fprintf(f_out, "\tlw $28,8($sp)\n"); 
-			fprintf(f_out, "\taddi $sp,$sp,-4\n"); 
-			fprintf(f_out, "\tsw $%d,0($sp)\n",res_reg); 
-			// iterate through strings and do the copy
-			fprintf(f_out, "label_copystr%d:\n", generic_label_id); 
-			fprintf(f_out, "\tlb $25,0($28)\n"); 
-			fprintf(f_out, "\tsb $25,0($%d)\n", res_reg); 
-			fprintf(f_out, "\tbeq $25,$0,label_endcopystr%d\n", generic_label_id); 
-			fprintf(f_out, "\taddi $28,$28,1\n"); 
-			fprintf(f_out, "\taddi $%d,$%d,1\n", res_reg, res_reg); 
-			fprintf(f_out, "\tj label_copystr%d\n",generic_label_id); 
-			fprintf(f_out, "label_endcopystr%d:\n", generic_label_id); 
-			fprintf(f_out, "\taddi $28,$%d,1\n",res_reg); 
-			// restore adresses of strings
-			fprintf(f_out, "\tlw $%d,0($sp)\n",res_reg); 
-			fprintf(f_out, "\taddi $sp,$sp,4\n"); 
-			// change the character
-			fprintf(f_out, "\tlw $25,4($sp)\n"); 
-			fprintf(f_out, "\tadd $%d,$%d,$25\n",res_reg,res_reg); 
-			fprintf(f_out, "\tlw $25,0($sp)\n"); 
-			fprintf(f_out, "\tsb $25,0($%d)\n", res_reg); 
-			fprintf(f_out, "\tlw $25,4($sp)\n"); 
-			fprintf(f_out, "\tsub $%d,$%d,$25\n",res_reg,res_reg); 
-			fprintf(f_out, "\taddi $sp,$sp,12\n");
-			generic_label_id++;
-			break;
-		case 8: //strcat
-			res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-			// store adresses of strings
-			fprintf(f_out, "\taddi $%d,$28,0\n", res_reg); 
-			fprintf(f_out, "\tlw $28,4($sp)\n"); 
-			fprintf(f_out, "\taddi $sp,$sp,-4\n"); 
-			fprintf(f_out, "\tsw $%d,0($sp)\n",res_reg); 
-			// iterate through strings and do the copy
-			fprintf(f_out, "label_copystr%d:\n", generic_label_id); 
-			fprintf(f_out, "\tlb $25,0($28)\n"); 
-			fprintf(f_out, "\tsb $25,0($%d)\n", res_reg); 
-			fprintf(f_out, "\tbeq $25,$0,label_endcopystr%d\n", generic_label_id); 
-			fprintf(f_out, "\taddi $28,$28,1\n"); 
-			fprintf(f_out, "\taddi $%d,$%d,1\n", res_reg, res_reg); 
-			fprintf(f_out, "\tj label_copystr%d\n",generic_label_id); 
-			fprintf(f_out, "label_endcopystr%d:\n", generic_label_id); 
-			generic_label_id++;
-			// store adresses of strings
-			fprintf(f_out, "\tlw $28,4($sp)\n"); 
-			// iterate through strings and do the copy
-			fprintf(f_out, "label_copystr%d:\n", generic_label_id); 
-			fprintf(f_out, "\tlb $25,0($28)\n"); 
-			fprintf(f_out, "\tsb $25,0($%d)\n", res_reg); 
-			fprintf(f_out, "\tbeq $25,$0,label_endcopystr%d\n", generic_label_id); 
-			fprintf(f_out, "\taddi $28,$28,1\n"); 
-			fprintf(f_out, "\taddi $%d,$%d,1\n", res_reg, res_reg); 
-			fprintf(f_out, "\tj label_copystr%d\n",generic_label_id); 
-			fprintf(f_out, "label_endcopystr%d:\n", generic_label_id); 
-			// restore adresses of strings
-			fprintf(f_out, "\taddi $28,$%d,1\n",res_reg);
-			fprintf(f_out, "\tlw $%d,0($sp)\n",res_reg); 
-			fprintf(f_out, "\taddi $sp,$sp,4\n"); 
-			fprintf(f_out, "\taddi $sp,$sp,8\n");
-			generic_label_id++;
+			break;
+		case SET_AT_LABEL: // set_at
+			generate_routine_call(RT_SET_AT, f_out);
+			res_reg = get_result_register(ra, inst.res_num, f_out);
+			fprintf(f_out, "\taddi $%d,$2,0\n", res_reg);
+			uses_heap = 1;
+			break;
+		case STRCAT_LABEL: //strcat
+			generate_routine_call(RT_STRCAT, f_out);
+			res_reg = get_result_register(ra, inst.res_num, f_out);
+			fprintf(f_out, "\taddi $%d,$2,0\n", res_reg);
+			uses_heap = 1;
+			break;
+		case SET_AT_IN_PLACE_LABEL: // set_at of a string referred to by nothing else
+			res_reg = get_result_register(ra, inst.res_num, f_out);
+			fprintf(f_out, "\tadd $25,$4,$5\n");
+			fprintf(f_out, "\tsb $6,0($25)\n");
+			fprintf(f_out, "\taddi $%d,$4,0\n", res_reg);
 			break;
 	}
 }
 
+// register the argument pushed by instruction i is passed in, 0 if it is
+// pushed on the stack, arguments pushed right before a call of a builtin
+// other than print are passed in $4-$6
+int argument_register(struct tac * tac, unsigned i, const int * func_params) {
+	unsigned call = i;
+	while (call < tac->instructions_cnt &&
+	       tac->instructions[call].operator == OPERATOR_PUSH) {
+		call++;
+	}
+	if (call >= tac->instructions_cnt ||
+	    tac->instructions[call].operator != OPERATOR_CALL) {
+		return 0;
+	}
+	unsigned label = tac->instructions[call].op1.value.num;
+	if (label < GET_AT_LABEL || label > LAST_BUILTIN_LABEL || (int)(call - i) > func_params[label]) {
+		return 0;
+	}
+	return 4 + func_params[label] - (call - i);
+}
+
+// arguments of the builtin call i pushed on the stack are moved to their
+// registers, the number of them is returned
+int pop_arguments(struct tac * tac, unsigned i, const int * func_params,
+			FILE * f_out) {
+	int n = func_params[tac->instructions[i].op1.value.num];
+	int in_registers = 0;
+	while (in_registers < n && in_registers < (int)i &&
+	       tac->instructions[i - 1 - in_registers].operator == OPERATOR_PUSH) {
+		in_registers++;
+	}
+	int on_stack = n - in_registers;
+	for (int k = 0; k < on_stack; k++) {
+		fprintf(f_out, "\tlw $%d,%d($sp)\n", 4 + k, 4 * (on_stack - 1 - k));
+	}
+	if (on_stack > 0) {
+		fprintf(f_out, "\taddi $sp,$sp,%d\n", 4 * on_stack);
+	}
+	return on_stack;
+}
+
 void count_func_params(struct tac * tac, int ** func_params) {
-	unsigned n_labels = 8;
+	unsigned n_labels = 9;
 	for (unsigned i = 0; i < tac->instructions_cnt; i++) {
 		struct tac_instruction inst = tac->instructions[i];
 		if (inst.operator == OPERATOR_LABEL) {
@@ -252,109 +1096,311 @@ void count_func_params(struct tac * tac, int ** func_params) {
 	}
 
 	// n_params for built in functions
-	(*func_params)[2] = 0; // print
-	(*func_params)[3] = 0; // read_char
-	(*func_params)[4] = 0; // read_int
-	(*func_params)[5] = 0; // read_string
-	(*func_params)[6] = 2; // get_at
-	(*func_params)[7] = 3; // set_at
-	(*func_params)[8] = 2; // strcat
+	(*func_params)[PRINT_LABEL] = 0; // print
+	(*func_params)[READ_CHAR_LABEL] = 0; // read_char
+	(*func_params)[READ_INT_LABEL] = 0; // read_int
+	(*func_params)[READ_STRING_LABEL] = 0; // read_string
+	(*func_params)[GET_AT_LABEL] = 2; // get_at
+	(*func_params)[SET_AT_LABEL] = 3; // set_at
+	(*func_params)[STRCAT_LABEL] = 2; // strcat
+	(*func_params)[SET_AT_IN_PLACE_LABEL] = 3; // set_at in place
 }
 
-void compare_strings(struct tac_instruction inst, int * var_mapping, int * reg_mapping,
-			FILE * f_out, operator_t operator) {
-	int res_reg, op1_reg, op2_reg;
-	res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-	op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-	op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+/*
+ * Activation record of a function, $fp points to the last pushed argument:
+ *
+ *   4*k($fp)         k-th popped parameter (pushed by the caller)
+ *   -4($fp)          saved $ra
+ *   -8($fp)          saved $fp of the caller
+ *   -12-4*i($fp)     i-th local variable or temporary
+ *
+ * Every TAC variable belongs to exactly one function, so its offset is fixed.
+ */
+void compute_frames(struct tac * tac, unsigned n_vars, int ** var_offsets,
+			int ** frame_sizes) {
+	unsigned n_labels = 0;
+	for (unsigned i = 0; i < tac->instructions_cnt; i++) {
+		struct tac_instruction inst = tac->instructions[i];
+		if (inst.operator == OPERATOR_LABEL) {
+			if (inst.op1.value.num > n_labels) {
+				n_labels = inst.op1.value.num;
+			}
+		}
+	}
+	n_labels++;
 
-	fprintf(f_out, "\taddi $sp,$sp,-4\n");
-	fprintf(f_out, "\tsw $%d,0($sp)\n", op1_reg);
-	fprintf(f_out, "\taddi $sp,$sp,-4\n");
-	fprintf(f_out, "\tsw $%d,0($sp)\n", op2_reg);
+	*var_offsets = malloc(sizeof(int) * n_vars);
+	*frame_sizes = malloc(sizeof(int) * n_labels);
+	char * assigned = calloc(n_vars, sizeof(char));
+	assigned[0] = 1; // dummy variable of void returns
 
-	fprintf(f_out, "label_compstr%d:\n", generic_label_id);
-	fprintf(f_out, "\tlb $25,0($%d)\n", op1_reg);
-	fprintf(f_out, "\tlb $%d,0($%d)\n", res_reg, op2_reg);
-	fprintf(f_out, "\tsub $25,$25,$%d\n", res_reg);
-	fprintf(f_out, "\tbne $25,$0,label_compstr_end%d\n", generic_label_id);
-	fprintf(f_out, "\tbeq $%d,$0,label_compstr_end%d\n", res_reg, generic_label_id);
-	fprintf(f_out, "\taddi $%d,$%d,1\n", op1_reg, op1_reg);
-	fprintf(f_out, "\taddi $%d,$%d,1\n", op2_reg, op2_reg);
-	fprintf(f_out, "\tj label_compstr%d\n", generic_label_id);
-	fprintf(f_out, "label_compstr_end%d:\n", generic_label_id);
-	fprintf(f_out, "\tadd $25,$25,$%d\n", res_reg);
+	int curr_func = -1;
+	int n_pops = 0;
+	int n_locals = 0;
+	for (unsigned i = 0; i < tac->instructions_cnt; i++) {
+		struct tac_instruction inst = tac->instructions[i];
+		if (inst.operator == OPERATOR_LABEL &&
+		    inst.data_type == DATA_TYPE_FUNCTION) {
+			curr_func = inst.op1.value.num;
+			n_pops = 0;
+			n_locals = 0;
+			(*frame_sizes)[curr_func] = FRAME_HEADER_SIZE;
+			continue;
+		}
+		if (inst.operator == OPERATOR_POP) {
+			(*var_offsets)[inst.res_num] = 4 * n_pops++;
+			assigned[inst.res_num] = 1;
+			continue;
+		}
+
+		unsigned vars[3] = { inst.res_num, 0, 0 };
+		if (inst.op1.type == OPERAND_TYPE_VARIABLE) vars[1] = inst.op1.value.num;
+		if (inst.op2.type == OPERAND_TYPE_VARIABLE) vars[2] = inst.op2.value.num;
+		for (int v = 0; v < 3; v++) {
+			if (!assigned[vars[v]]) {
+				(*var_offsets)[vars[v]] = -FRAME_HEADER_SIZE - 4 - 4 * n_locals++;
+				assigned[vars[v]] = 1;
+				(*frame_sizes)[curr_func] = FRAME_HEADER_SIZE + 4 * n_locals;
+			}
+		}
+	}
+
+	free(assigned);
+}
+
+// saved registers used by the function are kept at the bottom of its frame
+void generate_prologue(int frame_size, const int * saved, int n_saved, FILE * f_out) {
+	fprintf(f_out, "\taddi $sp,$sp,%d\n", -frame_size);
+	fprintf(f_out, "\tsw $ra,%d($sp)\n", frame_size - 4);
+	fprintf(f_out, "\tsw $fp,%d($sp)\n", frame_size - 8);
+	for (int j = 0; j < n_saved; j++) {
+		fprintf(f_out, "\tsw $%d,%d($sp)\n", saved[j], 4 * j);
+	}
+	fprintf(f_out, "\taddi $fp,$sp,%d\n", frame_size);
+}
+
+// restore the state of the caller, $sp points to the arguments again
+void release_frame(int frame_size, const int * saved, int n_saved, FILE * f_out) {
+	for (int j = 0; j < n_saved; j++) {
+		fprintf(f_out, "\tlw $%d,%d($fp)\n", saved[j], 4 * j - frame_size);
+	}
+	fprintf(f_out, "\tlw $ra,-4($fp)\n");
+	fprintf(f_out, "\taddi $sp,$fp,0\n");
+	fprintf(f_out, "\tlw $fp,-8($fp)\n");
+}
+
+void generate_epilogue(int frame_size, const int * saved, int n_saved, FILE * f_out) {
+	release_frame(frame_size, saved, n_saved, f_out);
+	fprintf(f_out, "\tjr $ra\n");
+}
+
+// call whose result is returned right away, the callee takes the same number
+// of arguments as the current function, so it can take over its frame
+int is_sibling_call(struct tac * tac, unsigned i, const int * func_params,
+			int curr_func) {
+	struct tac_instruction call = tac->instructions[i];
+	if (call.op1.value.num <= LAST_BUILTIN_LABEL || i + 1 >= tac->instructions_cnt ||
+	    func_params[call.op1.value.num] != func_params[curr_func]) {
+		return 0;
+	}
+	struct tac_instruction ret = tac->instructions[i + 1];
+	if (ret.operator != OPERATOR_RETURN) {
+		return 0;
+	}
+	if (call.data_type == DATA_TYPE_VOID) {
+		return ret.data_type == DATA_TYPE_VOID;
+	}
+	return ret.op1.type == OPERAND_TYPE_VARIABLE &&
+		ret.op1.value.num == call.res_num;
+}
+
+// arguments replace the ones of the current function, the callee returns
+// directly to our caller, which pops them
+void generate_sibling_call(int label, int n_params, int frame_size,
+			const int * saved, int n_saved, FILE * f_out) {
+	for (int j = 0; j < n_params; j++) {
+		fprintf(f_out, "\tlw $25,%d($sp)\n", 4 * j);
+		fprintf(f_out, "\tsw $25,%d($fp)\n", 4 * j);
+	}
+	release_frame(frame_size, saved, n_saved, f_out);
+	fprintf(f_out, "\tj label%d\n", label);
+}
+
+// branch emitted by BZERO of a relation fused with it
+struct fused_branch {
+	const char * op; // taken when the relation does not hold, NULL if none
+	int rs;
+	int rt; // -1 for comparisons with zero
+};
+
+// relation on numbers whose only use is the following BZERO
+int is_fused_relation(struct tac * tac, unsigned i, const unsigned * n_reads) {
+	struct tac_instruction inst = tac->instructions[i];
+	if (inst.operator < OPERATOR_SE || inst.operator > OPERATOR_SGET ||
+	    inst.data_type == DATA_TYPE_STRING ||
+	    (inst.op1.type == OPERAND_TYPE_LITERAL &&
+	     inst.op2.type == OPERAND_TYPE_LITERAL) ||
+	    i + 1 >= tac->instructions_cnt || n_reads[inst.res_num] != 1) {
+		return 0;
+	}
+	struct tac_instruction next = tac->instructions[i + 1];
+	return next.operator == OPERATOR_BZERO &&
+		next.op1.type == OPERAND_TYPE_VARIABLE &&
+		next.op1.value.num == inst.res_num;
+}
+
+// load the operands of the relation and compare them into register 25 if
+// needed, the branch itself is emitted by the BZERO after write back
+void fuse_relation(struct reg_alloc * ra, struct tac_instruction inst,
+			struct fused_branch * br, FILE * f_out) {
+	operator_t operator = inst.operator;
+	short x = 1, y = 2;
+	if (inst.op1.type == OPERAND_TYPE_LITERAL) {
+		// c < x is x > c etc.
+		x = 2; y = 1;
+		switch (operator) {
+			case OPERATOR_SLT: operator = OPERATOR_SGT; break;
+			case OPERATOR_SLET: operator = OPERATOR_SGET; break;
+			case OPERATOR_SGT: operator = OPERATOR_SLT; break;
+			case OPERATOR_SGET: operator = OPERATOR_SLET; break;
+			default: break;
+		}
+	}
+	const struct tac_operand * y_operand = (y == 1) ? &inst.op1 : &inst.op2;
+	int lit = (y_operand->type == OPERAND_TYPE_LITERAL);
+	long long c = lit ? get_op_val(inst, y) : 0;
+
+	br->rs = get_operand_register(ra, inst, x, f_out);
+	br->rt = -1;
+	if (operator == OPERATOR_SE || operator == OPERATOR_SNE) {
+		br->rt = get_operand_register(ra, inst, y, f_out);
+		br->op = (operator == OPERATOR_SE) ? "bne" : "beq";
+		return;
+	}
+	if (lit && c == 0) {
+		switch (operator) {
+			case OPERATOR_SLT: br->op = "bgez"; break;
+			case OPERATOR_SLET: br->op = "bgtz"; break;
+			case OPERATOR_SGT: br->op = "blez"; break;
+			default: br->op = "bltz"; break;
+		}
+		return;
+	}
 
-	fprintf(f_out, "\taddi $%d,$%d,0\n", op2_reg, res_reg);
-	fprintf(f_out, "\taddi $%d,$25,0\n", op1_reg);
+	int x_reg = br->rs;
+	br->rs = 25;
+	br->rt = 0;
+	if (lit && (operator == OPERATOR_SLET || operator == OPERATOR_SGT) &&
+	    c < 32767 && c >= -32769) {
+		// x <= c is x < c+1
+		fprintf(f_out, "\tslti $25,$%d,%lld\n", x_reg, c + 1);
+		br->op = (operator == OPERATOR_SLET) ? "beq" : "bne";
+	}
+	else if (lit && c <= 32767 && c >= -32768 &&
+		 (operator == OPERATOR_SLT || operator == OPERATOR_SGET)) {
+		fprintf(f_out, "\tslti $25,$%d,%lld\n", x_reg, c);
+		br->op = (operator == OPERATOR_SLT) ? "beq" : "bne";
+	}
+	else {
+		int y_reg = get_operand_register(ra, inst, y, f_out);
+		switch (operator) {
+			case OPERATOR_SLT:
+			case OPERATOR_SGET:
+				fprintf(f_out, "\tslt $25,$%d,$%d\n", x_reg, y_reg);
+				br->op = (operator == OPERATOR_SLT) ? "beq" : "bne";
+				break;
+			default:
+				fprintf(f_out, "\tslt $25,$%d,$%d\n", y_reg, x_reg);
+				br->op = (operator == OPERATOR_SGT) ? "beq" : "bne";
+				break;
+		}
+	}
+}
+
+void compare_strings(struct tac_instruction inst, struct reg_alloc * ra,
+			FILE * f_out, operator_t operator) {
+	int res_reg, op1_reg, op2_reg;
+	op1_reg = get_operand_register(ra, inst, 1, f_out);
+	op2_reg = get_operand_register(ra, inst, 2, f_out);
+	fprintf(f_out, "\taddi $4,$%d,0\n", op1_reg);
+	fprintf(f_out, "\taddi $5,$%d,0\n", op2_reg);
+	if (operator == OPERATOR_SE || operator == OPERATOR_SNE) {
+		generate_routine_call(length_prefix ? RT_STREQ : RT_STRCMP, f_out);
+	}
+	else {
+		generate_routine_call(RT_STRCMP, f_out);
+	}
+	res_reg = get_result_register(ra, inst.res_num, f_out);
 
 	switch (operator) {
 		case OPERATOR_SLT:
-			fprintf(f_out, "\tslt $%d,$%d,$%d\n", res_reg, op1_reg, op2_reg);
+			fprintf(f_out, "\tslt $%d,$2,$0\n", res_reg);
 			break;
 		case OPERATOR_SLET:
-			fprintf(f_out, "\tslt $%d,$%d,$%d\n", res_reg, op2_reg, op1_reg);
-			fprintf(f_out, "\tlui $25,0xFFFF\n");
-			fprintf(f_out, "\tori $25,$25,0xFFFE\n");
-			fprintf(f_out, "\tnor $%d,$%d,$25\n", res_reg, res_reg);
+			fprintf(f_out, "\tslt $%d,$0,$2\n", res_reg);
+			fprintf(f_out, "\txori $%d,$%d,1\n", res_reg, res_reg);
 			break;
 		case OPERATOR_SGET:
-			fprintf(f_out, "\tslt $%d,$%d,$%d\n", res_reg, op1_reg, op2_reg);
-			fprintf(f_out, "\tlui $25,0xFFFF\n");
-			fprintf(f_out, "\tori $25,$25,0xFFFE\n");
-			fprintf(f_out, "\tnor $%d,$%d,$25\n", res_reg, res_reg);
+			fprintf(f_out, "\tslt $%d,$2,$0\n", res_reg);
+			fprintf(f_out, "\txori $%d,$%d,1\n", res_reg, res_reg);
 			break;
 		case OPERATOR_SGT:
-			fprintf(f_out, "\tslt $%d,$%d,$%d\n", res_reg, op2_reg, op1_reg);
+			fprintf(f_out, "\tslt $%d,$0,$2\n", res_reg);
 			break;
 		case OPERATOR_SE:
-			fprintf(f_out, "\tsub $%d,$%d,$%d\n", res_reg, op1_reg, op2_reg);
-			fprintf(f_out, "\tsltu $%d,$zero,$%d\n", res_reg, res_reg);
-			fprintf(f_out, "\tlui $25,0xFFFF\n");
-			fprintf(f_out, "\tori $25,$25,0xFFFE\n");
-			fprintf(f_out, "\tnor $%d,$%d,$25\n", res_reg, res_reg);
+			fprintf(f_out, "\tsltiu $%d,$2,1\n", res_reg);
 			break;
 		case OPERATOR_SNE:
-			fprintf(f_out, "\tsub $%d,$%d,$%d\n", res_reg, op1_reg, op2_reg);
-			fprintf(f_out, "\tsltu $%d,$zero,$%d\n", res_reg, res_reg);
+			fprintf(f_out, "\tsltu $%d,$0,$2\n", res_reg);
 			break;
 		default:
 			break;
 	}
-
-	fprintf(f_out, "\tlw $%d,0($sp)\n", op2_reg);
-	fprintf(f_out, "\taddi $sp,$sp,4\n");
-	fprintf(f_out, "\tlw $%d,0($sp)\n", op1_reg);
-	fprintf(f_out, "\taddi $sp,$sp,4\n");
-
-	generic_label_id++;
-
 }
 
-void generate_code(struct tac * tac_mapped, FILE * f_out) {
+void generate_code(struct tac * tac_mapped, FILE * f_out,
+			const struct gen_code_params * params) {
+	length_prefix = params->length_prefix;
+	runtime_threshold = params->runtime_threshold;
+
 	// gather data to be declared in the end
-	unsigned n_strings = count_string_literals(tac_mapped);
+	char ** p_lit_strings; unsigned n_strings;
+	collect_string_literals(tac_mapped, &p_lit_strings, &n_strings);
 	unsigned n_vars = count_vars(tac_mapped);
-	char ** p_lit_strings = malloc(sizeof(char*) * n_strings);
-	unsigned i_string = 0;
 
 	int * func_params;
 	count_func_params(tac_mapped, &func_params);
 	int n_pushes = 0;
+	struct print_arg * print_args = match_print_args(tac_mapped, func_params);
+
+	// lay out activation records
+	int * var_offsets; int * frame_sizes;
+	compute_frames(tac_mapped, n_vars, &var_offsets, &frame_sizes);
 
-	// create mappings between variables and registers
-	int * var_mapping; int * reg_mapping;
-	unsigned res_reg, op1_reg, op2_reg;
-	create_variable_mapping(n_vars, &var_mapping);
-	create_register_mapping(&reg_mapping);
+	// compute live intervals for register allocation
+	struct reg_alloc * ra = reg_alloc_init(tac_mapped, n_vars, var_offsets);
+	unsigned res_reg, op1_reg, op2_reg; int arg_reg;
+	int saved_regs[8]; int n_saved = 0; int frame_size = 0;
+	int curr_func = 0; int tail_call = 0;
+	struct fused_branch fused = { NULL, 0, 0 };
+
+	// relations used only by a conditional jump are fused with it
+	unsigned * n_reads = calloc(n_vars, sizeof(unsigned));
+	for (unsigned i = 0; i < tac_mapped->instructions_cnt; i++) {
+		struct tac_instruction inst = tac_mapped->instructions[i];
+		if (inst.op1.type == OPERAND_TYPE_VARIABLE) n_reads[inst.op1.value.num]++;
+		if (inst.op2.type == OPERAND_TYPE_VARIABLE) n_reads[inst.op2.value.num]++;
+	}
 
 	// id counter for auxiliary labels
 	generic_label_id = 0;
+	uses_heap = 0;
+	count_routine_refs(tac_mapped);
 
 	// initial settings
 	fprintf(f_out,".text\n");
 	fprintf(f_out,".org 0\n");
-	fprintf(f_out,"li $sp,0x00800000\n");
+	fprintf(f_out,"li $sp,0x%08X\n", STACK_TOP);
 	fprintf(f_out,"la $28,heap\n");
 
 	// call main and break after it's finished
@@ -363,123 +1409,167 @@ void generate_code(struct tac * tac_mapped, FILE * f_out) {
 
 	for (unsigned i = 0; i < tac_mapped->instructions_cnt; i++) {
 		struct tac_instruction inst = tac_mapped->instructions[i];
+		begin_instruction(ra, i);
 		switch (inst.operator) {
 			case OPERATOR_LABEL:
-				clear_mappings(var_mapping, n_vars, reg_mapping, f_out);
 				fprintf(f_out, "\nlabel%d:\n",inst.op1.value.num);
+				if (inst.data_type == DATA_TYPE_FUNCTION) {
+					curr_func = inst.op1.value.num;
+					// main returns to the startup code, no need to save registers
+					n_saved = (inst.op1.value.num == MAIN_LABEL) ? 0 :
+						used_saved_registers(ra, i, saved_regs);
+					frame_size = frame_sizes[inst.op1.value.num] + 4 * n_saved;
+					generate_prologue(frame_size, saved_regs, n_saved, f_out);
+				}
 				break;
 			case OPERATOR_ASSIGN:
 				if ((inst.data_type == DATA_TYPE_STRING) && 
 				    (inst.op1.type == OPERAND_TYPE_LITERAL)) { //string literal
-					p_lit_strings[i_string] = inst.op1.value.string_val;
-					res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-					fprintf(f_out, "\tla $%d,str%d\n", res_reg, i_string);
-					i_string++;
+					res_reg = get_result_register(ra, inst.res_num, f_out);
+					fprintf(f_out, "\tla $%d,str%u\n", res_reg,
+						string_label(p_lit_strings, n_strings,
+							     inst.op1.value.string_val));
 				}
 				else if (inst.data_type == DATA_TYPE_STRING) { //string
 					// not doing deep copy, because we cannot change the string anyway
-					res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-					op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
+					op1_reg = get_operand_register(ra, inst, 1, f_out);
+					res_reg = get_result_register(ra, inst.res_num, f_out);
 					fprintf(f_out, "\taddi $%d,$%d,0\n", res_reg, op1_reg);
 				}
 				else if (inst.op1.type == OPERAND_TYPE_LITERAL) { // int or char literal
-					res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
+					res_reg = get_result_register(ra, inst.res_num, f_out);
 					fprintf(f_out, "\tli $%d,%d\n", res_reg, get_op_val(inst, 1));
 				}
 				else { // int or char
-					res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-					op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
+					op1_reg = get_operand_register(ra, inst, 1, f_out);
+					res_reg = get_result_register(ra, inst.res_num, f_out);
 					fprintf(f_out, "\taddi $%d,$%d,0\n", res_reg, op1_reg);
 				}	
 				break;
 			case OPERATOR_SLT:
+				if (is_fused_relation(tac_mapped, i, n_reads)) {
+					fuse_relation(ra, inst, &fused, f_out);
+					break;
+				}
 				if (inst.data_type == DATA_TYPE_STRING) {
-					compare_strings(inst, var_mapping, reg_mapping, f_out, OPERATOR_SLT);
+					compare_strings(inst, ra, f_out, OPERATOR_SLT);
 					break;
 				}
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				if (generate_immediate(ra, inst, f_out)) break;
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tslt $%d,$%d,$%d\n", res_reg, op1_reg, op2_reg);
 				break;
 			case OPERATOR_SLET:
+				if (is_fused_relation(tac_mapped, i, n_reads)) {
+					fuse_relation(ra, inst, &fused, f_out);
+					break;
+				}
 				if (inst.data_type == DATA_TYPE_STRING) {
-					compare_strings(inst, var_mapping, reg_mapping, f_out, OPERATOR_SLET);
+					compare_strings(inst, ra, f_out, OPERATOR_SLET);
 					break;
 				}
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				if (generate_immediate(ra, inst, f_out)) break;
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tslt $%d,$%d,$%d\n", res_reg, op2_reg, op1_reg);
-				fprintf(f_out, "\tlui $25,0xFFFF\n");
-				fprintf(f_out, "\tori $25,$25,0xFFFE\n");
-				fprintf(f_out, "\tnor $%d,$%d,$25\n", res_reg, res_reg);
+				fprintf(f_out, "\txori $%d,$%d,1\n", res_reg, res_reg);
 				break;
 			case OPERATOR_SGET:
+				if (is_fused_relation(tac_mapped, i, n_reads)) {
+					fuse_relation(ra, inst, &fused, f_out);
+					break;
+				}
 				if (inst.data_type == DATA_TYPE_STRING) {
-					compare_strings(inst, var_mapping, reg_mapping, f_out, OPERATOR_SGET);
+					compare_strings(inst, ra, f_out, OPERATOR_SGET);
 					break;
 				}
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				if (generate_immediate(ra, inst, f_out)) break;
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tslt $%d,$%d,$%d\n", res_reg, op1_reg, op2_reg);
-				fprintf(f_out, "\tlui $25,0xFFFF\n");
-				fprintf(f_out, "\tori $25,$25,0xFFFE\n");
-				fprintf(f_out, "\tnor $%d,$%d,$25\n", res_reg, res_reg);
+				fprintf(f_out, "\txori $%d,$%d,1\n", res_reg, res_reg);
 				break;
 			case OPERATOR_SGT:
+				if (is_fused_relation(tac_mapped, i, n_reads)) {
+					fuse_relation(ra, inst, &fused, f_out);
+					break;
+				}
 				if (inst.data_type == DATA_TYPE_STRING) {
-					compare_strings(inst, var_mapping, reg_mapping, f_out, OPERATOR_SGT);
+					compare_strings(inst, ra, f_out, OPERATOR_SGT);
 					break;
 				}
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				if (generate_immediate(ra, inst, f_out)) break;
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tslt $%d,$%d,$%d\n", res_reg, op2_reg, op1_reg);
 				break;
 			case OPERATOR_SE:
+				if (is_fused_relation(tac_mapped, i, n_reads)) {
+					fuse_relation(ra, inst, &fused, f_out);
+					break;
+				}
 				if (inst.data_type == DATA_TYPE_STRING) {
-					compare_strings(inst, var_mapping, reg_mapping, f_out, OPERATOR_SE);
+					compare_strings(inst, ra, f_out, OPERATOR_SE);
 					break;
 				}
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				if (generate_immediate(ra, inst, f_out)) break;
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tsub $%d,$%d,$%d\n", res_reg, op1_reg, op2_reg);
 				fprintf(f_out, "\tsltu $%d,$zero,$%d\n", res_reg, res_reg);
-				fprintf(f_out, "\tlui $25,0xFFFF\n");
-				fprintf(f_out, "\tori $25,$25,0xFFFE\n");
-				fprintf(f_out, "\tnor $%d,$%d,$25\n", res_reg, res_reg);
+				fprintf(f_out, "\txori $%d,$%d,1\n", res_reg, res_reg);
 				break;
 			case OPERATOR_SNE:
+				if (is_fused_relation(tac_mapped, i, n_reads)) {
+					fuse_relation(ra, inst, &fused, f_out);
+					break;
+				}
 				if (inst.data_type == DATA_TYPE_STRING) {
-					compare_strings(inst, var_mapping, reg_mapping, f_out, OPERATOR_SNE);
+					compare_strings(inst, ra, f_out, OPERATOR_SNE);
 					break;
 				}
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				if (generate_immediate(ra, inst, f_out)) break;
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tsub $%d,$%d,$%d\n", res_reg, op1_reg, op2_reg);
 				fprintf(f_out, "\tsltu $%d,$zero,$%d\n", res_reg, res_reg);
 				break;
 			case OPERATOR_BZERO:
-				clear_mappings(var_mapping, n_vars, reg_mapping, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
+				if (fused.op != NULL) {
+					write_back_registers(ra, f_out);
+					if (fused.rt == -1) {
+						fprintf(f_out, "\t%s $%d, label%d\n", fused.op,
+							fused.rs, inst.op2.value.num);
+					}
+					else {
+						fprintf(f_out, "\t%s $%d, $%d, label%d\n", fused.op,
+							fused.rs, fused.rt, inst.op2.value.num);
+					}
+					fused.op = NULL;
+					break;
+				}
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				write_back_registers(ra, f_out);
 				fprintf(f_out, "\tbeq $%d, $0, label%d\n", op1_reg, inst.op2.value.num);
 				break;
 			case OPERATOR_NEG:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tsltu $%d,$zero,$%d\n", res_reg, op1_reg);
-				fprintf(f_out, "\tlui $25,0xFFFF\n");
-				fprintf(f_out, "\tori $25,$25,0xFFFE\n");
-				fprintf(f_out, "\tnor $%d,$%d,$25\n", res_reg, res_reg);
+				fprintf(f_out, "\txori $%d,$%d,1\n", res_reg, res_reg);
 				break;
 			case OPERATOR_AND:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				if (generate_immediate(ra, inst, f_out)) break;
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\taddi $%d,$zero,0\n", res_reg);
 				fprintf(f_out, "\tbeq $%d, $0, labelgen%d\n", op1_reg, generic_label_id);
 				fprintf(f_out, "\tbeq $%d, $0, labelgen%d\n", op2_reg, generic_label_id);
@@ -488,9 +1578,10 @@ void generate_code(struct tac * tac_mapped, FILE * f_out) {
 				generic_label_id++;
 				break;
 			case OPERATOR_OR:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				if (generate_immediate(ra, inst, f_out)) break;
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\taddi $%d,$zero,1\n", res_reg);
 				fprintf(f_out, "\tbne $%d, $0, labelgen%d\n", op1_reg, generic_label_id);
 				fprintf(f_out, "\tbne $%d, $0, labelgen%d\n", op2_reg, generic_label_id);
@@ -499,167 +1590,197 @@ void generate_code(struct tac * tac_mapped, FILE * f_out) {
 				generic_label_id++;
 				break;
 			case OPERATOR_JUMP:
-				clear_mappings(var_mapping, n_vars, reg_mapping, f_out);
+				write_back_registers(ra, f_out);
 				fprintf(f_out, "\tj label%d\n",inst.op1.value.num);
 				break;
 			case OPERATOR_SUB:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				if (generate_immediate(ra, inst, f_out)) break;
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tsub $%d,$%d,$%d\n", res_reg, op1_reg, op2_reg);
 				break;
 			case OPERATOR_ADD:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				if (generate_immediate(ra, inst, f_out)) break;
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tadd $%d,$%d,$%d\n", res_reg, op1_reg, op2_reg);
 				break;
 			case OPERATOR_DIV:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tdiv $%d,$%d\n", op1_reg, op2_reg);
 				fprintf(f_out, "\tmflo $%d\n", res_reg);
 				break;
 			case OPERATOR_MOD:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tdiv $%d,$%d\n", op1_reg, op2_reg);
 				fprintf(f_out, "\tmfhi $%d\n", res_reg);
 				break;
 			case OPERATOR_MUL:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				op2_reg = get_register(var_mapping, reg_mapping, inst.op2.value.num, inst, f_out);
+				if (generate_immediate(ra, inst, f_out)) break;
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				op2_reg = get_operand_register(ra, inst, 2, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\tmul $%d,$%d,$%d\n", res_reg, op1_reg, op2_reg);
 				break;
 			case OPERATOR_POP:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				fprintf(f_out, "\tlw $%d,0($fp)\n", res_reg);
-				fprintf(f_out,"\taddi $fp,$fp,4\n");
+				// parameter lives in its argument slot, see compute_frames
+				load_parameter(ra, inst.res_num, f_out);
 				break;
 			case OPERATOR_PUSH:
+				if (print_args[i].call != 0 && print_args[i].flush >= 0) {
+					n_pushes -= flush_print_args(tac_mapped, print_args,
+								     i, f_out);
+				}
+				if (string_literal(inst) != NULL) {
+					// literal arguments of print joined at compile time
+					fprintf(f_out, "\tla $25,str%u\n",
+						string_label(p_lit_strings, n_strings,
+							     inst.op1.value.string_val));
+					op1_reg = 25;
+				}
+				else {
+					op1_reg = get_operand_register(ra, inst, 1, f_out);
+				}
+				if (print_args[i].call != 0 && print_args[i].flush >= 0) {
+					generate_print(f_out, inst.data_type, op1_reg);
+					break;
+				}
+				arg_reg = argument_register(tac_mapped, i, func_params);
+				if (arg_reg != 0) {
+					fprintf(f_out,"\taddi $%d,$%d,0\n",arg_reg,op1_reg);
+					break;
+				}
 				// push param on stack
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
 				fprintf(f_out,"\taddi $sp,$sp,-4\n");
 				fprintf(f_out,"\tsw $%d,0($sp)\n",op1_reg);
 				n_pushes++;
 				break;
 			case OPERATOR_CALL:
-				n_pushes -= func_params[inst.op1.value.num];
-
-				if ((inst.op1.value.num >=2) && inst.op1.value.num <= 8) {
+				if (inst.op1.value.num >= FIRST_BUILTIN_LABEL &&
+				    inst.op1.value.num <= LAST_BUILTIN_LABEL) {
 					// built in function
-					generate_built_in(inst.op1.value.num, n_pushes, tac_mapped, i, 
-								func_params, f_out, reg_mapping, var_mapping);
-					if (inst.op1.value.num == 2) n_pushes = 0;
+					if (inst.op1.value.num == PRINT_LABEL) {
+						n_pushes -= flush_print_args(tac_mapped,
+							print_args, i, f_out);
+					}
+					else {
+						n_pushes -= pop_arguments(tac_mapped, i,
+							func_params, f_out);
+					}
+					generate_built_in(inst.op1.value.num, tac_mapped, i,
+							  f_out, ra);
 					break;
 				}
-				// push old FP
-				fprintf(f_out,"\taddi $sp,$sp,-4\n");
-				fprintf(f_out,"\tsw $fp,0($sp)\n");
-				// set new FP 
-				fprintf(f_out,"\taddi $fp,$sp,4\n");
-				// push old RA
-				fprintf(f_out,"\taddi $sp,$sp,-4\n");
-				fprintf(f_out,"\tsw $ra,0($sp)\n");
-				// push vars
-				clear_mappings(var_mapping, n_vars, reg_mapping, f_out);
-				fprintf(f_out,"\tjal push_registers\n");
-				// call
+				n_pushes -= func_params[inst.op1.value.num];
+				if (is_sibling_call(tac_mapped, i, func_params, curr_func)) {
+					generate_sibling_call(inst.op1.value.num,
+						func_params[curr_func], frame_size,
+						saved_regs, n_saved, f_out);
+					tail_call = 1; // the return is done by the callee
+					break;
+				}
+				// save temporary registers live across the call
+				save_live_registers(ra, f_out);
+				// call, callee saves $ra and $fp in its own frame
 				fprintf(f_out,"\tjal label%d\n",inst.op1.value.num);
-				// pop vars
-				clear_mappings(var_mapping, n_vars, reg_mapping, f_out);
-				fprintf(f_out,"\tjal pop_registers\n");
-				// pop ra
-				fprintf(f_out,"\tlw $ra,0($sp)\n");
-				fprintf(f_out,"\taddi $sp,$sp,4\n");
-				// pop fp + params	
-				fprintf(f_out,"\taddi $25,$fp,0\n");
-				fprintf(f_out,"\tlw $fp,0($sp)\n");
-				fprintf(f_out,"\taddi $sp,$25,0\n");
+				// pop params
+				if (func_params[inst.op1.value.num] > 0) {
+					fprintf(f_out,"\taddi $sp,$sp,%d\n",
+						4 * func_params[inst.op1.value.num]);
+				}
+				restore_live_registers(ra, f_out);
 				// save return value
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out,"\taddi $%d,$2,0\n",res_reg);
 				break;
 			case OPERATOR_RETURN:
+				if (tail_call) {
+					tail_call = 0;
+					break;
+				}
 				if (inst.op1.type == OPERAND_TYPE_LITERAL) {
 					if (inst.data_type == DATA_TYPE_STRING) {
-						p_lit_strings[i_string] = inst.op1.value.string_val;
-						fprintf(f_out, "\tla $2,str%d\n", i_string);
-						i_string++;
+						fprintf(f_out, "\tla $2,str%u\n",
+							string_label(p_lit_strings, n_strings,
+								     inst.op1.value.string_val));
 					}
 					else {
 						fprintf(f_out,"\tli $2,%d\n",get_op_val(inst,1));
-						fprintf(f_out, "\tjr $ra\n");
 					}
 				}
-				else {
-					op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
+				else if (inst.data_type != DATA_TYPE_VOID) {
+					op1_reg = get_operand_register(ra, inst, 1, f_out);
 					fprintf(f_out,"\taddi $2,$%d,0\n",op1_reg);
-					fprintf(f_out, "\tjr $ra\n");
 				}
+				generate_epilogue(frame_size, saved_regs, n_saved, f_out);
 				break;
 			case OPERATOR_CAST_INT_TO_CHAR:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				fprintf(f_out, "\tli $%d,0\n",res_reg);
-				fprintf(f_out, "\taddi $%d,$%d,0\n",res_reg,op1_reg);
-				fprintf(f_out, "\tli $25,0x00FF\n");
-				fprintf(f_out, "\tand $%d,$%d,$25\n",res_reg,res_reg);
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
+				fprintf(f_out, "\tandi $%d,$%d,0x00FF\n",res_reg,op1_reg);
 				break;
 			case OPERATOR_CAST_CHAR_TO_INT:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				fprintf(f_out, "\tli $%d,0\n",res_reg);
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
 				fprintf(f_out, "\taddi $%d,$%d,0\n",res_reg,op1_reg);
-				//fprintf(f_out, "\tli $25,0x000F\n");
-				//fprintf(f_out, "\tand $%d,$%d,$25\n",res_reg,res_reg);
 				break;
 			case OPERATOR_CAST_CHAR_TO_STRING:
-				res_reg = get_register(var_mapping, reg_mapping, inst.res_num, inst, f_out);
-				op1_reg = get_register(var_mapping, reg_mapping, inst.op1.value.num, inst, f_out);
-				fprintf(f_out, "\taddi $%d,$28,0\n",res_reg);
-				fprintf(f_out, "\tsb $%d,0($%d)\n",op1_reg,res_reg);
-				fprintf(f_out, "\tsb $0,1($%d)\n",res_reg);
-				fprintf(f_out, "\taddi $28,$28,2\n");
+				op1_reg = get_operand_register(ra, inst, 1, f_out);
+				res_reg = get_result_register(ra, inst.res_num, f_out);
+				if (length_prefix) {
+					fprintf(f_out, "\taddi $4,$0,6\n");
+					fprintf(f_out, "\tjal rt_alloc\n");
+					fprintf(f_out, "\tsb $%d,4($2)\n",op1_reg);
+					fprintf(f_out, "\tsb $0,5($2)\n");
+					fprintf(f_out, "\taddi $4,$0,1\n");
+					fprintf(f_out, "\tsw $4,0($2)\n");
+					fprintf(f_out, "\taddi $%d,$2,4\n",res_reg);
+				}
+				else {
+					fprintf(f_out, "\taddi $4,$0,2\n");
+					fprintf(f_out, "\tjal rt_alloc\n");
+					fprintf(f_out, "\tsb $%d,0($2)\n",op1_reg);
+					fprintf(f_out, "\tsb $0,1($2)\n");
+					fprintf(f_out, "\taddi $%d,$2,0\n",res_reg);
+				}
+				uses_heap = 1;
 				break;
 			default:
 				fprintf(f_out, "\tMISSING INSTR\n");
 				break;
 		}
+		end_instruction(ra, f_out);
 	}
 
-	// generate push_registers function
-	fprintf(f_out,"\npush_registers:\n");
-	for (unsigned i_reg = 0; i_reg < n_vars; i_reg++) {
-		fprintf(f_out,"\taddi $sp,$sp,-4\n");
-		fprintf(f_out,"\tla $25,var%d\n",i_reg);
-		fprintf(f_out,"\tlw $8,0($25)\n");
-		fprintf(f_out,"\tsw $8,0($sp)\n");
-	}
-	fprintf(f_out,"\tjr $ra\n");
-
-	// generate pop_registers function
-	fprintf(f_out,"\npop_registers:\n");
-	for (int i_reg = n_vars-1; i_reg >= 0; i_reg--) {
-		fprintf(f_out,"\tla $25,var%d\n",i_reg);
-		fprintf(f_out,"\tlw $8,0($sp)\n");
-		fprintf(f_out,"\tsw $8,0($25)\n");
-		fprintf(f_out,"\taddi $sp,$sp,4\n");
+	if (uses_heap) generate_runtime(f_out);
+	for (int r = 0; r < RT_COUNT; r++) {
+		if (routine_called[r]) generate_routine(r, f_out);
 	}
-	fprintf(f_out,"\tjr $ra\n");
 
-	// print data - strings + variables
+	// print data - strings only, variables live in activation records
 	fprintf(f_out,"\n.data\n");
 	print_string_literals(f_out, p_lit_strings, n_strings);
-	print_vars(f_out, n_vars);
 	fprintf(f_out,"\n.align 4\n");
+	if (uses_heap) {
+		// free lists and the heap limit, zero limit collects at first
+		fprintf(f_out,"\nrt_free:\t.space\t64\n");
+		fprintf(f_out,"rt_limit:\t.word\t0\n");
+	}
 	fprintf(f_out,"\nheap:\n");
 
+	free(p_lit_strings);
 	free(func_params);
+	free(print_args);
+	free(n_reads);
+	free(var_offsets);
+	free(frame_sizes);
 
-	// dealocate register and variable mappings
-	destroy_mappings(reg_mapping, var_mapping);
+	// dealocate register allocator
+	reg_alloc_free(ra);
 }
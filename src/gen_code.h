@@ -10,7 +10,16 @@
 
 #include "tac.h"
 
-void generate_code(struct tac * tac, FILE * f_out);
+#define RUNTIME_THRESHOLD_DEFAULT 1
+
+struct gen_code_params {
+	int length_prefix; // strings are preceded by their length
+	// string builtins used more times are called, not expanded inline
+	unsigned runtime_threshold;
+};
+
+void generate_code(struct tac * tac, FILE * f_out,
+			const struct gen_code_params * params);
 
 
 #endif //GEN_CODE_H
@@ -0,0 +1,1493 @@
+/*
+ * project: VYPe15 programming language compiler
+ * author: Jan Wrona <xwrona00@stud.fit.vutbr.cz>
+ * author: Katerina Zmolikova <xzmoli02@stud.fit.vutbr.cz>
+ * date: 2015
+ */
+/*
+ * Self-contained MIPS32 assembler and cycle counting simulator. Accepts the
+ * assembly dialect emitted by generate_code() (including the print_* and
+ * read_* pseudo-instructions of the MIPS32-Lissom simulator) and reports
+ * dynamic execution statistics after the program hits BREAK.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+
+#define MEM_SIZE 0x00800000 //stack starts here and grows down
+#define MAX_LABEL_LEN 128
+#define MAX_OPERANDS 3
+#define LINE_MAX_LEN 4096
+
+/* Cycle cost model of a simple in-order pipeline without delay slots. */
+#define CYCLES_TAKEN_BRANCH 1 //extra cycles for taken branch or jump
+#define CYCLES_LOAD_USE 1 //extra cycles when loaded value is used next
+#define CYCLES_MUL 3 //extra cycles for multiplication
+#define CYCLES_DIV 34 //extra cycles for division
+
+
+typedef enum {
+        OP_INVALID,
+
+        /* R-type ALU. */
+        OP_ADD, OP_ADDU, OP_SUB, OP_SUBU, OP_AND, OP_OR, OP_XOR, OP_NOR,
+        OP_SLT, OP_SLTU, OP_SLLV, OP_SRLV, OP_SRAV, OP_MOVN, OP_MOVZ, OP_MUL,
+        /* Shifts by immediate. */
+        OP_SLL, OP_SRL, OP_SRA,
+        /* HI/LO. */
+        OP_MULT, OP_MULTU, OP_DIV, OP_DIVU, OP_MFHI, OP_MFLO, OP_MTHI, OP_MTLO,
+        /* I-type ALU. */
+        OP_ADDI, OP_ADDIU, OP_ANDI, OP_ORI, OP_XORI, OP_SLTI, OP_SLTIU, OP_LUI,
+        /* Memory. */
+        OP_LW, OP_LH, OP_LHU, OP_LB, OP_LBU, OP_SW, OP_SH, OP_SB,
+        /* Branches and jumps. */
+        OP_BEQ, OP_BNE, OP_BLEZ, OP_BGTZ, OP_BLTZ, OP_BGEZ,
+        OP_J, OP_JAL, OP_JR, OP_JALR,
+        /* Special. */
+        OP_BREAK, OP_PRINT_INT, OP_PRINT_CHAR, OP_PRINT_STRING,
+        OP_READ_INT, OP_READ_CHAR, OP_READ_STRING,
+
+        OP_CNT,
+} opcode_t;
+
+typedef enum {
+        FMT_NONE, //break
+        FMT_RD_RS_RT, //add rd,rs,rt
+        FMT_RD_RT_SA, //sll rd,rt,sa
+        FMT_RD_RT_RS, //sllv rd,rt,rs
+        FMT_RS_RT, //mult rs,rt
+        FMT_RD, //mfhi rd
+        FMT_RS, //mthi rs, jr rs
+        FMT_RT_RS_IMM, //addi rt,rs,imm
+        FMT_RT_IMM, //lui rt,imm
+        FMT_RT_MEM, //lw rt,off(rs)
+        FMT_RS_RT_LABEL, //beq rs,rt,label
+        FMT_RS_LABEL, //blez rs,label
+        FMT_LABEL, //j label
+        FMT_JALR, //jalr [rd,]rs
+        FMT_R, //print_int r
+        FMT_R_R, //read_string rd,rl
+} format_t;
+
+struct opcode_desc {
+        const char *name;
+        opcode_t op;
+        format_t fmt;
+};
+
+static const struct opcode_desc opcodes[] = {
+        {"add", OP_ADD, FMT_RD_RS_RT},
+        {"addu", OP_ADDU, FMT_RD_RS_RT},
+        {"sub", OP_SUB, FMT_RD_RS_RT},
+        {"subu", OP_SUBU, FMT_RD_RS_RT},
+        {"and", OP_AND, FMT_RD_RS_RT},
+        {"or", OP_OR, FMT_RD_RS_RT},
+        {"xor", OP_XOR, FMT_RD_RS_RT},
+        {"nor", OP_NOR, FMT_RD_RS_RT},
+        {"slt", OP_SLT, FMT_RD_RS_RT},
+        {"sltu", OP_SLTU, FMT_RD_RS_RT},
+        {"sllv", OP_SLLV, FMT_RD_RT_RS},
+        {"srlv", OP_SRLV, FMT_RD_RT_RS},
+        {"srav", OP_SRAV, FMT_RD_RT_RS},
+        {"movn", OP_MOVN, FMT_RD_RS_RT},
+        {"movz", OP_MOVZ, FMT_RD_RS_RT},
+        {"mul", OP_MUL, FMT_RD_RS_RT},
+        {"sll", OP_SLL, FMT_RD_RT_SA},
+        {"srl", OP_SRL, FMT_RD_RT_SA},
+        {"sra", OP_SRA, FMT_RD_RT_SA},
+        {"mult", OP_MULT, FMT_RS_RT},
+        {"multu", OP_MULTU, FMT_RS_RT},
+        {"div", OP_DIV, FMT_RS_RT},
+        {"divu", OP_DIVU, FMT_RS_RT},
+        {"mfhi", OP_MFHI, FMT_RD},
+        {"mflo", OP_MFLO, FMT_RD},
+        {"mthi", OP_MTHI, FMT_RS},
+        {"mtlo", OP_MTLO, FMT_RS},
+        {"addi", OP_ADDI, FMT_RT_RS_IMM},
+        {"addiu", OP_ADDIU, FMT_RT_RS_IMM},
+        {"andi", OP_ANDI, FMT_RT_RS_IMM},
+        {"ori", OP_ORI, FMT_RT_RS_IMM},
+        {"xori", OP_XORI, FMT_RT_RS_IMM},
+        {"slti", OP_SLTI, FMT_RT_RS_IMM},
+        {"sltiu", OP_SLTIU, FMT_RT_RS_IMM},
+        {"lui", OP_LUI, FMT_RT_IMM},
+        {"lw", OP_LW, FMT_RT_MEM},
+        {"lh", OP_LH, FMT_RT_MEM},
+        {"lhu", OP_LHU, FMT_RT_MEM},
+        {"lb", OP_LB, FMT_RT_MEM},
+        {"lbu", OP_LBU, FMT_RT_MEM},
+        {"sw", OP_SW, FMT_RT_MEM},
+        {"sh", OP_SH, FMT_RT_MEM},
+        {"sb", OP_SB, FMT_RT_MEM},
+        {"beq", OP_BEQ, FMT_RS_RT_LABEL},
+        {"bne", OP_BNE, FMT_RS_RT_LABEL},
+        {"blez", OP_BLEZ, FMT_RS_LABEL},
+        {"bgtz", OP_BGTZ, FMT_RS_LABEL},
+        {"bltz", OP_BLTZ, FMT_RS_LABEL},
+        {"bgez", OP_BGEZ, FMT_RS_LABEL},
+        {"j", OP_J, FMT_LABEL},
+        {"jal", OP_JAL, FMT_LABEL},
+        {"jr", OP_JR, FMT_RS},
+        {"jalr", OP_JALR, FMT_JALR},
+        {"break", OP_BREAK, FMT_NONE},
+        {"print_int", OP_PRINT_INT, FMT_R},
+        {"print_char", OP_PRINT_CHAR, FMT_R},
+        {"print_string", OP_PRINT_STRING, FMT_R},
+        {"read_int", OP_READ_INT, FMT_R},
+        {"read_char", OP_READ_CHAR, FMT_R},
+        {"read_string", OP_READ_STRING, FMT_R_R},
+};
+
+static const char *register_names[32] = {
+        "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+        "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+        "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+        "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra",
+};
+
+
+struct instruction {
+        opcode_t op;
+        unsigned rd, rs, rt;
+        int32_t imm; //immediate, shift amount or memory offset
+        char *label; //unresolved branch/jump/address target or NULL
+        unsigned label_half; //0 = whole address, 1 = upper half, 2 = lower
+        unsigned line; //source line for error messages
+};
+
+struct label {
+        char *name;
+        int is_data; //label belongs to the data section
+        uint32_t offset; //offset in its section
+};
+
+struct data_fixup { //.int with label operand
+        uint32_t offset;
+        char *label;
+        unsigned line;
+};
+
+struct program {
+        struct instruction *text;
+        size_t text_cnt;
+        size_t text_size;
+
+        uint8_t *data;
+        size_t data_cnt;
+        size_t data_size;
+
+        struct label *labels;
+        size_t labels_cnt;
+        size_t labels_size;
+
+        struct data_fixup *fixups;
+        size_t fixups_cnt;
+        size_t fixups_size;
+
+        uint32_t data_base; //address of the data section
+        uint32_t heap_base; //address of "heap" label or 0
+        uint32_t org; //address of the first instruction
+};
+
+struct stats {
+        uint64_t instructions;
+        uint64_t cycles;
+        uint64_t per_opcode[OP_CNT];
+        uint64_t loads;
+        uint64_t stores;
+        uint64_t branches; //conditional branches executed
+        uint64_t branches_taken;
+        uint64_t jumps; //unconditional jumps, calls and returns
+        uint64_t calls; //jal and jalr
+        uint64_t syscalls; //print_* and read_* pseudo-instructions
+        uint32_t min_sp;
+        uint32_t max_heap;
+};
+
+
+static const char *input_name;
+static unsigned line_num;
+
+
+static void fatal(const char *message)
+{
+        fprintf(stderr, "mipssim: %s:%u: %s\n", input_name, line_num, message);
+        exit(EXIT_FAILURE);
+}
+
+static void *xrealloc(void *ptr, size_t size)
+{
+        ptr = realloc(ptr, size);
+        if (ptr == NULL) {
+                fprintf(stderr, "mipssim: memory exhausted\n");
+                exit(EXIT_FAILURE);
+        }
+
+        return ptr;
+}
+
+#define GROW(arr, cnt, size) do { \
+        if ((cnt) == (size)) { \
+                (size) = ((size) == 0) ? 64 : (size) * 2; \
+                (arr) = xrealloc((arr), (size) * sizeof (*(arr))); \
+        } \
+} while (0)
+
+
+/*
+ * Assembler.
+ */
+static const char *skip_space(const char *s)
+{
+        while (*s == ' ' || *s == '\t' || *s == '\r') {
+                s++;
+        }
+
+        return s;
+}
+
+static void add_label(struct program *p, const char *name, int is_data)
+{
+        for (size_t i = 0; i < p->labels_cnt; ++i) {
+                if (strcmp(p->labels[i].name, name) == 0) {
+                        fatal("label redefined");
+                }
+        }
+
+        GROW(p->labels, p->labels_cnt, p->labels_size);
+        p->labels[p->labels_cnt].name = strdup(name);
+        p->labels[p->labels_cnt].is_data = is_data;
+        p->labels[p->labels_cnt].offset = is_data ? p->data_cnt :
+                p->text_cnt * 4;
+        p->labels_cnt++;
+}
+
+static int find_label(const struct program *p, const char *name, uint32_t *addr)
+{
+        for (size_t i = 0; i < p->labels_cnt; ++i) {
+                if (strcmp(p->labels[i].name, name) == 0) {
+                        *addr = p->labels[i].offset + (p->labels[i].is_data ?
+                                        p->data_base : p->org);
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+static void data_put(struct program *p, uint8_t byte)
+{
+        GROW(p->data, p->data_cnt, p->data_size);
+        p->data[p->data_cnt++] = byte;
+}
+
+static void data_put_word(struct program *p, uint32_t word) //big endian
+{
+        data_put(p, word >> 24);
+        data_put(p, word >> 16);
+        data_put(p, word >> 8);
+        data_put(p, word);
+}
+
+static void text_put(struct program *p, struct instruction instr)
+{
+        instr.line = line_num;
+        GROW(p->text, p->text_cnt, p->text_size);
+        p->text[p->text_cnt++] = instr;
+}
+
+static int parse_register(const char *tok, unsigned *reg)
+{
+        char *end;
+        long num;
+
+
+        if (tok[0] != '$') {
+                return 1;
+        }
+        tok++;
+
+        if (isdigit((unsigned char)tok[0])) {
+                num = strtol(tok, &end, 10);
+                if (*end != '\0' || num < 0 || num > 31) {
+                        return 1;
+                }
+                *reg = num;
+                return 0;
+        }
+
+        for (unsigned i = 0; i < 32; ++i) {
+                if (strcasecmp(tok, register_names[i]) == 0) {
+                        *reg = i;
+                        return 0;
+                }
+        }
+        if (strcasecmp(tok, "s8") == 0) {
+                *reg = 30;
+                return 0;
+        }
+
+        return 1;
+}
+
+static int parse_immediate(const char *tok, int32_t *imm)
+{
+        char *end;
+        long long num;
+
+
+        if (tok[0] == '\'' && tok[1] != '\0' && tok[2] == '\'') {
+                *imm = (unsigned char)tok[1];
+                return 0;
+        }
+
+        num = strtoll(tok, &end, 0);
+        if (end == tok || *end != '\0') {
+                return 1;
+        }
+        *imm = (int32_t)num;
+
+        return 0;
+}
+
+static void need_register(const char *tok, unsigned *reg)
+{
+        if (tok == NULL || parse_register(tok, reg) != 0) {
+                fatal("register operand expected");
+        }
+}
+
+static void need_immediate(const char *tok, int32_t *imm)
+{
+        if (tok == NULL || parse_immediate(tok, imm) != 0) {
+                fatal("immediate operand expected");
+        }
+}
+
+static void need_label(const char *tok, char **label)
+{
+        if (tok == NULL || !(isalpha((unsigned char)tok[0]) || tok[0] == '_' ||
+                                tok[0] == '.')) {
+                fatal("label operand expected");
+        }
+        *label = strdup(tok);
+}
+
+/* Split operand string at commas, trim whitespace. */
+static size_t split_operands(char *s, char *ops[MAX_OPERANDS + 1])
+{
+        size_t cnt = 0;
+
+
+        for (size_t i = 0; i <= MAX_OPERANDS; ++i) {
+                ops[i] = NULL;
+        }
+
+        s = (char *)skip_space(s);
+        if (*s == '\0') {
+                return 0;
+        }
+
+        while (s != NULL && cnt <= MAX_OPERANDS) {
+                char *comma = strchr(s, ',');
+                char *end;
+
+                if (comma != NULL) {
+                        *comma = '\0';
+                }
+                s = (char *)skip_space(s);
+                end = s + strlen(s);
+                while (end > s && isspace((unsigned char)end[-1])) {
+                        *--end = '\0';
+                }
+                ops[cnt++] = s;
+                s = (comma != NULL) ? comma + 1 : NULL;
+        }
+        if (s != NULL) {
+                fatal("too many operands");
+        }
+
+        return cnt;
+}
+
+static void assemble_memory_operand(const char *tok, struct instruction *in)
+{
+        const char *paren;
+        char buf[MAX_LABEL_LEN];
+        size_t len;
+
+
+        if (tok == NULL || (paren = strchr(tok, '(')) == NULL) {
+                fatal("memory operand expected");
+        }
+        len = paren - tok;
+        if (len >= sizeof (buf)) {
+                fatal("memory operand too long");
+        }
+        memcpy(buf, tok, len);
+        buf[len] = '\0';
+        if (len == 0) {
+                in->imm = 0;
+        } else {
+                need_immediate(buf, &in->imm);
+        }
+
+        strncpy(buf, paren + 1, sizeof (buf) - 1);
+        buf[sizeof (buf) - 1] = '\0';
+        if (strchr(buf, ')') == NULL) {
+                fatal("missing ')' in memory operand");
+        }
+        *strchr(buf, ')') = '\0';
+        need_register(buf, &in->rs);
+}
+
+/* Expand li/la/move/nop/b pseudo-instructions the way a real assembler does. */
+static int assemble_pseudo(struct program *p, const char *mnem, char **ops,
+                size_t ops_cnt)
+{
+        struct instruction in = {0};
+
+
+        if (strcmp(mnem, "li") == 0) {
+                int32_t imm;
+
+                if (ops_cnt != 2) {
+                        fatal("li expects 2 operands");
+                }
+                need_register(ops[0], &in.rt);
+                need_immediate(ops[1], &imm);
+                if (imm >= -32768 && imm <= 32767) {
+                        in.op = OP_ADDIU;
+                        in.imm = imm;
+                        text_put(p, in);
+                } else if (imm >= 0 && imm <= 0xFFFF) {
+                        in.op = OP_ORI;
+                        in.imm = imm;
+                        text_put(p, in);
+                } else {
+                        in.op = OP_LUI;
+                        in.imm = (uint32_t)imm >> 16;
+                        text_put(p, in);
+                        if ((imm & 0xFFFF) != 0) {
+                                in.op = OP_ORI;
+                                in.rs = in.rt;
+                                in.imm = imm & 0xFFFF;
+                                text_put(p, in);
+                        }
+                }
+        } else if (strcmp(mnem, "la") == 0) {
+                if (ops_cnt != 2) {
+                        fatal("la expects 2 operands");
+                }
+                need_register(ops[0], &in.rt);
+                in.op = OP_LUI;
+                need_label(ops[1], &in.label);
+                in.label_half = 1;
+                text_put(p, in);
+                in.op = OP_ORI;
+                in.rs = in.rt;
+                need_label(ops[1], &in.label);
+                in.label_half = 2;
+                text_put(p, in);
+        } else if (strcmp(mnem, "move") == 0) {
+                if (ops_cnt != 2) {
+                        fatal("move expects 2 operands");
+                }
+                in.op = OP_ADDU;
+                need_register(ops[0], &in.rd);
+                need_register(ops[1], &in.rs);
+                text_put(p, in);
+        } else if (strcmp(mnem, "nop") == 0) {
+                in.op = OP_SLL;
+                text_put(p, in);
+        } else if (strcmp(mnem, "b") == 0) {
+                if (ops_cnt != 1) {
+                        fatal("b expects 1 operand");
+                }
+                in.op = OP_BEQ;
+                need_label(ops[0], &in.label);
+                text_put(p, in);
+        } else if (strcmp(mnem, "beqz") == 0 || strcmp(mnem, "bnez") == 0) {
+                if (ops_cnt != 2) {
+                        fatal("beqz/bnez expects 2 operands");
+                }
+                in.op = (mnem[1] == 'e') ? OP_BEQ : OP_BNE;
+                need_register(ops[0], &in.rs);
+                need_label(ops[1], &in.label);
+                text_put(p, in);
+        } else {
+                return 1; //not a pseudo-instruction
+        }
+
+        return 0;
+}
+
+static void assemble_instruction(struct program *p, char *mnem, char *rest)
+{
+        char *ops[MAX_OPERANDS + 1];
+        size_t ops_cnt;
+        const struct opcode_desc *desc = NULL;
+        struct instruction in = {0};
+        static const size_t expected[] = {
+                [FMT_NONE] = 0, [FMT_RD_RS_RT] = 3, [FMT_RD_RT_SA] = 3,
+                [FMT_RD_RT_RS] = 3,
+                [FMT_RS_RT] = 2, [FMT_RD] = 1, [FMT_RS] = 1,
+                [FMT_RT_RS_IMM] = 3, [FMT_RT_IMM] = 2, [FMT_RT_MEM] = 2,
+                [FMT_RS_RT_LABEL] = 3, [FMT_RS_LABEL] = 2, [FMT_LABEL] = 1,
+                [FMT_JALR] = 0, [FMT_R] = 1, [FMT_R_R] = 2,
+        };
+
+
+        for (char *c = mnem; *c != '\0'; ++c) {
+                *c = tolower((unsigned char)*c);
+        }
+
+        ops_cnt = split_operands(rest, ops);
+        if (assemble_pseudo(p, mnem, ops, ops_cnt) == 0) {
+                return;
+        }
+
+        for (size_t i = 0; i < sizeof (opcodes) / sizeof (opcodes[0]); ++i) {
+                if (strcmp(opcodes[i].name, mnem) == 0) {
+                        desc = &opcodes[i];
+                        break;
+                }
+        }
+        if (desc == NULL) {
+                fatal("unknown instruction");
+        }
+        if (desc->fmt == FMT_JALR) {
+                if (ops_cnt != 1 && ops_cnt != 2) {
+                        fatal("bad operand count");
+                }
+        } else if (ops_cnt != expected[desc->fmt]) {
+                fatal("bad operand count");
+        }
+
+        in.op = desc->op;
+        switch (desc->fmt) {
+        case FMT_NONE:
+                break;
+        case FMT_RD_RS_RT:
+                need_register(ops[0], &in.rd);
+                need_register(ops[1], &in.rs);
+                need_register(ops[2], &in.rt);
+                break;
+        case FMT_RD_RT_RS:
+                need_register(ops[0], &in.rd);
+                need_register(ops[1], &in.rt);
+                need_register(ops[2], &in.rs);
+                break;
+        case FMT_RD_RT_SA:
+                need_register(ops[0], &in.rd);
+                need_register(ops[1], &in.rt);
+                need_immediate(ops[2], &in.imm);
+                in.imm &= 0x1F;
+                break;
+        case FMT_RS_RT:
+                need_register(ops[0], &in.rs);
+                need_register(ops[1], &in.rt);
+                break;
+        case FMT_RD:
+                need_register(ops[0], &in.rd);
+                break;
+        case FMT_RS:
+        case FMT_R:
+                need_register(ops[0], &in.rs);
+                break;
+        case FMT_R_R:
+                need_register(ops[0], &in.rs);
+                need_register(ops[1], &in.rt);
+                break;
+        case FMT_RT_RS_IMM:
+                need_register(ops[0], &in.rt);
+                need_register(ops[1], &in.rs);
+                need_immediate(ops[2], &in.imm);
+                break;
+        case FMT_RT_IMM:
+                need_register(ops[0], &in.rt);
+                need_immediate(ops[1], &in.imm);
+                break;
+        case FMT_RT_MEM:
+                need_register(ops[0], &in.rt);
+                assemble_memory_operand(ops[1], &in);
+                break;
+        case FMT_RS_RT_LABEL:
+                need_register(ops[0], &in.rs);
+                need_register(ops[1], &in.rt);
+                need_label(ops[2], &in.label);
+                break;
+        case FMT_RS_LABEL:
+                need_register(ops[0], &in.rs);
+                need_label(ops[1], &in.label);
+                break;
+        case FMT_LABEL:
+                need_label(ops[0], &in.label);
+                break;
+        case FMT_JALR:
+                if (ops_cnt == 1) {
+                        in.rd = 31;
+                        need_register(ops[0], &in.rs);
+                } else {
+                        need_register(ops[0], &in.rd);
+                        need_register(ops[1], &in.rs);
+                }
+                break;
+        }
+
+        text_put(p, in);
+}
+
+/* Parse a quoted string starting at *s, which may span several lines. */
+static void assemble_string(struct program *p, const char **s, int terminate)
+{
+        const char *c = skip_space(*s);
+
+
+        if (*c != '"') {
+                fatal("string literal expected");
+        }
+        c++;
+
+        while (*c != '"') {
+                if (*c == '\0') {
+                        fatal("unterminated string literal");
+                } else if (*c == '\n') {
+                        line_num++;
+                }
+
+                if (*c == '\\') {
+                        c++;
+                        switch (*c) {
+                        case 'n':
+                                data_put(p, '\n');
+                                break;
+                        case 't':
+                                data_put(p, '\t');
+                                break;
+                        case '0':
+                                data_put(p, '\0');
+                                break;
+                        case '\0':
+                                fatal("unterminated string literal");
+                                break;
+                        default:
+                                data_put(p, *c);
+                                break;
+                        }
+                } else {
+                        data_put(p, *c);
+                }
+                c++;
+        }
+
+        if (terminate) {
+                data_put(p, '\0');
+        }
+        *s = c + 1;
+}
+
+static void assemble_directive(struct program *p, const char *dir,
+                const char **s, int in_data)
+{
+        char line[LINE_MAX_LEN];
+        const char *end;
+        char *ops[MAX_OPERANDS + 1];
+
+
+        if (strcmp(dir, ".asciz") == 0 || strcmp(dir, ".ascii") == 0) {
+                if (!in_data) {
+                        fatal("string outside of .data");
+                }
+                assemble_string(p, s, dir[5] == 'z');
+                return;
+        }
+
+        /* Other directives operate on the rest of the line. */
+        end = strchr(*s, '\n');
+        if (end == NULL) {
+                end = *s + strlen(*s);
+        }
+        if ((size_t)(end - *s) >= sizeof (line)) {
+                fatal("line too long");
+        }
+        memcpy(line, *s, end - *s);
+        line[end - *s] = '\0';
+        *s = end;
+
+        if (strcmp(dir, ".text") == 0 || strcmp(dir, ".data") == 0) {
+                return; //handled by the caller
+        } else if (strcmp(dir, ".org") == 0) {
+                int32_t org;
+
+                need_immediate(skip_space(line), &org);
+                if (in_data || p->text_cnt != 0) {
+                        fatal(".org supported only at the start of .text");
+                }
+                p->org = org;
+        } else if (strcmp(dir, ".align") == 0) {
+                int32_t align;
+
+                need_immediate(skip_space(line), &align);
+                if (align <= 0) {
+                        fatal("bad alignment");
+                }
+                if (in_data) {
+                        while (p->data_cnt % align != 0) {
+                                data_put(p, 0);
+                        }
+                }
+        } else if (strcmp(dir, ".int") == 0 || strcmp(dir, ".word") == 0 ||
+                   strcmp(dir, ".byte") == 0 || strcmp(dir, ".space") == 0) {
+                char *tok = line;
+
+                if (!in_data) {
+                        fatal("data directive outside of .data");
+                }
+                if (dir[1] != 'b' && dir[1] != 's' && p->data_cnt % 4 != 0) {
+                        const uint32_t unaligned = p->data_cnt;
+
+                        /* Words are implicitly aligned, so are their labels. */
+                        while (p->data_cnt % 4 != 0) {
+                                data_put(p, 0);
+                        }
+                        for (size_t i = 0; i < p->labels_cnt; ++i) {
+                                if (p->labels[i].is_data &&
+                                    p->labels[i].offset == unaligned) {
+                                        p->labels[i].offset = p->data_cnt;
+                                }
+                        }
+                }
+                while (tok != NULL) {
+                        char *comma = strchr(tok, ',');
+                        int32_t val;
+
+                        if (comma != NULL) {
+                                *comma = '\0';
+                        }
+                        split_operands(tok, ops);
+                        if (ops[0] == NULL) {
+                                fatal("data value expected");
+                        }
+                        if (dir[1] == 'b') {
+                                need_immediate(ops[0], &val);
+                                data_put(p, val);
+                        } else if (dir[1] == 's') {
+                                need_immediate(ops[0], &val);
+                                while (val-- > 0) {
+                                        data_put(p, 0);
+                                }
+                        } else if (parse_immediate(ops[0], &val) == 0) {
+                                data_put_word(p, val);
+                        } else {
+                                GROW(p->fixups, p->fixups_cnt, p->fixups_size);
+                                p->fixups[p->fixups_cnt].offset = p->data_cnt;
+                                need_label(ops[0],
+                                           &p->fixups[p->fixups_cnt].label);
+                                p->fixups[p->fixups_cnt].line = line_num;
+                                p->fixups_cnt++;
+                                data_put_word(p, 0);
+                        }
+                        tok = (comma != NULL) ? comma + 1 : NULL;
+                }
+        } else {
+                fatal("unknown directive");
+        }
+}
+
+static void assemble(struct program *p, const char *src)
+{
+        const char *s = src;
+        int in_data = 0;
+
+
+        line_num = 1;
+        while (*s != '\0') {
+                char tok[MAX_LABEL_LEN];
+                size_t len = 0;
+
+                s = skip_space(s);
+
+                /* Comments and empty lines. */
+                if (*s == '\n') {
+                        line_num++;
+                        s++;
+                        continue;
+                } else if (*s == '#' || (s[0] == '/' && s[1] == '/')) {
+                        while (*s != '\0' && *s != '\n') {
+                                s++;
+                        }
+                        continue;
+                } else if (s[0] == '/' && s[1] == '*') {
+                        s += 2;
+                        while (*s != '\0' && !(s[0] == '*' && s[1] == '/')) {
+                                if (*s++ == '\n') {
+                                        line_num++;
+                                }
+                        }
+                        if (*s != '\0') {
+                                s += 2;
+                        }
+                        continue;
+                } else if (*s == '\0') {
+                        break;
+                }
+
+                /* Label, directive or mnemonic. */
+                while (isalnum((unsigned char)*s) || *s == '_' || *s == '.') {
+                        if (len + 1 >= sizeof (tok)) {
+                                fatal("identifier too long");
+                        }
+                        tok[len++] = *s++;
+                }
+                tok[len] = '\0';
+                if (len == 0) {
+                        fatal("unexpected character");
+                }
+
+                if (*s == ':') { //label definition
+                        s++;
+                        add_label(p, tok, in_data);
+                        if (in_data && strcmp(tok, "heap") == 0) {
+                                p->heap_base = 1; //resolved after assembly
+                        }
+                } else if (tok[0] == '.') { //directive
+                        if (strcmp(tok, ".text") == 0) {
+                                in_data = 0;
+                        } else if (strcmp(tok, ".data") == 0) {
+                                in_data = 1;
+                        }
+                        assemble_directive(p, tok, &s, in_data);
+                } else { //instruction
+                        char rest[LINE_MAX_LEN];
+                        const char *end = s;
+
+                        if (in_data) {
+                                fatal("instruction inside of .data");
+                        }
+                        while (*end != '\0' && *end != '\n' && *end != '#' &&
+                               !(end[0] == '/' && (end[1] == '/' ||
+                                                   end[1] == '*'))) {
+                                end++;
+                        }
+                        if ((size_t)(end - s) >= sizeof (rest)) {
+                                fatal("line too long");
+                        }
+                        memcpy(rest, s, end - s);
+                        rest[end - s] = '\0';
+                        s = end;
+                        assemble_instruction(p, tok, rest);
+                }
+        }
+}
+
+static void resolve(struct program *p)
+{
+        /* Data follows the code, aligned to a 16 byte boundary. */
+        p->data_base = (p->org + p->text_cnt * 4 + 15) & ~15u;
+        if (p->data_base + p->data_cnt >= MEM_SIZE) {
+                fprintf(stderr, "mipssim: program does not fit into memory\n");
+                exit(EXIT_FAILURE);
+        }
+
+        for (size_t i = 0; i < p->text_cnt; ++i) {
+                struct instruction *in = &p->text[i];
+                uint32_t addr;
+
+                if (in->label == NULL) {
+                        continue;
+                }
+                line_num = in->line;
+                if (!find_label(p, in->label, &addr)) {
+                        fatal("undefined label");
+                }
+                if (in->label_half == 1) {
+                        in->imm = addr >> 16;
+                } else if (in->label_half == 2) {
+                        in->imm = addr & 0xFFFF;
+                } else {
+                        in->imm = addr;
+                }
+        }
+
+        for (size_t i = 0; i < p->fixups_cnt; ++i) {
+                uint32_t addr;
+                uint32_t off = p->fixups[i].offset;
+
+                line_num = p->fixups[i].line;
+                if (!find_label(p, p->fixups[i].label, &addr)) {
+                        fatal("undefined label");
+                }
+                p->data[off] = addr >> 24;
+                p->data[off + 1] = addr >> 16;
+                p->data[off + 2] = addr >> 8;
+                p->data[off + 3] = addr;
+        }
+
+        if (p->heap_base) {
+                find_label(p, "heap", &p->heap_base);
+        }
+}
+
+
+/*
+ * Simulator.
+ */
+static uint8_t *mem;
+static uint32_t regs[32];
+static uint32_t hi, lo;
+static struct stats stats;
+static const struct program *prog;
+static uint32_t cur_pc;
+
+
+static void sim_fatal(const char *message, uint32_t addr)
+{
+        fprintf(stderr, "mipssim: pc 0x%08" PRIx32 " (line %u): %s "
+                        "(address 0x%08" PRIx32 ")\n", cur_pc,
+                        prog->text[(cur_pc - prog->org) / 4].line, message,
+                        addr);
+        exit(EXIT_FAILURE);
+}
+
+static void check_access(uint32_t addr, unsigned size)
+{
+        if (addr >= MEM_SIZE || MEM_SIZE - addr < size) {
+                sim_fatal("memory access out of range", addr);
+        } else if (addr % size != 0) {
+                sim_fatal("unaligned memory access", addr);
+        }
+}
+
+static uint32_t load(uint32_t addr, unsigned size)
+{
+        uint32_t val = 0;
+
+
+        check_access(addr, size);
+        for (unsigned i = 0; i < size; ++i) { //big endian
+                val = (val << 8) | mem[addr + i];
+        }
+
+        return val;
+}
+
+static void note_heap_write(uint32_t addr, unsigned size)
+{
+        if (prog->heap_base != 0 && addr >= prog->heap_base &&
+            addr < regs[29] && addr + size - prog->heap_base > stats.max_heap) {
+                stats.max_heap = addr + size - prog->heap_base;
+        }
+}
+
+static void store(uint32_t addr, uint32_t val, unsigned size)
+{
+        check_access(addr, size);
+        for (unsigned i = size; i-- > 0; ) {
+                mem[addr + i] = val;
+                val >>= 8;
+        }
+        note_heap_write(addr, size);
+}
+
+/* Read one line from stdin, strip the EOL. Returns length or -1 on EOF. */
+static long read_line(char *buf, size_t size)
+{
+        size_t len;
+
+
+        if (fgets(buf, size, stdin) == NULL) {
+                buf[0] = '\0';
+                return -1;
+        }
+        len = strlen(buf);
+        while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\r')) {
+                buf[--len] = '\0';
+        }
+
+        return len;
+}
+
+static int reads_register(const struct instruction *in, unsigned reg)
+{
+        if (reg == 0) {
+                return 0;
+        }
+
+        switch (in->op) {
+        case OP_SLL: case OP_SRL: case OP_SRA:
+                return in->rt == reg;
+        case OP_ADDI: case OP_ADDIU: case OP_ANDI: case OP_ORI: case OP_XORI:
+        case OP_SLTI: case OP_SLTIU: case OP_LW: case OP_LH: case OP_LHU:
+        case OP_LB: case OP_LBU: case OP_BLEZ: case OP_BGTZ: case OP_BLTZ:
+        case OP_BGEZ: case OP_JR: case OP_JALR: case OP_MTHI: case OP_MTLO:
+        case OP_PRINT_INT: case OP_PRINT_CHAR: case OP_PRINT_STRING:
+                return in->rs == reg;
+        case OP_LUI: case OP_MFHI: case OP_MFLO: case OP_J: case OP_JAL:
+        case OP_BREAK: case OP_READ_INT: case OP_READ_CHAR:
+                return 0;
+        default:
+                return in->rs == reg || in->rt == reg;
+        }
+}
+
+static void simulate(const struct program *p)
+{
+        char buf[LINE_MAX_LEN];
+        unsigned pending_load = 0; //destination of the previous load or 0
+
+
+        prog = p;
+        mem = calloc(MEM_SIZE, 1);
+        if (mem == NULL) {
+                fprintf(stderr, "mipssim: memory exhausted\n");
+                exit(EXIT_FAILURE);
+        }
+        memcpy(mem + p->data_base, p->data, p->data_cnt);
+        stats.min_sp = MEM_SIZE;
+        regs[29] = MEM_SIZE;
+
+        cur_pc = p->org;
+        while (1) {
+                const struct instruction *in;
+                uint32_t next_pc = cur_pc + 4;
+                uint32_t rs, rt, addr;
+                int taken = 0;
+                unsigned loaded = 0;
+
+                if (cur_pc < p->org || cur_pc % 4 != 0 ||
+                    (cur_pc - p->org) / 4 >= p->text_cnt) {
+                        fprintf(stderr, "mipssim: pc 0x%08" PRIx32 " outside "
+                                        "of the program\n", cur_pc);
+                        exit(EXIT_FAILURE);
+                }
+                in = &p->text[(cur_pc - p->org) / 4];
+                rs = regs[in->rs];
+                rt = regs[in->rt];
+
+                stats.instructions++;
+                stats.cycles++;
+                stats.per_opcode[in->op]++;
+                if (pending_load != 0 && reads_register(in, pending_load)) {
+                        stats.cycles += CYCLES_LOAD_USE;
+                }
+
+                switch (in->op) {
+                case OP_ADD: case OP_ADDU:
+                        regs[in->rd] = rs + rt;
+                        break;
+                case OP_SUB: case OP_SUBU:
+                        regs[in->rd] = rs - rt;
+                        break;
+                case OP_AND:
+                        regs[in->rd] = rs & rt;
+                        break;
+                case OP_OR:
+                        regs[in->rd] = rs | rt;
+                        break;
+                case OP_XOR:
+                        regs[in->rd] = rs ^ rt;
+                        break;
+                case OP_NOR:
+                        regs[in->rd] = ~(rs | rt);
+                        break;
+                case OP_SLT:
+                        regs[in->rd] = (int32_t)rs < (int32_t)rt;
+                        break;
+                case OP_SLTU:
+                        regs[in->rd] = rs < rt;
+                        break;
+                case OP_SLLV:
+                        regs[in->rd] = rt << (rs & 0x1F);
+                        break;
+                case OP_SRLV:
+                        regs[in->rd] = rt >> (rs & 0x1F);
+                        break;
+                case OP_SRAV:
+                        regs[in->rd] = (uint32_t)((int32_t)rt >> (rs & 0x1F));
+                        break;
+                case OP_MOVN:
+                        if (rt != 0) {
+                                regs[in->rd] = rs;
+                        }
+                        break;
+                case OP_MOVZ:
+                        if (rt == 0) {
+                                regs[in->rd] = rs;
+                        }
+                        break;
+                case OP_MUL:
+                        regs[in->rd] = (uint32_t)((int32_t)rs * (int64_t)(int32_t)rt);
+                        stats.cycles += CYCLES_MUL;
+                        break;
+                case OP_SLL:
+                        regs[in->rd] = rt << in->imm;
+                        break;
+                case OP_SRL:
+                        regs[in->rd] = rt >> in->imm;
+                        break;
+                case OP_SRA:
+                        regs[in->rd] = (uint32_t)((int32_t)rt >> in->imm);
+                        break;
+                case OP_MULT: {
+                        int64_t r = (int64_t)(int32_t)rs * (int32_t)rt;
+                        lo = (uint32_t)r;
+                        hi = (uint32_t)((uint64_t)r >> 32);
+                        stats.cycles += CYCLES_MUL;
+                        break;
+                }
+                case OP_MULTU: {
+                        uint64_t r = (uint64_t)rs * rt;
+                        lo = (uint32_t)r;
+                        hi = (uint32_t)(r >> 32);
+                        stats.cycles += CYCLES_MUL;
+                        break;
+                }
+                case OP_DIV:
+                        if (rt != 0 && !(rs == 0x80000000u && rt == 0xFFFFFFFFu)) {
+                                lo = (uint32_t)((int32_t)rs / (int32_t)rt);
+                                hi = (uint32_t)((int32_t)rs % (int32_t)rt);
+                        }
+                        stats.cycles += CYCLES_DIV;
+                        break;
+                case OP_DIVU:
+                        if (rt != 0) {
+                                lo = rs / rt;
+                                hi = rs % rt;
+                        }
+                        stats.cycles += CYCLES_DIV;
+                        break;
+                case OP_MFHI:
+                        regs[in->rd] = hi;
+                        break;
+                case OP_MFLO:
+                        regs[in->rd] = lo;
+                        break;
+                case OP_MTHI:
+                        hi = rs;
+                        break;
+                case OP_MTLO:
+                        lo = rs;
+                        break;
+                case OP_ADDI: case OP_ADDIU:
+                        regs[in->rt] = rs + (uint32_t)(int16_t)in->imm;
+                        break;
+                case OP_ANDI:
+                        regs[in->rt] = rs & (in->imm & 0xFFFF);
+                        break;
+                case OP_ORI:
+                        regs[in->rt] = rs | (in->imm & 0xFFFF);
+                        break;
+                case OP_XORI:
+                        regs[in->rt] = rs ^ (in->imm & 0xFFFF);
+                        break;
+                case OP_SLTI:
+                        regs[in->rt] = (int32_t)rs < (int16_t)in->imm;
+                        break;
+                case OP_SLTIU:
+                        regs[in->rt] = rs < (uint32_t)(int32_t)(int16_t)in->imm;
+                        break;
+                case OP_LUI:
+                        regs[in->rt] = (uint32_t)in->imm << 16;
+                        break;
+                case OP_LW:
+                        regs[in->rt] = load(rs + in->imm, 4);
+                        loaded = in->rt;
+                        stats.loads++;
+                        break;
+                case OP_LH:
+                        regs[in->rt] = (uint32_t)(int16_t)load(rs + in->imm, 2);
+                        loaded = in->rt;
+                        stats.loads++;
+                        break;
+                case OP_LHU:
+                        regs[in->rt] = load(rs + in->imm, 2);
+                        loaded = in->rt;
+                        stats.loads++;
+                        break;
+                case OP_LB:
+                        regs[in->rt] = (uint32_t)(int8_t)load(rs + in->imm, 1);
+                        loaded = in->rt;
+                        stats.loads++;
+                        break;
+                case OP_LBU:
+                        regs[in->rt] = load(rs + in->imm, 1);
+                        loaded = in->rt;
+                        stats.loads++;
+                        break;
+                case OP_SW:
+                        store(rs + in->imm, rt, 4);
+                        stats.stores++;
+                        break;
+                case OP_SH:
+                        store(rs + in->imm, rt, 2);
+                        stats.stores++;
+                        break;
+                case OP_SB:
+                        store(rs + in->imm, rt, 1);
+                        stats.stores++;
+                        break;
+                case OP_BEQ:
+                        taken = (rs == rt);
+                        stats.branches++;
+                        break;
+                case OP_BNE:
+                        taken = (rs != rt);
+                        stats.branches++;
+                        break;
+                case OP_BLEZ:
+                        taken = ((int32_t)rs <= 0);
+                        stats.branches++;
+                        break;
+                case OP_BGTZ:
+                        taken = ((int32_t)rs > 0);
+                        stats.branches++;
+                        break;
+                case OP_BLTZ:
+                        taken = ((int32_t)rs < 0);
+                        stats.branches++;
+                        break;
+                case OP_BGEZ:
+                        taken = ((int32_t)rs >= 0);
+                        stats.branches++;
+                        break;
+                case OP_J:
+                        next_pc = in->imm;
+                        stats.jumps++;
+                        stats.cycles += CYCLES_TAKEN_BRANCH;
+                        break;
+                case OP_JAL:
+                        regs[31] = cur_pc + 4;
+                        next_pc = in->imm;
+                        stats.jumps++;
+                        stats.calls++;
+                        stats.cycles += CYCLES_TAKEN_BRANCH;
+                        break;
+                case OP_JR:
+                        next_pc = rs;
+                        stats.jumps++;
+                        stats.cycles += CYCLES_TAKEN_BRANCH;
+                        break;
+                case OP_JALR:
+                        regs[in->rd] = cur_pc + 4;
+                        next_pc = rs;
+                        stats.jumps++;
+                        stats.calls++;
+                        stats.cycles += CYCLES_TAKEN_BRANCH;
+                        break;
+                case OP_BREAK:
+                        return;
+                case OP_PRINT_INT:
+                        printf("%" PRId32, (int32_t)rs);
+                        stats.syscalls++;
+                        break;
+                case OP_PRINT_CHAR:
+                        putchar((int)(rs & 0xFF));
+                        stats.syscalls++;
+                        break;
+                case OP_PRINT_STRING:
+                        for (addr = rs; ; ++addr) {
+                                check_access(addr, 1);
+                                if (mem[addr] == '\0') {
+                                        break;
+                                }
+                                putchar(mem[addr]);
+                        }
+                        stats.syscalls++;
+                        break;
+                case OP_READ_INT:
+                        fflush(stdout);
+                        read_line(buf, sizeof (buf));
+                        regs[in->rs] = (uint32_t)atoi(buf);
+                        stats.syscalls++;
+                        break;
+                case OP_READ_CHAR:
+                        fflush(stdout);
+                        read_line(buf, sizeof (buf));
+                        regs[in->rs] = (unsigned char)buf[0];
+                        stats.syscalls++;
+                        break;
+                case OP_READ_STRING: {
+                        long len;
+
+                        fflush(stdout);
+                        len = read_line(buf, sizeof (buf));
+                        if (len < 0) {
+                                len = 0;
+                        }
+                        for (long i = 0; i < len; ++i) {
+                                store(rs + i, (unsigned char)buf[i], 1);
+                        }
+                        regs[in->rt] = len;
+                        stats.syscalls++;
+                        break;
+                }
+                default:
+                        sim_fatal("invalid instruction", cur_pc);
+                }
+
+                if (taken) {
+                        next_pc = in->imm;
+                        stats.branches_taken++;
+                        stats.cycles += CYCLES_TAKEN_BRANCH;
+                }
+                regs[0] = 0;
+                pending_load = loaded;
+
+                if (regs[29] < stats.min_sp) {
+                        stats.min_sp = regs[29];
+                }
+                if (p->heap_base != 0 && regs[28] > p->heap_base &&
+                    regs[28] <= MEM_SIZE &&
+                    regs[28] - p->heap_base > stats.max_heap) {
+                        stats.max_heap = regs[28] - p->heap_base;
+                }
+
+                cur_pc = next_pc;
+        }
+}
+
+
+/*
+ * Statistics.
+ */
+static const char * opcode_name(opcode_t op)
+{
+        for (size_t i = 0; i < sizeof (opcodes) / sizeof (opcodes[0]); ++i) {
+                if (opcodes[i].op == op) {
+                        return opcodes[i].name;
+                }
+        }
+
+        return "?";
+}
+
+static void print_stats(FILE *f, const struct program *p, int machine)
+{
+        const char *fmt = machine ? "%s=%" PRIu64 "\n" : "%-20s %12" PRIu64 "\n";
+
+
+        if (!machine) {
+                fprintf(f, "\n---- mipssim statistics ----\n");
+        }
+        fprintf(f, fmt, "return_value", (uint64_t)(int32_t)regs[2]);
+        fprintf(f, fmt, "instructions", stats.instructions);
+        fprintf(f, fmt, "cycles", stats.cycles);
+        fprintf(f, fmt, "loads", stats.loads);
+        fprintf(f, fmt, "stores", stats.stores);
+        fprintf(f, fmt, "branches", stats.branches);
+        fprintf(f, fmt, "branches_taken", stats.branches_taken);
+        fprintf(f, fmt, "jumps", stats.jumps);
+        fprintf(f, fmt, "calls", stats.calls);
+        fprintf(f, fmt, "syscalls", stats.syscalls);
+        fprintf(f, fmt, "peak_stack", (uint64_t)(MEM_SIZE - stats.min_sp));
+        fprintf(f, fmt, "peak_heap", (uint64_t)stats.max_heap);
+        fprintf(f, fmt, "text_size", (uint64_t)p->text_cnt * 4);
+        fprintf(f, fmt, "data_size", (uint64_t)p->data_cnt);
+
+        if (!machine) {
+                fprintf(f, "---- per opcode ----\n");
+        }
+        for (int op = OP_INVALID + 1; op < OP_CNT; ++op) {
+                if (stats.per_opcode[op] == 0) {
+                        continue;
+                }
+                if (machine) {
+                        fprintf(f, "op.%s=%" PRIu64 "\n", opcode_name(op),
+                                        stats.per_opcode[op]);
+                } else {
+                        fprintf(f, "  %-18s %12" PRIu64 "\n", opcode_name(op),
+                                        stats.per_opcode[op]);
+                }
+        }
+}
+
+static char * read_file(const char *name)
+{
+        FILE *f = fopen(name, "r");
+        char *buf = NULL;
+        size_t cnt = 0;
+        size_t size = 0;
+        int c;
+
+
+        if (f == NULL) {
+                perror(name);
+                exit(EXIT_FAILURE);
+        }
+        while ((c = getc(f)) != EOF) {
+                GROW(buf, cnt, size);
+                buf[cnt++] = c;
+        }
+        GROW(buf, cnt, size);
+        buf[cnt] = '\0';
+        fclose(f);
+
+        return buf;
+}
+
+static void usage(void)
+{
+        fprintf(stderr, "usage: mipssim [-q] [-s stats_file] program.asm\n"
+                        "  -q  do not print statistics to stderr\n"
+                        "  -s  write machine readable statistics to file\n");
+        exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char **argv)
+{
+        struct program p = {0};
+        const char *stats_file = NULL;
+        int quiet = 0;
+        int opt;
+        char *src;
+
+
+        while ((opt = getopt(argc, argv, "qs:")) != -1) {
+                switch (opt) {
+                case 'q':
+                        quiet = 1;
+                        break;
+                case 's':
+                        stats_file = optarg;
+                        break;
+                default:
+                        usage();
+                }
+        }
+        if (optind + 1 != argc) {
+                usage();
+        }
+        input_name = argv[optind];
+
+        src = read_file(input_name);
+        assemble(&p, src);
+        resolve(&p);
+        free(src);
+
+        simulate(&p);
+        fflush(stdout);
+
+        if (!quiet) {
+                print_stats(stderr, &p, 0);
+        }
+        if (stats_file != NULL) {
+                FILE *f = fopen(stats_file, "w");
+
+                if (f == NULL) {
+                        perror(stats_file);
+                        return EXIT_FAILURE;
+                }
+                print_stats(f, &p, 1);
+                fclose(f);
+        }
+
+        return EXIT_SUCCESS;
+}
@@ -19,7 +19,6 @@
 
 
 #define MAIN_FUNCTION_NAME "main"
-#define MAIN_FUNCTION_TAC_NUM 1
 
 
 typedef enum {
@@ -103,13 +102,32 @@ static int sem_expr_integer_binary(struct block_record op1,
                                    operator_t operator);
 static int sem_expr_relation(struct block_record op1, struct block_record op2,
                              struct block_record *res_br, operator_t operator);
+static int sem_pre_logical_expression(struct block_record op1,
+                                      operator_t operator);
+static int sem_post_logical_expression(struct block_record op2,
+                                       struct block_record *res_br,
+                                       operator_t operator);
+static int sem_branch_false(struct block_record expr_br, unsigned label);
+static int sem_branch_true(struct block_record expr_br, unsigned label);
 
 
 static struct block *top_block = NULL; //pointer to current block
 static struct tac_instruction instr; //three address code instruction
 static unsigned tac_res_cntr = 1; //three address code result counter
-static unsigned tac_label_cntr = 10; //three address code label counter
+static unsigned tac_label_cntr = LAST_BUILTIN_LABEL + 1; //three address code label counter
 static struct stack label_stack = {0}; //selection/iteration stmnt label stack
+static struct stack logical_stack = {0}; //logical expression label stack
+
+/*
+ * Last logical expression. Its value is computed by the last five instructions
+ * (res = 1; JUMP end; false: res = 0; end:), the jumps to the false label are
+ * between first and the tail.
+ */
+static struct {
+        unsigned res_num; //result number
+        size_t first; //first instruction which may jump to the false label
+        size_t end; //instructions count after the expression
+} logical;
 
 extern struct tac *tac; //three address code
 extern const struct function builtins[]; //builtin functions
@@ -597,18 +615,30 @@ expression:
                 }
         }
 
-          /* Logical AND. */
-        | expression AND_OP expression
+          /* Logical AND, right operand is evaluated only if needed. */
+        | expression AND_OP
+        { //mid-rule action
+                if (sem_pre_logical_expression($1, OPERATOR_AND) != 0) {
+                        YYERROR;
+                }
+        }
+          expression
         {
-                if (sem_expr_integer_binary($1, $3, &$$, OPERATOR_AND) != 0) {
+                if (sem_post_logical_expression($4, &$$, OPERATOR_AND) != 0) {
                         YYERROR;
                 }
         }
 
-          /* Logical OR. */
-        | expression OR_OP expression
+          /* Logical OR, right operand is evaluated only if needed. */
+        | expression OR_OP
+        { //mid-rule action
+                if (sem_pre_logical_expression($1, OPERATOR_OR) != 0) {
+                        YYERROR;
+                }
+        }
+          expression
         {
-                if (sem_expr_integer_binary($1, $3, &$$, OPERATOR_OR) != 0) {
+                if (sem_post_logical_expression($4, &$$, OPERATOR_OR) != 0) {
                         YYERROR;
                 }
         }
@@ -815,7 +845,7 @@ static int sem_function_declaration(const char *id, data_type_t ret_type,
                         return 1;
                 }
 
-                br->tac_num = MAIN_FUNCTION_TAC_NUM; //assign special TAC label
+                br->tac_num = MAIN_LABEL; //assign special TAC label
         } else {
                 br->tac_num = tac_label_cntr++; //assign unique TAC label
         }
@@ -893,7 +923,7 @@ static int sem_pre_function_definition(char *id, data_type_t ret_type,
                                 return 1;
                         }
 
-                        br->tac_num = MAIN_FUNCTION_TAC_NUM; //special TAC label
+                        br->tac_num = MAIN_LABEL; //special TAC label
                 } else {
                         br->tac_num = tac_label_cntr++; //unique TAC label
                 }
@@ -911,6 +941,7 @@ static int sem_pre_function_definition(char *id, data_type_t ret_type,
 
         /* Generate TAC for the label. */
         memset(&instr, 0, sizeof (struct tac_instruction));
+        instr.data_type = DATA_TYPE_FUNCTION; //marks function entry
         instr.operator = OPERATOR_LABEL; //unary
 
         instr.op1.type = OPERAND_TYPE_LABEL;
@@ -1097,21 +1128,12 @@ static int sem_pre_selection_statement(struct block_record expr_br)
         }
 
         /* Generate TAC for the branch to the ELSE compound statement. */
-        memset(&instr, 0, sizeof (struct tac_instruction));
-        instr.operator = OPERATOR_BZERO; //binary
-
-        instr.op1.type = OPERAND_TYPE_VARIABLE;
-        instr.op1.value.num = expr_br.tac_num;
-
-        instr.op2.type = OPERAND_TYPE_LABEL;
-        instr.op2.value.num = tac_label_cntr++; //ELSE label
-
-        if (stack_push(&label_stack, instr.op2.value.num) != 0) {
+        if (stack_push(&label_stack, tac_label_cntr) != 0) {
                 set_error(RET_INTERNAL, "stack_push", "label stack full");
                 return 1;
         }
 
-        return tac_add(tac, instr); //success or memory exhaustion
+        return sem_branch_false(expr_br, tac_label_cntr++); //ELSE label
 }
 
 static int sem_mid_selection_statement(void)
@@ -1195,22 +1217,13 @@ static int sem_mid_iteration_statement(struct block_record expr_br)
         }
 
         /* Generate TAC for the branch to the end of WHILE statement. */
-        memset(&instr, 0, sizeof (struct tac_instruction));
-        instr.operator = OPERATOR_BZERO; //binary
-
-        instr.op1.type = OPERAND_TYPE_VARIABLE;
-        instr.op1.value.num = expr_br.tac_num;
-
-        instr.op2.type = OPERAND_TYPE_LABEL;
-        instr.op2.value.num = tac_label_cntr++; //WHILE end label
-
-        if (stack_push(&label_stack, instr.op2.value.num) != 0) {
+        if (stack_push(&label_stack, tac_label_cntr) != 0) {
                 set_error(RET_INTERNAL, "stack_push", "label stack full");
                 return 1;
         }
 
 
-        return tac_add(tac, instr); //success or memory exhaustion
+        return sem_branch_false(expr_br, tac_label_cntr++); //WHILE end label
 }
 
 static int sem_post_iteration_statement(void)
@@ -1248,6 +1261,9 @@ static int sem_function_call(char *id, struct var_list *call_type_list,
                              struct block_record *ret_br)
 {
         const struct block_record *id_br;
+        int print_args_cnt = 0; //arguments of print, zero for other calls
+        data_type_t dt;
+        const char *arg_id;
 
 
         assert(id != NULL && ret_br != NULL);
@@ -1271,6 +1287,13 @@ static int sem_function_call(char *id, struct var_list *call_type_list,
                                   "mandatory");
                         return 1;
                 }
+
+                /* Count the arguments, the call records them. */
+                dt = var_list_it_first(call_type_list, &arg_id);
+                while (dt != DATA_TYPE_UNSET) {
+                        print_args_cnt++;
+                        dt = var_list_it_next(call_type_list, &arg_id);
+                }
         } else if (!var_list_are_equal(id_br->var_list, call_type_list)) {
                 set_error(RET_SEMANTIC, id, "declaration/definition and call "
                           "type mismatch");
@@ -1294,6 +1317,12 @@ static int sem_function_call(char *id, struct var_list *call_type_list,
         instr.op1.type = OPERAND_TYPE_LABEL;
         instr.op1.value.num = id_br->tac_num; //TAC label number
 
+        /* Print has a variable argument list, the pushes carry the types. */
+        if (print_args_cnt > 0) {
+                instr.op2.type = OPERAND_TYPE_LITERAL;
+                instr.op2.value.int_val = print_args_cnt;
+        }
+
 
         return tac_add(tac, instr); //success or memory exhaustion
 }
@@ -1521,3 +1550,256 @@ static int sem_expr_relation(struct block_record op1, struct block_record op2,
 
         return tac_add(tac, instr); //success or memory exhaustion
 }
+
+static int is_logical_tail(struct block_record expr_br)
+{
+        return expr_br.tac_num == logical.res_num &&
+                tac->instructions_cnt == logical.end;
+}
+
+/* Generate TAC for the jump to the label if the expression is zero. */
+static int sem_branch_false(struct block_record expr_br, unsigned label)
+{
+        if (is_logical_tail(expr_br)) {
+                const size_t tail = tac->instructions_cnt - 5;
+                const unsigned false_label =
+                        tac->instructions[tail + 2].op1.value.num;
+
+                /*
+                 * Value of the logical expression is not needed, jump from
+                 * its false exits directly to the label and fall through
+                 * its true exit.
+                 */
+                for (size_t i = logical.first; i < tail; ++i) {
+                        struct tac_instruction *jump = &tac->instructions[i];
+
+                        if (jump->operator == OPERATOR_JUMP &&
+                            jump->op1.value.num == false_label) {
+                                jump->op1.value.num = label;
+                        } else if (jump->operator == OPERATOR_BZERO &&
+                                   jump->op2.value.num == false_label) {
+                                jump->op2.value.num = label;
+                        }
+                }
+
+                tac->instructions_cnt = tail;
+                logical.res_num = 0;
+                return 0;
+        }
+
+        memset(&instr, 0, sizeof (struct tac_instruction));
+        instr.operator = OPERATOR_BZERO; //binary
+
+        instr.op1.type = OPERAND_TYPE_VARIABLE;
+        instr.op1.value.num = expr_br.tac_num;
+
+        instr.op2.type = OPERAND_TYPE_LABEL;
+        instr.op2.value.num = label;
+
+
+        return tac_add(tac, instr); //success or memory exhaustion
+}
+
+/* Generate TAC for the jump to the label if the expression is not zero. */
+static int sem_branch_true(struct block_record expr_br, unsigned label)
+{
+        const struct tac_instruction *last;
+
+
+        if (is_logical_tail(expr_br)) {
+                struct tac_instruction *tail =
+                        &tac->instructions[tac->instructions_cnt - 5];
+
+                /* True exit jumps to the label, false exits fall through. */
+                tail[0] = tail[1];
+                tail[0].op1.value.num = label;
+                tail[1] = tail[2];
+
+                tac->instructions_cnt -= 3;
+                logical.res_num = 0;
+                return 0;
+        }
+
+        /* BZERO on the negated expression, relations are inverted. */
+        last = &tac->instructions[tac->instructions_cnt - 1];
+        if (last->res_num == expr_br.tac_num &&
+            last->operator >= OPERATOR_SE && last->operator <= OPERATOR_SGET) {
+                static const operator_t inverse[] = {
+                        OPERATOR_SNE, OPERATOR_SE, OPERATOR_SGET,
+                        OPERATOR_SGT, OPERATOR_SLET, OPERATOR_SLT,
+                };
+
+                instr = *last;
+                instr.res_num = tac_res_cntr++;
+                instr.operator = inverse[last->operator - OPERATOR_SE];
+        } else {
+                memset(&instr, 0, sizeof (struct tac_instruction));
+                instr.data_type = DATA_TYPE_INT;
+                instr.res_num = tac_res_cntr++;
+                instr.operator = OPERATOR_SE; //binary
+
+                instr.op1.type = OPERAND_TYPE_VARIABLE;
+                instr.op1.value.num = expr_br.tac_num;
+
+                instr.op2.type = OPERAND_TYPE_LITERAL;
+                instr.op2.value.int_val = 0;
+        }
+
+        if (tac_add(tac, instr) != 0) { //success or memory exhaustion
+                return 1;
+        }
+
+        memset(&instr, 0, sizeof (struct tac_instruction));
+        instr.operator = OPERATOR_BZERO; //binary
+
+        instr.op1.type = OPERAND_TYPE_VARIABLE;
+        instr.op1.value.num = tac_res_cntr - 1;
+
+        instr.op2.type = OPERAND_TYPE_LABEL;
+        instr.op2.value.num = label;
+
+
+        return tac_add(tac, instr); //success or memory exhaustion
+}
+
+/*
+ * Left operand of the logical expression is evaluated, generate TAC for the
+ * jump to the false exit (AND) or to the true exit (OR) of the expression.
+ */
+static int sem_pre_logical_expression(struct block_record op1,
+                                      operator_t operator)
+{
+        const unsigned label = tac_label_cntr++; //AND false or OR true label
+        size_t first = tac->instructions_cnt;
+
+
+        if (op1.symbol_type != DATA_TYPE_INT) {
+                set_error(RET_SEMANTIC, operator_symbol[operator],
+                          "incompatible data type");
+                return 1;
+        }
+
+        if (is_logical_tail(op1)) { //its jumps may be redirected
+                first = logical.first;
+        }
+
+        if (stack_push(&logical_stack, first) != 0 ||
+            stack_push(&logical_stack, label) != 0) {
+                set_error(RET_INTERNAL, "stack_push", "label stack full");
+                return 1;
+        }
+
+        if (operator == OPERATOR_AND) {
+                return sem_branch_false(op1, label);
+        } else {
+                return sem_branch_true(op1, label);
+        }
+}
+
+/*
+ * Right operand of the logical expression is evaluated, generate TAC setting
+ * the result to 1 on the true exit and to 0 on the false exit.
+ */
+static int sem_post_logical_expression(struct block_record op2,
+                                       struct block_record *res_br,
+                                       operator_t operator)
+{
+        unsigned first, label, false_label, end_label;
+
+
+        assert(res_br != NULL);
+
+        if (op2.symbol_type != DATA_TYPE_INT) {
+                set_error(RET_SEMANTIC, operator_symbol[operator],
+                          "incompatible data type");
+                return 1;
+        }
+
+        assert(stack_pop(&logical_stack, &label) == 0);
+        assert(stack_pop(&logical_stack, &first) == 0);
+
+        false_label = (operator == OPERATOR_AND) ? label : tac_label_cntr++;
+        end_label = tac_label_cntr++;
+
+        if (sem_branch_false(op2, false_label) != 0) {
+                return 1;
+        }
+
+        res_br->symbol_type = DATA_TYPE_INT; //0 or 1
+        res_br->tac_num = tac_res_cntr++;
+
+        /* Generate TAC for the true exit, the result is 1. */
+        if (operator == OPERATOR_OR) {
+                memset(&instr, 0, sizeof (struct tac_instruction));
+                instr.operator = OPERATOR_LABEL; //unary
+
+                instr.op1.type = OPERAND_TYPE_LABEL;
+                instr.op1.value.num = label; //OR true label
+
+                if (tac_add(tac, instr) != 0) {
+                        return 1;
+                }
+        }
+
+        memset(&instr, 0, sizeof (struct tac_instruction));
+        instr.data_type = DATA_TYPE_INT;
+        instr.res_num = res_br->tac_num;
+        instr.operator = OPERATOR_ASSIGN; //unary
+
+        instr.op1.type = OPERAND_TYPE_LITERAL;
+        instr.op1.value.int_val = 1;
+
+        if (tac_add(tac, instr) != 0) {
+                return 1;
+        }
+
+        memset(&instr, 0, sizeof (struct tac_instruction));
+        instr.operator = OPERATOR_JUMP; //unary
+
+        instr.op1.type = OPERAND_TYPE_LABEL;
+        instr.op1.value.num = end_label;
+
+        if (tac_add(tac, instr) != 0) {
+                return 1;
+        }
+
+        /* Generate TAC for the false exit, the result is 0. */
+        memset(&instr, 0, sizeof (struct tac_instruction));
+        instr.operator = OPERATOR_LABEL; //unary
+
+        instr.op1.type = OPERAND_TYPE_LABEL;
+        instr.op1.value.num = false_label;
+
+        if (tac_add(tac, instr) != 0) {
+                return 1;
+        }
+
+        memset(&instr, 0, sizeof (struct tac_instruction));
+        instr.data_type = DATA_TYPE_INT;
+        instr.res_num = res_br->tac_num;
+        instr.operator = OPERATOR_ASSIGN; //unary
+
+        instr.op1.type = OPERAND_TYPE_LITERAL;
+        instr.op1.value.int_val = 0;
+
+        if (tac_add(tac, instr) != 0) {
+                return 1;
+        }
+
+        memset(&instr, 0, sizeof (struct tac_instruction));
+        instr.operator = OPERATOR_LABEL; //unary
+
+        instr.op1.type = OPERAND_TYPE_LABEL;
+        instr.op1.value.num = end_label;
+
+        if (tac_add(tac, instr) != 0) {
+                return 1;
+        }
+
+        logical.res_num = res_br->tac_num;
+        logical.first = first;
+        logical.end = tac->instructions_cnt;
+
+
+        return 0;
+}
@@ -0,0 +1,430 @@
+/*
+ * project: VYPe15 programming language compiler
+ * author: Jan Wrona <xwrona00@stud.fit.vutbr.cz>
+ * author: Katerina Zmolikova <xzmoli02@stud.fit.vutbr.cz>
+ * date: 2015
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "peephole.h"
+
+#define MAX_ARGS 3
+#define ARG_LEN 32
+#define MAX_WINDOW 4
+
+enum line_kind {
+	LINE_OTHER, // directives and everything after .data, written verbatim
+	LINE_BLANK,
+	LINE_LABEL,
+	LINE_INSTR,
+	LINE_DELETED,
+};
+
+struct asm_line {
+	enum line_kind kind;
+	char * text; // original line, NULL once the instruction is rewritten
+	char op[ARG_LEN]; // mnemonic or name of the label
+	char args[MAX_ARGS][ARG_LEN];
+	int n_args;
+};
+
+// rewrites the window of consecutive lines, returns 1 if it did anything
+struct pattern {
+	const char * name;
+	int window;
+	int (*rewrite)(struct asm_line ** w);
+};
+
+// instructions whose first operand is the only register they write
+static const char * const writers[] = {
+	"li", "la", "lui", "addi", "addiu", "add", "addu", "sub", "subu",
+	"slt", "sltu", "slti", "sltiu", "and", "andi", "or", "ori", "xor",
+	"xori", "nor", "mul", "sll", "srl", "sra", "mflo", "mfhi", "lw", "lb",
+};
+
+static int is_op(const struct asm_line * l, const char * op) {
+	return l->kind == LINE_INSTR && strcmp(l->op, op) == 0;
+}
+
+static int writes_first(const struct asm_line * l) {
+	if (l->kind != LINE_INSTR || l->n_args == 0) return 0;
+	for (unsigned i = 0; i < sizeof(writers) / sizeof(writers[0]); i++) {
+		if (strcmp(l->op, writers[i]) == 0) return 1;
+	}
+	return 0;
+}
+
+// register is a source operand or the base of a memory operand
+static int reads(const struct asm_line * l, const char * reg) {
+	size_t len = strlen(reg);
+	for (int a = writes_first(l); a < l->n_args; a++) {
+		const char * base = strchr(l->args[a], '(');
+		if (strcmp(l->args[a], reg) == 0) return 1;
+		if (base != NULL && strncmp(base + 1, reg, len) == 0 &&
+		    base[len + 1] == ')') {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int parse_imm(const char * s, long * val) {
+	char * end;
+	*val = strtol(s, &end, 0);
+	return *s != '\0' && *end == '\0';
+}
+
+static int is_imm(const char * s, long val) {
+	long v;
+	return parse_imm(s, &v) && v == val;
+}
+
+static int memory_base(const char * mem, const char * reg) {
+	const char * base = strchr(mem, '(');
+	return base != NULL && strncmp(base + 1, reg, strlen(reg)) == 0 &&
+		base[strlen(reg) + 1] == ')';
+}
+
+static void delete_line(struct asm_line * l) {
+	free(l->text);
+	l->text = NULL;
+	l->kind = LINE_DELETED;
+}
+
+static void set_instr(struct asm_line * l, const char * op, const char * a0,
+			const char * a1, const char * a2) {
+	char args[MAX_ARGS][ARG_LEN];
+	// arguments may point to the line itself
+	snprintf(args[0], ARG_LEN, "%s", a0);
+	snprintf(args[1], ARG_LEN, "%s", a1);
+	snprintf(args[2], ARG_LEN, "%s", a2);
+	free(l->text);
+	l->text = NULL;
+	snprintf(l->op, ARG_LEN, "%s", op);
+	memcpy(l->args, args, sizeof(args));
+	l->n_args = 3;
+}
+
+static void parse_line(struct asm_line * l) {
+	char buf[4 * ARG_LEN];
+	char * s = buf;
+	size_t len = strlen(l->text);
+
+	l->kind = LINE_OTHER;
+	l->n_args = 0;
+	if (len >= sizeof(buf)) return;
+	memcpy(buf, l->text, len + 1);
+	while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == ' ' ||
+				buf[len - 1] == '\t')) {
+		buf[--len] = '\0';
+	}
+	while (*s == ' ' || *s == '\t') s++;
+
+	if (*s == '\0') {
+		l->kind = LINE_BLANK;
+		return;
+	}
+	if (*s == '.') return;
+	if (s[strlen(s) - 1] == ':') {
+		s[strlen(s) - 1] = '\0';
+		if (strlen(s) >= ARG_LEN) return;
+		strcpy(l->op, s);
+		l->kind = LINE_LABEL;
+		return;
+	}
+
+	size_t n = strcspn(s, " \t");
+	if (n >= ARG_LEN) return;
+	memcpy(l->op, s, n);
+	l->op[n] = '\0';
+	s += n;
+
+	while (*s != '\0') {
+		while (*s == ' ' || *s == '\t' || *s == ',') s++;
+		n = strcspn(s, ", \t");
+		if (n == 0) break;
+		if (n >= ARG_LEN || l->n_args == MAX_ARGS) return;
+		memcpy(l->args[l->n_args], s, n);
+		l->args[l->n_args][n] = '\0';
+		if (strcmp(l->args[l->n_args], "$zero") == 0) {
+			strcpy(l->args[l->n_args], "$0");
+		}
+		l->n_args++;
+		s += n;
+	}
+	l->kind = LINE_INSTR;
+}
+
+static void write_line(const struct asm_line * l, FILE * f_out) {
+	if (l->kind == LINE_DELETED) return;
+	if (l->text != NULL) {
+		fputs(l->text, f_out);
+		return;
+	}
+	fprintf(f_out, "\t%s", l->op);
+	for (int a = 0; a < l->n_args; a++) {
+		fprintf(f_out, "%c%s", (a == 0) ? ' ' : ',', l->args[a]);
+	}
+	fprintf(f_out, "\n");
+}
+
+/*
+ * Patterns
+ */
+
+// addi $x,$x,0
+static int self_move(struct asm_line ** w) {
+	if (!is_op(w[0], "addi") || w[0]->n_args != 3 ||
+	    strcmp(w[0]->args[0], w[0]->args[1]) != 0 ||
+	    !is_imm(w[0]->args[2], 0)) {
+		return 0;
+	}
+	delete_line(w[0]);
+	return 1;
+}
+
+// sw $x,m; lw $y,m -> sw $x,m; addi $y,$x,0
+static int store_load(struct asm_line ** w) {
+	if (!is_op(w[0], "sw") || !is_op(w[1], "lw") ||
+	    w[0]->n_args != 2 || w[1]->n_args != 2 ||
+	    strcmp(w[0]->args[1], w[1]->args[1]) != 0) {
+		return 0;
+	}
+	if (strcmp(w[0]->args[0], w[1]->args[0]) == 0) {
+		delete_line(w[1]);
+	}
+	else {
+		set_instr(w[1], "addi", w[1]->args[0], w[0]->args[0], "0");
+	}
+	return 1;
+}
+
+// lw $x,m; sw $x,m -> lw $x,m
+static int load_store(struct asm_line ** w) {
+	if (!is_op(w[0], "lw") || !is_op(w[1], "sw") ||
+	    w[0]->n_args != 2 || w[1]->n_args != 2 ||
+	    strcmp(w[0]->args[0], w[1]->args[0]) != 0 ||
+	    strcmp(w[0]->args[1], w[1]->args[1]) != 0 ||
+	    memory_base(w[0]->args[1], w[0]->args[0])) {
+		return 0;
+	}
+	delete_line(w[1]);
+	return 1;
+}
+
+// value overwritten by the next instruction before being read
+static int dead_def(struct asm_line ** w) {
+	if (!writes_first(w[0]) || !writes_first(w[1]) ||
+	    strcmp(w[0]->args[0], "$0") == 0 ||
+	    strcmp(w[0]->args[0], w[1]->args[0]) != 0 ||
+	    reads(w[1], w[0]->args[0])) {
+		return 0;
+	}
+	delete_line(w[0]);
+	return 1;
+}
+
+// slt $x,..; lui $25,0xFFFF; ori $25,$25,0xFFFE; nor $x,$x,$25
+//   -> slt $x,..; xori $x,$x,1
+static int boolean_not(struct asm_line ** w) {
+	if (!(is_op(w[0], "slt") || is_op(w[0], "sltu") ||
+	      is_op(w[0], "slti") || is_op(w[0], "sltiu")) ||
+	    !is_op(w[1], "lui") || w[1]->n_args != 2 ||
+	    strcmp(w[1]->args[0], "$25") != 0 ||
+	    !is_imm(w[1]->args[1], 0xFFFF) ||
+	    !is_op(w[2], "ori") || w[2]->n_args != 3 ||
+	    strcmp(w[2]->args[0], "$25") != 0 ||
+	    strcmp(w[2]->args[1], "$25") != 0 ||
+	    !is_imm(w[2]->args[2], 0xFFFE) ||
+	    !is_op(w[3], "nor") || w[3]->n_args != 3 ||
+	    strcmp(w[3]->args[0], w[0]->args[0]) != 0) {
+		return 0;
+	}
+	if (!(strcmp(w[3]->args[1], w[0]->args[0]) == 0 &&
+	      strcmp(w[3]->args[2], "$25") == 0) &&
+	    !(strcmp(w[3]->args[2], w[0]->args[0]) == 0 &&
+	      strcmp(w[3]->args[1], "$25") == 0)) {
+		return 0;
+	}
+	delete_line(w[1]);
+	delete_line(w[2]);
+	set_instr(w[3], "xori", w[0]->args[0], w[0]->args[0], "1");
+	return 1;
+}
+
+// addi $x,$y,0; li $25,c; and $x,$x,$25 -> andi $x,$y,c
+static int and_immediate(struct asm_line ** w) {
+	long mask;
+	if (!is_op(w[0], "addi") || w[0]->n_args != 3 ||
+	    !is_imm(w[0]->args[2], 0) ||
+	    !is_op(w[1], "li") || w[1]->n_args != 2 ||
+	    strcmp(w[1]->args[0], "$25") != 0 ||
+	    !parse_imm(w[1]->args[1], &mask) || mask < 0 || mask > 0xFFFF ||
+	    !is_op(w[2], "and") || w[2]->n_args != 3 ||
+	    strcmp(w[2]->args[0], w[0]->args[0]) != 0 ||
+	    strcmp(w[2]->args[1], w[0]->args[0]) != 0 ||
+	    strcmp(w[2]->args[2], "$25") != 0 ||
+	    strcmp(w[0]->args[1], "$25") == 0) {
+		return 0;
+	}
+	set_instr(w[2], "andi", w[0]->args[0], w[0]->args[1], w[1]->args[1]);
+	delete_line(w[0]);
+	delete_line(w[1]);
+	return 1;
+}
+
+// addi $x,$x,a; addi $x,$x,b -> addi $x,$x,a+b
+static int merge_addi(struct asm_line ** w) {
+	long a, b;
+	char sum[ARG_LEN];
+	if (!is_op(w[0], "addi") || !is_op(w[1], "addi") ||
+	    w[0]->n_args != 3 || w[1]->n_args != 3 ||
+	    strcmp(w[0]->args[0], w[0]->args[1]) != 0 ||
+	    strcmp(w[1]->args[0], w[1]->args[1]) != 0 ||
+	    strcmp(w[0]->args[0], w[1]->args[0]) != 0 ||
+	    !parse_imm(w[0]->args[2], &a) || !parse_imm(w[1]->args[2], &b) ||
+	    a + b < -32768 || a + b > 32767) {
+		return 0;
+	}
+	snprintf(sum, ARG_LEN, "%ld", a + b);
+	set_instr(w[0], "addi", w[0]->args[0], w[0]->args[0], sum);
+	delete_line(w[1]);
+	return 1;
+}
+
+// jump or branch to the label right after it
+static int jump_to_next(struct asm_line ** w) {
+	const char * target;
+	if (w[1]->kind != LINE_LABEL) return 0;
+	if (is_op(w[0], "j") && w[0]->n_args == 1) {
+		target = w[0]->args[0];
+	}
+	else if ((is_op(w[0], "beq") || is_op(w[0], "bne")) &&
+		 w[0]->n_args == 3) {
+		target = w[0]->args[2];
+	}
+	else if ((is_op(w[0], "bgez") || is_op(w[0], "bgtz") ||
+		  is_op(w[0], "blez") || is_op(w[0], "bltz")) &&
+		 w[0]->n_args == 2) {
+		target = w[0]->args[1];
+	}
+	else {
+		return 0;
+	}
+	if (strcmp(target, w[1]->op) != 0) return 0;
+	delete_line(w[0]);
+	return 1;
+}
+
+// instruction after an unconditional jump without a label in between
+static int unreachable(struct asm_line ** w) {
+	if (!(is_op(w[0], "j") || is_op(w[0], "jr")) ||
+	    w[1]->kind != LINE_INSTR) {
+		return 0;
+	}
+	delete_line(w[1]);
+	return 1;
+}
+
+static const struct pattern patterns[] = {
+	{ "self move", 1, self_move },
+	{ "store and load", 2, store_load },
+	{ "load and store", 2, load_store },
+	{ "dead definition", 2, dead_def },
+	{ "boolean not", 4, boolean_not },
+	{ "and immediate", 3, and_immediate },
+	{ "merged addi", 2, merge_addi },
+	{ "jump to next", 2, jump_to_next },
+	{ "unreachable", 2, unreachable },
+};
+#define N_PATTERNS (sizeof(patterns) / sizeof(patterns[0]))
+
+// collect n lines starting at i, blank and deleted ones are skipped
+static int fill_window(struct asm_line * lines, size_t n_lines, size_t i,
+			int n, struct asm_line ** w) {
+	int k = 0;
+	for (; i < n_lines && k < n; i++) {
+		if (lines[i].kind == LINE_BLANK || lines[i].kind == LINE_DELETED) {
+			continue;
+		}
+		if (lines[i].kind == LINE_OTHER) return 0;
+		w[k++] = &lines[i];
+	}
+	return k == n;
+}
+
+long peephole(FILE * f_in, FILE * f_out, FILE * f_stats) {
+	struct asm_line * lines = NULL;
+	size_t n_lines = 0, size = 0;
+	unsigned long fired[N_PATTERNS] = { 0 };
+	long total = 0;
+	int in_text = 1;
+	char * text = NULL;
+	size_t text_size = 0;
+
+	// read the whole code, only the text section is parsed
+	while (getline(&text, &text_size, f_in) != -1) {
+		if (n_lines == size) {
+			size = (size == 0) ? 1024 : 2 * size;
+			struct asm_line * tmp = realloc(lines,
+					size * sizeof(struct asm_line));
+			if (tmp == NULL) {
+				size = n_lines;
+				total = -1;
+				break;
+			}
+			lines = tmp;
+		}
+		struct asm_line * l = &lines[n_lines++];
+		l->text = strdup(text);
+		if (l->text == NULL) {
+			n_lines--;
+			total = -1;
+			break;
+		}
+		if (strncmp(text, ".data", 5) == 0) in_text = 0;
+		if (in_text) {
+			parse_line(l);
+		}
+		else {
+			l->kind = LINE_OTHER;
+		}
+	}
+	free(text);
+
+	// apply the patterns until none of them fires
+	int changed = (total == 0);
+	while (changed) {
+		changed = 0;
+		for (size_t i = 0; i < n_lines; i++) {
+			if (lines[i].kind != LINE_INSTR) continue;
+			for (unsigned p = 0; p < N_PATTERNS; p++) {
+				struct asm_line * w[MAX_WINDOW];
+				if (lines[i].kind != LINE_INSTR) break;
+				if (fill_window(lines, n_lines, i, patterns[p].window, w) &&
+				    patterns[p].rewrite(w)) {
+					fired[p]++;
+					total++;
+					changed = 1;
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < n_lines; i++) {
+		if (total >= 0) write_line(&lines[i], f_out);
+		free(lines[i].text);
+	}
+	free(lines);
+
+	if (total >= 0 && f_stats != NULL) {
+		for (unsigned p = 0; p < N_PATTERNS; p++) {
+			fprintf(f_stats, "peephole %-16s %lu\n", patterns[p].name,
+				fired[p]);
+		}
+		fprintf(f_stats, "peephole %-16s %ld\n", "total", total);
+	}
+	return total;
+}
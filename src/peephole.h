@@ -0,0 +1,18 @@
+/*
+ * project: VYPe15 programming language compiler
+ * author: Jan Wrona <xwrona00@stud.fit.vutbr.cz>
+ * author: Katerina Zmolikova <xzmoli02@stud.fit.vutbr.cz>
+ * date: 2015
+ */
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+
+#include <stdio.h>
+
+// rewrites the assembly read from f_in into f_out, returns number of fired
+// patterns or -1 on failure, counts of each pattern are printed to f_stats
+long peephole(FILE * f_in, FILE * f_out, FILE * f_stats);
+
+
+#endif //PEEPHOLE_H
@@ -7,79 +7,669 @@
 #include "stdlib.h"
 #include "stdio.h"
 #include "reg_alloc.h"
+#include "builtins.h"
 
-const int n_registers = 24-8+1;
-int free_reg = 8;
-int dump_reg = 8;
+#define FIRST_REGISTER 8
+#define LAST_REGISTER 24
+#define N_TEMP_REGISTERS 9
+#define N_SAVED_REGISTERS 8
+#define N_SCRATCH 3 // result and two operands of spilled variables
+#define NONE ((unsigned)-1)
 
-void create_register_mapping(int ** mapping) {
-	*mapping = malloc(24 * sizeof(int));
-	for (int i = 0; i < 24; i++) {
-		(*mapping)[i] = -1;
+/*
+ * Linear scan register allocation over live intervals of whole functions.
+ *
+ * The TAC is split into basic blocks, which are connected into a control
+ * flow graph. Global liveness is computed by the usual backward data flow
+ * iteration, for each function over its own variables. The live interval
+ * of a variable spans all instructions between the first and the last one
+ * where it is live, so it covers loops the variable is live around. The
+ * intervals are assigned registers by a linear scan for each function.
+ * When the register file is exhausted, the interval with the lowest spill
+ * weight (references weighted by loop depth, divided by the length of the
+ * interval) is spilled to its frame slot for its whole lifetime. Within a
+ * basic block, spilled variables are cached in registers not occupied by
+ * any interval in the block and in scratch registers, which are reserved
+ * only in functions that spill. Cached values are written back before the
+ * block is left and before calls.
+ *
+ * Every variable lives in a single location from its definition to its last
+ * use, so the assignment is consistent on all control flow edges and no
+ * values have to be moved or stored at the block boundaries.
+ *
+ * Registers follow the o32 convention. Temporary registers ($t) are saved by
+ * the caller, only if they hold a value live across the call. Saved registers
+ * ($s) are saved by the callee in its prologue, if it uses them. An interval
+ * gets the cheaper kind: temporary register costs a store and a load at each
+ * call it crosses, a saved register costs them once per invocation, unless it
+ * is already used by the function. Scratch and caching registers are
+ * temporary ones.
+ */
+
+// temporary registers, the last N_SCRATCH are scratch registers when spilling
+static const int temp_registers[N_TEMP_REGISTERS] = {8, 9, 10, 11, 12, 24, 13, 14, 15};
+static const int saved_registers[N_SAVED_REGISTERS] = {16, 17, 18, 19, 20, 21, 22, 23};
+
+struct block {
+	unsigned first, last; // first and last instruction
+	unsigned succ[2];
+	unsigned n_succ;
+	unsigned depth; // loop nesting depth
+};
+
+struct func_info {
+	unsigned first_block, end_block; // blocks of the function
+	unsigned first_var, n_vars; // variables referenced in it, in func_vars
+};
+
+struct interval {
+	unsigned start, end; // first and last instruction where variable is live
+	unsigned weight; // references weighted by loop depth
+	unsigned call_weight; // calls inside the interval weighted by loop depth
+};
+
+struct reg_alloc {
+	const struct tac * tac;
+	unsigned n_vars;
+	const int * var_offsets; // home of each variable, relative to $fp
+	struct block * blocks;
+	unsigned n_blocks;
+	struct func_info * funcs;
+	unsigned n_funcs;
+	unsigned * func_vars;
+	struct interval * intervals;
+	int * var_reg; // register assigned to variable or -1 if spilled
+	unsigned curr; // current instruction
+	unsigned curr_block;
+	unsigned curr_func;
+	// cache of spilled variables within the current block
+	char pool_valid; // pool of registers computed for current block
+	char pool[LAST_REGISTER + 1]; // register free in the whole block
+	int cached_var[LAST_REGISTER + 1]; // spilled variable in register or -1
+	unsigned cached_used[LAST_REGISTER + 1]; // last instruction using it
+	char cached_dirty[LAST_REGISTER + 1];
+};
+
+static int ends_block(operator_t operator) {
+	return operator == OPERATOR_JUMP || operator == OPERATOR_BZERO ||
+		operator == OPERATOR_RETURN;
+}
+
+// fill array of variables referenced by instruction, result first
+static void referenced_vars(struct tac_instruction inst, unsigned vars[3]) {
+	vars[0] = inst.res_num;
+	vars[1] = (inst.op1.type == OPERAND_TYPE_VARIABLE) ? inst.op1.value.num : 0;
+	vars[2] = (inst.op2.type == OPERAND_TYPE_VARIABLE) ? inst.op2.value.num : 0;
+}
+
+static int is_temp_register(int reg) {
+	return (reg >= 8 && reg <= 15) || reg == 24;
+}
+
+static int is_user_call(struct tac_instruction inst) {
+	// built in functions are generated inline
+	return inst.operator == OPERATOR_CALL &&
+		(inst.op1.value.num < FIRST_BUILTIN_LABEL ||
+		 inst.op1.value.num > LAST_BUILTIN_LABEL);
+}
+
+static int starts_function(struct tac_instruction inst) {
+	return inst.operator == OPERATOR_LABEL && inst.data_type == DATA_TYPE_FUNCTION;
+}
+
+static unsigned build_cfg(const struct tac * tac, struct block ** blocks) {
+	unsigned n_blocks = 0;
+	unsigned n_labels = 0;
+
+	for (unsigned i = 0; i < tac->instructions_cnt; i++) {
+		struct tac_instruction inst = tac->instructions[i];
+		if (i == 0 || inst.operator == OPERATOR_LABEL ||
+		    ends_block(tac->instructions[i - 1].operator)) {
+			n_blocks++;
+		}
+		if (inst.operator == OPERATOR_LABEL &&
+		    inst.op1.value.num >= n_labels) {
+			n_labels = inst.op1.value.num + 1;
+		}
+	}
+
+	*blocks = calloc(n_blocks + 1, sizeof(struct block));
+	unsigned * label_block = malloc((n_labels + 1) * sizeof(unsigned));
+	unsigned b = 0;
+
+	for (unsigned i = 0; i < tac->instructions_cnt; i++) {
+		struct tac_instruction inst = tac->instructions[i];
+		if (i == 0 || inst.operator == OPERATOR_LABEL ||
+		    ends_block(tac->instructions[i - 1].operator)) {
+			if (i > 0) b++;
+			(*blocks)[b].first = i;
+		}
+		(*blocks)[b].last = i;
+		if (inst.operator == OPERATOR_LABEL) {
+			label_block[inst.op1.value.num] = b;
+		}
+	}
+
+	for (b = 0; b < n_blocks; b++) {
+		struct block * blk = &(*blocks)[b];
+		struct tac_instruction inst = tac->instructions[blk->last];
+		if (inst.operator == OPERATOR_JUMP) {
+			blk->succ[blk->n_succ++] = label_block[inst.op1.value.num];
+			continue;
+		}
+		if (inst.operator == OPERATOR_BZERO) {
+			blk->succ[blk->n_succ++] = label_block[inst.op2.value.num];
+		}
+		// fall through, unless the next block is another function
+		if (inst.operator != OPERATOR_RETURN && b + 1 < n_blocks &&
+		    !starts_function(tac->instructions[blk->last + 1])) {
+			blk->succ[blk->n_succ++] = b + 1;
+		}
 	}
+
+	// blocks between loop header and back edge form the loop body
+	for (b = 0; b < n_blocks; b++) {
+		for (unsigned s = 0; s < (*blocks)[b].n_succ; s++) {
+			for (unsigned l = (*blocks)[b].succ[s]; l <= b; l++) {
+				(*blocks)[l].depth++;
+			}
+		}
+	}
+
+	free(label_block);
+	return n_blocks;
 }
 
-void create_variable_mapping(int n_vars, int ** mapping) {
-	*mapping = malloc(n_vars * sizeof(int));
-	for (int i = 0; i < n_vars; i++) {
-		(*mapping)[i] = -1;
+static void extend_interval(struct interval * iv, unsigned i) {
+	if (iv->start == NONE || i < iv->start) iv->start = i;
+	if (iv->end == NONE || i > iv->end) iv->end = i;
+}
+
+static int compare_vars(const void * a, const void * b) {
+	unsigned va = *(const unsigned *)a, vb = *(const unsigned *)b;
+	return (va > vb) - (va < vb);
+}
+
+// split blocks into functions and gather the variables of each function
+static void build_functions(struct reg_alloc * ra) {
+	const struct tac * tac = ra->tac;
+	unsigned * seen = calloc(ra->n_vars, sizeof(unsigned)); // function + 1
+	unsigned n = 0;
+
+	for (unsigned b = 0; b < ra->n_blocks; b++) {
+		if (b == 0 || starts_function(tac->instructions[ra->blocks[b].first])) {
+			ra->n_funcs++;
+		}
+	}
+	ra->funcs = calloc(ra->n_funcs + 1, sizeof(struct func_info));
+	ra->func_vars = malloc((3 * tac->instructions_cnt + 1) * sizeof(unsigned));
+
+	unsigned f = 0;
+	for (unsigned b = 0; b < ra->n_blocks; b++) {
+		if (b > 0 && starts_function(tac->instructions[ra->blocks[b].first])) {
+			ra->funcs[f].end_block = b;
+			f++;
+			ra->funcs[f].first_block = b;
+			ra->funcs[f].first_var = n;
+		}
+		for (unsigned i = ra->blocks[b].first; i <= ra->blocks[b].last; i++) {
+			unsigned vars[3];
+			referenced_vars(tac->instructions[i], vars);
+			for (int s = 0; s < 3; s++) {
+				if (vars[s] == 0 || seen[vars[s]] == f + 1) continue;
+				seen[vars[s]] = f + 1;
+				ra->func_vars[n++] = vars[s];
+				ra->funcs[f].n_vars++;
+			}
+		}
 	}
+	if (ra->n_funcs > 0) {
+		ra->funcs[f].end_block = ra->n_blocks;
+	}
+	for (f = 0; f < ra->n_funcs; f++) {
+		qsort(ra->func_vars + ra->funcs[f].first_var, ra->funcs[f].n_vars,
+		      sizeof(unsigned), compare_vars);
+	}
+	free(seen);
 }
 
-void destroy_mappings(int * var_mapping, int * reg_mapping) {
-	free(var_mapping);
-	free(reg_mapping);
+// liveness over the blocks and variables of one function
+static void compute_function_intervals(struct reg_alloc * ra,
+			const struct func_info * fn, unsigned * local, unsigned * calls) {
+	const struct tac * tac = ra->tac;
+	const unsigned * vars_of = ra->func_vars + fn->first_var;
+	struct block * blocks = ra->blocks + fn->first_block;
+	unsigned n_blocks = fn->end_block - fn->first_block;
+	unsigned words = fn->n_vars / 32 + 1;
+	unsigned * use = calloc(n_blocks * words, sizeof(unsigned));
+	unsigned * def = calloc(n_blocks * words, sizeof(unsigned));
+	unsigned * live_in = calloc(n_blocks * words, sizeof(unsigned));
+	unsigned * live_out = calloc(n_blocks * words, sizeof(unsigned));
+	#define BIT(set, b, v) ((set)[(b) * words + (v) / 32] & (1u << ((v) % 32)))
+	#define SET_BIT(set, b, v) ((set)[(b) * words + (v) / 32] |= (1u << ((v) % 32)))
+
+	for (unsigned l = 0; l < fn->n_vars; l++) {
+		local[vars_of[l]] = l;
+	}
+
+	// local use (read before written) and def sets, references
+	for (unsigned b = 0; b < n_blocks; b++) {
+		unsigned weight = 1u << (3 * (blocks[b].depth < 8 ? blocks[b].depth : 8));
+		for (unsigned i = blocks[b].first; i <= blocks[b].last; i++) {
+			unsigned vars[3];
+			calls[i + 1] = calls[i] +
+				(is_user_call(tac->instructions[i]) ? weight : 0);
+			referenced_vars(tac->instructions[i], vars);
+			for (int s = 1; s < 3; s++) {
+				if (vars[s] == 0) continue;
+				if (!BIT(def, b, local[vars[s]])) SET_BIT(use, b, local[vars[s]]);
+			}
+			if (vars[0] != 0) SET_BIT(def, b, local[vars[0]]);
+			for (int s = 0; s < 3; s++) {
+				if (vars[s] == 0) continue;
+				extend_interval(&ra->intervals[vars[s]], i);
+				ra->intervals[vars[s]].weight += weight;
+			}
+		}
+	}
+
+	// live_in = use | (live_out & ~def), live_out = union of successors' live_in
+	int changed = 1;
+	while (changed) {
+		changed = 0;
+		for (unsigned b = n_blocks; b-- > 0; ) {
+			for (unsigned w = 0; w < words; w++) {
+				unsigned out = 0;
+				for (unsigned s = 0; s < blocks[b].n_succ; s++) {
+					unsigned succ = blocks[b].succ[s] - fn->first_block;
+					out |= live_in[succ * words + w];
+				}
+				unsigned in = use[b * words + w] | (out & ~def[b * words + w]);
+				if (out != live_out[b * words + w] ||
+				    in != live_in[b * words + w]) {
+					live_out[b * words + w] = out;
+					live_in[b * words + w] = in;
+					changed = 1;
+				}
+			}
+		}
+	}
+
+	// interval covers every block boundary where the variable is live
+	for (unsigned b = 0; b < n_blocks; b++) {
+		for (unsigned l = 0; l < fn->n_vars; l++) {
+			if (BIT(live_in, b, l)) extend_interval(&ra->intervals[vars_of[l]], blocks[b].first);
+			if (BIT(live_out, b, l)) extend_interval(&ra->intervals[vars_of[l]], blocks[b].last);
+		}
+	}
+	#undef BIT
+	#undef SET_BIT
+
+	free(use);
+	free(def);
+	free(live_in);
+	free(live_out);
 }
 
-int get_free_register(int * var_mapping, int * reg_mapping, struct tac_instruction inst, FILE * f_out) {
-	if (free_reg <= 24) {
-		return free_reg++;
+static void compute_intervals(struct reg_alloc * ra) {
+	unsigned * local = malloc(ra->n_vars * sizeof(unsigned));
+	// weighted calls before each instruction
+	unsigned * calls = calloc(ra->tac->instructions_cnt + 1, sizeof(unsigned));
+
+	for (unsigned f = 0; f < ra->n_funcs; f++) {
+		compute_function_intervals(ra, &ra->funcs[f], local, calls);
 	}
-	else {
-		int dump_var = reg_mapping[dump_reg];
-		while ((dump_var == (int)inst.res_num) || 
-			((inst.op1.type == OPERAND_TYPE_VARIABLE) && (dump_var == (int)inst.op1.value.num)) ||
-			((inst.op2.type == OPERAND_TYPE_VARIABLE) && (dump_var == (int)inst.op2.value.num))) {
-			dump_reg = dump_reg + 1;
-			if (dump_reg == 25) dump_reg = 8;
-			dump_var = reg_mapping[dump_reg];
+	free(local);
+
+	// calls strictly inside the interval, the value has to survive them
+	for (unsigned v = 1; v < ra->n_vars; v++) {
+		struct interval * iv = &ra->intervals[v];
+		if (iv->start != NONE && iv->end > iv->start) {
+			iv->call_weight = calls[iv->end] - calls[iv->start + 1];
 		}
-		int reg = dump_reg;
-			
-		fprintf(f_out,"\tla $25,var%d\n",dump_var);
-		fprintf(f_out, "\tsw $%d,0($25)\n",reg);
-		var_mapping[dump_var] = -1;
-		dump_reg = dump_reg + 1;
-		if (dump_reg == 25) dump_reg = 8;
-		return reg;
 	}
+	free(calls);
+}
+
+static const struct interval * sort_intervals;
+
+static int compare_starts(const void * a, const void * b) {
+	unsigned va = *(const unsigned *)a, vb = *(const unsigned *)b;
+	unsigned sa = sort_intervals[va].start;
+	unsigned sb = sort_intervals[vb].start;
+	if (sa != sb) return (sa > sb) - (sa < sb);
+	return (va > vb) - (va < vb);
+}
+
+// spill weight of interval a per instruction is lower than the one of b
+static int cheaper(const struct interval * a, const struct interval * b) {
+	return (unsigned long long)a->weight * (b->end - b->start + 1) <
+		(unsigned long long)b->weight * (a->end - a->start + 1);
 }
 
-int get_register(int * var_mapping, int * reg_mapping, int var, struct tac_instruction inst, FILE * f_out) {
-	if (var_mapping[var] != -1) {
-		return var_mapping[var];
+// assign registers to intervals in order, return 1 if anything spilled
+static int linear_scan(struct reg_alloc * ra, const unsigned * order,
+			unsigned n, int n_temps) {
+	int regs[N_TEMP_REGISTERS + N_SAVED_REGISTERS];
+	int active[N_TEMP_REGISTERS + N_SAVED_REGISTERS]; // variable or -1
+	char used[N_TEMP_REGISTERS + N_SAVED_REGISTERS] = { 0 };
+	int n_regs = 0;
+	int spilled = 0;
+
+	for (int r = 0; r < n_temps; r++) {
+		regs[n_regs++] = temp_registers[r];
+	}
+	for (int r = 0; r < N_SAVED_REGISTERS; r++) {
+		regs[n_regs++] = saved_registers[r];
+	}
+	for (int r = 0; r < n_regs; r++) {
+		active[r] = -1;
+	}
+
+	for (unsigned k = 0; k < n; k++) {
+		unsigned v = order[k];
+		const struct interval * iv = &ra->intervals[v];
+		int reg = -1;
+
+		// expire intervals ended before this one starts
+		for (int r = 0; r < n_regs; r++) {
+			if (active[r] != -1 && ra->intervals[active[r]].end < iv->start) {
+				active[r] = -1;
+			}
+		}
+
+		// cheapest free register, temporary ones first on ties
+		unsigned best_cost = 0;
+		for (int r = 0; r < n_regs; r++) {
+			unsigned cost;
+			if (active[r] != -1) continue;
+			if (is_temp_register(regs[r])) {
+				cost = 2 * iv->call_weight;
+			}
+			else {
+				cost = used[r] ? 0 : 2;
+			}
+			if (reg == -1 || cost < best_cost) {
+				reg = r;
+				best_cost = cost;
+			}
+		}
+
+		if (reg == -1) {
+			// spill the interval with the fewest references per instruction
+			int victim = -1;
+			for (int r = 0; r < n_regs; r++) {
+				const struct interval * a = &ra->intervals[active[r]];
+				if (victim == -1 ||
+				    cheaper(a, &ra->intervals[active[victim]])) {
+					victim = r;
+				}
+			}
+			const struct interval * vi = &ra->intervals[active[victim]];
+			spilled = 1;
+			if (!cheaper(vi, iv)) {
+				ra->var_reg[v] = -1;
+				continue;
+			}
+			ra->var_reg[active[victim]] = -1;
+			reg = victim;
+		}
+
+		active[reg] = v;
+		used[reg] = 1;
+		ra->var_reg[v] = regs[reg];
 	}
-	int reg = get_free_register(var_mapping, reg_mapping, inst, f_out);
-	// load var to register
-	fprintf(f_out,"\tla $25,var%d\n",var);
-	fprintf(f_out, "\tlw $%d,0($25)\n",reg);
-	// update mappings
-	var_mapping[var] = reg;
-	reg_mapping[reg] = var;
+
+	return spilled;
+}
+
+static void allocate_registers(struct reg_alloc * ra) {
+	unsigned * order = malloc((ra->tac->instructions_cnt * 3 + 1) * sizeof(unsigned));
+
+	for (unsigned v = 1; v < ra->n_vars; v++) {
+		ra->var_reg[v] = -1;
+	}
+	sort_intervals = ra->intervals;
+
+	// functions occupy disjoint ranges of instructions, scan them one by one
+	for (unsigned f = 0; f < ra->n_funcs; f++) {
+		const unsigned * vars_of = ra->func_vars + ra->funcs[f].first_var;
+		unsigned cnt = 0;
+		for (unsigned l = 0; l < ra->funcs[f].n_vars; l++) {
+			if (ra->intervals[vars_of[l]].start != NONE) {
+				order[cnt++] = vars_of[l];
+			}
+		}
+		qsort(order, cnt, sizeof(unsigned), compare_starts);
+
+		if (linear_scan(ra, order, cnt, N_TEMP_REGISTERS)) {
+			// keep registers for loading and storing spilled variables
+			linear_scan(ra, order, cnt, N_TEMP_REGISTERS - N_SCRATCH);
+		}
+	}
+
+	free(order);
+}
+
+struct reg_alloc * reg_alloc_init(const struct tac * tac, unsigned n_vars,
+			const int * var_offsets) {
+	struct reg_alloc * ra = calloc(1, sizeof(struct reg_alloc));
+	ra->tac = tac;
+	ra->n_vars = n_vars;
+	ra->var_offsets = var_offsets;
+	ra->intervals = malloc(n_vars * sizeof(struct interval));
+	ra->var_reg = malloc(n_vars * sizeof(int));
+
+	for (unsigned v = 0; v < n_vars; v++) {
+		ra->intervals[v].start = NONE;
+		ra->intervals[v].end = NONE;
+		ra->intervals[v].weight = 0;
+		ra->intervals[v].call_weight = 0;
+	}
+	ra->var_reg[0] = -1;
+	for (int r = 0; r <= LAST_REGISTER; r++) {
+		ra->cached_var[r] = -1;
+	}
+
+	ra->n_blocks = build_cfg(tac, &ra->blocks);
+	build_functions(ra);
+	compute_intervals(ra);
+	allocate_registers(ra);
+	return ra;
+}
+
+void reg_alloc_free(struct reg_alloc * ra) {
+	free(ra->blocks);
+	free(ra->funcs);
+	free(ra->func_vars);
+	free(ra->intervals);
+	free(ra->var_reg);
+	free(ra);
+}
+
+static void write_back_cached(struct reg_alloc * ra, int forget, FILE * f_out) {
+	for (int r = FIRST_REGISTER; r <= LAST_REGISTER; r++) {
+		int var = ra->cached_var[r];
+		if (var == -1) continue;
+		if (ra->cached_dirty[r]) {
+			fprintf(f_out, "\tsw $%d,%d($fp)\n", r, ra->var_offsets[var]);
+			ra->cached_dirty[r] = 0;
+		}
+		if (forget) {
+			ra->cached_var[r] = -1;
+		}
+	}
+}
+
+void begin_instruction(struct reg_alloc * ra, unsigned i) {
+	ra->curr = i;
+	if (i > ra->blocks[ra->curr_block].last) {
+		// cache was written back at the end of previous block
+		ra->curr_block++;
+		if (ra->curr_block == ra->funcs[ra->curr_func].end_block) {
+			ra->curr_func++;
+		}
+		ra->pool_valid = 0;
+		for (int r = FIRST_REGISTER; r <= LAST_REGISTER; r++) {
+			ra->cached_var[r] = -1;
+		}
+	}
+}
+
+static void compute_pool(struct reg_alloc * ra) {
+	const struct block * blk = &ra->blocks[ra->curr_block];
+	for (int r = FIRST_REGISTER; r <= LAST_REGISTER; r++) {
+		// callee does not expect saved registers to be changed
+		ra->pool[r] = is_temp_register(r);
+	}
+	const struct func_info * fn = &ra->funcs[ra->curr_func];
+	for (unsigned l = 0; l < fn->n_vars; l++) {
+		unsigned v = ra->func_vars[fn->first_var + l];
+		if (ra->var_reg[v] != -1 && ra->intervals[v].start <= blk->last &&
+		    ra->intervals[v].end >= blk->first) {
+			ra->pool[ra->var_reg[v]] = 0;
+		}
+	}
+	ra->pool_valid = 1;
+}
+
+static int used_by_current(struct reg_alloc * ra, int var) {
+	unsigned vars[3];
+	referenced_vars(ra->tac->instructions[ra->curr], vars);
+	return (unsigned)var == vars[0] || (unsigned)var == vars[1] ||
+		(unsigned)var == vars[2];
+}
+
+// register caching spilled variable, evicts the least recently used one
+static int get_cached(struct reg_alloc * ra, int var, int * loaded, FILE * f_out) {
+	int reg = -1;
+
+	if (!ra->pool_valid) {
+		compute_pool(ra);
+	}
+	for (int r = FIRST_REGISTER; r <= LAST_REGISTER; r++) {
+		if (ra->cached_var[r] == var) {
+			ra->cached_used[r] = ra->curr;
+			*loaded = 1;
+			return r;
+		}
+	}
+	for (int r = FIRST_REGISTER; r <= LAST_REGISTER && reg == -1; r++) {
+		if (ra->pool[r] && ra->cached_var[r] == -1) {
+			reg = r;
+		}
+	}
+	int found_free = (reg != -1);
+	for (int r = FIRST_REGISTER; r <= LAST_REGISTER && !found_free; r++) {
+		if (ra->pool[r] && !used_by_current(ra, ra->cached_var[r]) &&
+		    (reg == -1 || ra->cached_used[r] < ra->cached_used[reg])) {
+			reg = r;
+		}
+	}
+	if (ra->cached_var[reg] != -1 && ra->cached_dirty[reg]) {
+		fprintf(f_out, "\tsw $%d,%d($fp)\n", reg, ra->var_offsets[ra->cached_var[reg]]);
+	}
+
+	ra->cached_var[reg] = var;
+	ra->cached_used[reg] = ra->curr;
+	ra->cached_dirty[reg] = 0;
+	*loaded = 0;
+	return reg;
+}
+
+int get_register(struct reg_alloc * ra, int var, FILE * f_out) {
+	if (ra->var_reg[var] != -1) {
+		return ra->var_reg[var];
+	}
+
+	int loaded;
+	int reg = get_cached(ra, var, &loaded, f_out);
+	if (!loaded) {
+		fprintf(f_out, "\tlw $%d,%d($fp)\n", reg, ra->var_offsets[var]);
+	}
+	return reg;
+}
+
+int get_result_register(struct reg_alloc * ra, int var, FILE * f_out) {
+	if (ra->var_reg[var] != -1) {
+		return ra->var_reg[var];
+	}
+
+	int loaded;
+	int reg = get_cached(ra, var, &loaded, f_out);
+	ra->cached_dirty[reg] = 1;
 	return reg;
 }
 
-void clear_mappings(int * var_mapping, int n_vars, int * reg_mapping, FILE * f_out) {
-	for (int i = 0; i < n_vars; i++) {
-		if (var_mapping[i] != -1) {
-			fprintf(f_out,"\tla $25,var%d\n",i);
-			fprintf(f_out, "\tsw $%d,0($25)\n",var_mapping[i]);
-			var_mapping[i] = -1;
-		}		
+void load_parameter(struct reg_alloc * ra, int var, FILE * f_out) {
+	// parameter arrives in its argument slot
+	if (ra->var_reg[var] != -1) {
+		fprintf(f_out, "\tlw $%d,%d($fp)\n", ra->var_reg[var], ra->var_offsets[var]);
 	}
-	for (int i = 0; i < n_registers; i++) {
-		reg_mapping[i] = -1;
+}
+
+int used_saved_registers(struct reg_alloc * ra, unsigned i, int * regs) {
+	char used[LAST_REGISTER + 1] = { 0 };
+	int n = 0;
+
+	// function starting at instruction i
+	unsigned lo = 0, hi = ra->n_funcs - 1;
+	while (lo < hi) {
+		unsigned mid = (lo + hi + 1) / 2;
+		if (ra->blocks[ra->funcs[mid].first_block].first <= i) lo = mid;
+		else hi = mid - 1;
+	}
+	const struct func_info * fn = &ra->funcs[lo];
+	for (unsigned l = 0; l < fn->n_vars; l++) {
+		unsigned v = ra->func_vars[fn->first_var + l];
+		if (ra->var_reg[v] != -1 && ra->intervals[v].start >= i) {
+			used[ra->var_reg[v]] = 1;
+		}
+	}
+	for (int r = 0; r < N_SAVED_REGISTERS; r++) {
+		if (used[saved_registers[r]]) {
+			regs[n++] = saved_registers[r];
+		}
+	}
+	return n;
+}
+
+void write_back_registers(struct reg_alloc * ra, FILE * f_out) {
+	// block is about to be left, spilled variables must be in memory
+	write_back_cached(ra, 0, f_out);
+}
+
+// variable occupies temporary register before and after current instruction
+static int live_across(struct reg_alloc * ra, unsigned v) {
+	return ra->var_reg[v] != -1 && is_temp_register(ra->var_reg[v]) &&
+		ra->intervals[v].start < ra->curr && ra->intervals[v].end > ra->curr;
+}
+
+void save_live_registers(struct reg_alloc * ra, FILE * f_out) {
+	const struct func_info * fn = &ra->funcs[ra->curr_func];
+	write_back_cached(ra, 1, f_out);
+	for (unsigned l = 0; l < fn->n_vars; l++) {
+		unsigned v = ra->func_vars[fn->first_var + l];
+		if (live_across(ra, v)) {
+			fprintf(f_out, "\tsw $%d,%d($fp)\n", ra->var_reg[v], ra->var_offsets[v]);
+		}
+	}
+}
+
+void restore_live_registers(struct reg_alloc * ra, FILE * f_out) {
+	const struct func_info * fn = &ra->funcs[ra->curr_func];
+	for (unsigned l = 0; l < fn->n_vars; l++) {
+		unsigned v = ra->func_vars[fn->first_var + l];
+		if (live_across(ra, v)) {
+			fprintf(f_out, "\tlw $%d,%d($fp)\n", ra->var_reg[v], ra->var_offsets[v]);
+		}
+	}
+}
+
+void end_instruction(struct reg_alloc * ra, FILE * f_out) {
+	// falling through to the next block
+	if (ra->curr == ra->blocks[ra->curr_block].last &&
+	    !ends_block(ra->tac->instructions[ra->curr].operator)) {
+		write_back_cached(ra, 0, f_out);
 	}
-	free_reg = 8; dump_reg = 8;
-	
 }
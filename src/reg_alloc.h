@@ -10,10 +10,19 @@
 
 #include "tac.h"
 
-void create_register_mapping(int ** mapping);
-void create_variable_mapping(int n_vars, int ** mapping);
-int get_register(int * var_mapping, int * reg_mapping, int var, struct tac_instruction inst, FILE * f_out);
-void clear_mappings(int * var_mapping, int n_vars, int * reg_mapping, FILE * f_out);
-void destroy_mappings(int * var_mapping, int * reg_mapping);
+struct reg_alloc;
+
+struct reg_alloc * reg_alloc_init(const struct tac * tac, unsigned n_vars,
+			const int * var_offsets);
+void reg_alloc_free(struct reg_alloc * ra);
+void begin_instruction(struct reg_alloc * ra, unsigned i);
+void end_instruction(struct reg_alloc * ra, FILE * f_out);
+int get_register(struct reg_alloc * ra, int var, FILE * f_out);
+int get_result_register(struct reg_alloc * ra, int var, FILE * f_out);
+void load_parameter(struct reg_alloc * ra, int var, FILE * f_out);
+int used_saved_registers(struct reg_alloc * ra, unsigned i, int * regs);
+void write_back_registers(struct reg_alloc * ra, FILE * f_out);
+void save_live_registers(struct reg_alloc * ra, FILE * f_out);
+void restore_live_registers(struct reg_alloc * ra, FILE * f_out);
 
 #endif //REG_ALLOC_H
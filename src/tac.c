@@ -243,7 +243,10 @@ void tac_print(struct tac *tac)
                         printf("-%-*s", 7, "");
                 }
                 tac_operand_print(instr->op1, instr->data_type);
-                tac_operand_print(instr->op2, instr->data_type);
+                //argument count of a call is an integer
+                tac_operand_print(instr->op2,
+                                (instr->operator == OPERATOR_CALL) ?
+                                DATA_TYPE_INT : instr->data_type);
                 if (instr->data_type != DATA_TYPE_UNSET) {
                         printf("%s", data_type_str[instr->data_type]);
                 } else {
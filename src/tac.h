@@ -24,9 +24,9 @@ typedef enum {
         OPERATOR_CAST_CHAR_TO_INT, //character's ASCII value to int
         OPERATOR_CAST_CHAR_TO_STRING, //character to one character long string
 
-        OPERATOR_LABEL, //label
+        OPERATOR_LABEL, //label, function entry if data type is function
         OPERATOR_JUMP, //unconditional jump, goto op1
-        OPERATOR_CALL, //function call
+        OPERATOR_CALL, //function call, op2 is argument count of print
         OPERATOR_RETURN, //return from function call
         OPERATOR_PUSH, //stack push
 
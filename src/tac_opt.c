@@ -0,0 +1,3842 @@
+/*
+ * project: VYPe15 programming language compiler
+ * author: Jan Wrona <xwrona00@stud.fit.vutbr.cz>
+ * author: Katerina Zmolikova <xzmoli02@stud.fit.vutbr.cz>
+ * date: 2015
+ */
+#include "tac_opt.h"
+#include "builtins.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+
+struct basic_block {
+        size_t first; //index of the first instruction
+        size_t last; //index of the last instruction
+        size_t succ[2]; //successor blocks
+        unsigned succ_cnt;
+        size_t *pred; //predecessor blocks
+        unsigned pred_cnt;
+};
+
+struct cfg { //control flow graph
+        struct basic_block *blocks;
+        size_t blocks_cnt;
+        size_t *preds; //memory for all predecessor arrays
+};
+
+enum const_state { //lattice of constant and copy propagation
+        CONST_UNDEF, //no definition seen yet
+        CONST_VALUE, //always the same value
+        CONST_VARYING, //not a constant
+};
+
+struct const_val {
+        enum const_state state;
+        int value;
+};
+
+
+/* Instruction helpers. */
+static int starts_function(const struct tac_instruction *instr)
+{
+        return instr->operator == OPERATOR_LABEL &&
+                instr->data_type == DATA_TYPE_FUNCTION;
+}
+
+static int ends_block(const struct tac_instruction *instr)
+{
+        return instr->operator == OPERATOR_JUMP ||
+                instr->operator == OPERATOR_BZERO ||
+                instr->operator == OPERATOR_RETURN;
+}
+
+static int is_var(const struct tac_operand *op)
+{
+        return op->type == OPERAND_TYPE_VARIABLE && op->value.num != 0;
+}
+
+static data_type_t result_type(const struct tac_instruction *instr)
+{
+        switch (instr->operator) {
+        case OPERATOR_CAST_INT_TO_CHAR:
+                return DATA_TYPE_CHAR;
+        case OPERATOR_CAST_CHAR_TO_STRING:
+                return DATA_TYPE_STRING;
+        case OPERATOR_NEG:
+        case OPERATOR_CAST_CHAR_TO_INT:
+                return DATA_TYPE_INT;
+        default:
+                if (instr->operator > _OPERATOR_BINARY &&
+                    instr->operator != OPERATOR_BZERO) {
+                        return DATA_TYPE_INT; //arithmetic, relation, logical
+                }
+                return instr->data_type;
+        }
+}
+
+/* Operands of these instructions may be integer or character literals. */
+static int accepts_literal(const struct tac_instruction *instr)
+{
+        if (instr->operator == OPERATOR_BZERO) {
+                return 1; //integer condition
+        } else if (instr->data_type != DATA_TYPE_INT &&
+            instr->data_type != DATA_TYPE_CHAR) {
+                return 0;
+        }
+
+        switch (instr->operator) {
+        case OPERATOR_ASSIGN:
+        case OPERATOR_NEG:
+        case OPERATOR_CAST_INT_TO_CHAR:
+        case OPERATOR_CAST_CHAR_TO_INT:
+        case OPERATOR_CAST_CHAR_TO_STRING:
+        case OPERATOR_PUSH:
+        case OPERATOR_RETURN:
+                return 1;
+        default:
+                return instr->operator > _OPERATOR_BINARY;
+        }
+}
+
+static int literal_value(data_type_t data_type, const struct tac_operand *op)
+{
+        return (data_type == DATA_TYPE_CHAR) ? op->value.char_val :
+                op->value.int_val;
+}
+
+static void set_literal(data_type_t data_type, struct tac_operand *op,
+                int value)
+{
+        op->type = OPERAND_TYPE_LITERAL;
+        if (data_type == DATA_TYPE_CHAR) {
+                op->value.char_val = value;
+        } else {
+                op->value.int_val = value;
+        }
+}
+
+/* Number of variables, including the dummy variable 0. */
+static size_t count_vars(const struct tac *tac)
+{
+        size_t vars_cnt = 0;
+
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                if (instr->res_num > vars_cnt) {
+                        vars_cnt = instr->res_num;
+                }
+                if (is_var(&instr->op1) && instr->op1.value.num > vars_cnt) {
+                        vars_cnt = instr->op1.value.num;
+                }
+                if (is_var(&instr->op2) && instr->op2.value.num > vars_cnt) {
+                        vars_cnt = instr->op2.value.num;
+                }
+        }
+
+        return vars_cnt + 1;
+}
+
+/* Instruction only computes its result. */
+static int is_pure(const struct tac_instruction *instr)
+{
+        switch (instr->operator) {
+        case OPERATOR_ASSIGN:
+        case OPERATOR_NEG:
+        case OPERATOR_CAST_INT_TO_CHAR:
+        case OPERATOR_CAST_CHAR_TO_INT:
+        case OPERATOR_CAST_CHAR_TO_STRING:
+                return 1;
+        default:
+                return instr->operator > _OPERATOR_BINARY &&
+                        instr->operator != OPERATOR_BZERO;
+        }
+}
+
+static void remove_instruction(struct tac_instruction *instr)
+{
+        if (instr->data_type == DATA_TYPE_STRING &&
+            instr->op1.type == OPERAND_TYPE_LITERAL) {
+                free(instr->op1.value.string_val);
+        }
+        instr->operator = OPERATOR_UNSET;
+}
+
+/* Remove instructions marked by OPERATOR_UNSET. */
+static void tac_compact(struct tac *tac)
+{
+        size_t cnt = 0;
+
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                if (tac->instructions[i].operator != OPERATOR_UNSET) {
+                        tac->instructions[cnt++] = tac->instructions[i];
+                }
+        }
+        tac->instructions_cnt = cnt;
+}
+
+
+/* Control flow graph. */
+static void cfg_free(struct cfg *cfg)
+{
+        free(cfg->blocks);
+        free(cfg->preds);
+}
+
+static int cfg_build(const struct tac *tac, struct cfg *cfg)
+{
+        size_t labels_cnt = 0;
+        size_t *label_block;
+        size_t b = 0;
+        size_t succ_total = 0;
+
+
+        memset(cfg, 0, sizeof (struct cfg));
+
+        /* Leaders are labels and instructions following a jump. */
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                if (i == 0 || instr->operator == OPERATOR_LABEL ||
+                    ends_block(&tac->instructions[i - 1])) {
+                        cfg->blocks_cnt++;
+                }
+                if (instr->operator == OPERATOR_LABEL &&
+                    instr->op1.value.num >= labels_cnt) {
+                        labels_cnt = instr->op1.value.num + 1;
+                }
+        }
+
+        cfg->blocks = calloc(cfg->blocks_cnt + 1, sizeof (struct basic_block));
+        label_block = malloc((labels_cnt + 1) * sizeof (size_t));
+        if (cfg->blocks == NULL || label_block == NULL) {
+                free(label_block);
+                cfg_free(cfg);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                if (i == 0 || instr->operator == OPERATOR_LABEL ||
+                    ends_block(&tac->instructions[i - 1])) {
+                        if (i > 0) {
+                                b++;
+                        }
+                        cfg->blocks[b].first = i;
+                }
+                cfg->blocks[b].last = i;
+                if (instr->operator == OPERATOR_LABEL) {
+                        label_block[instr->op1.value.num] = b;
+                }
+        }
+
+        /* Successors, functions are never entered by falling through. */
+        for (b = 0; b < cfg->blocks_cnt; ++b) {
+                struct basic_block *block = &cfg->blocks[b];
+                const struct tac_instruction *last =
+                        &tac->instructions[block->last];
+
+                if (last->operator == OPERATOR_JUMP) {
+                        block->succ[block->succ_cnt++] =
+                                label_block[last->op1.value.num];
+                } else if (last->operator != OPERATOR_RETURN) {
+                        if (last->operator == OPERATOR_BZERO) {
+                                block->succ[block->succ_cnt++] =
+                                        label_block[last->op2.value.num];
+                        }
+                        if (b + 1 < cfg->blocks_cnt && !starts_function(
+                                    &tac->instructions[block->last + 1])) {
+                                block->succ[block->succ_cnt++] = b + 1;
+                        }
+                }
+                succ_total += block->succ_cnt;
+        }
+        free(label_block);
+
+        /* Predecessors. */
+        cfg->preds = malloc((succ_total + 1) * sizeof (size_t));
+        if (cfg->preds == NULL) {
+                cfg_free(cfg);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+        for (b = 0; b < cfg->blocks_cnt; ++b) {
+                for (unsigned s = 0; s < cfg->blocks[b].succ_cnt; ++s) {
+                        cfg->blocks[cfg->blocks[b].succ[s]].pred_cnt++;
+                }
+        }
+        succ_total = 0;
+        for (b = 0; b < cfg->blocks_cnt; ++b) {
+                cfg->blocks[b].pred = cfg->preds + succ_total;
+                succ_total += cfg->blocks[b].pred_cnt;
+                cfg->blocks[b].pred_cnt = 0;
+        }
+        for (b = 0; b < cfg->blocks_cnt; ++b) {
+                for (unsigned s = 0; s < cfg->blocks[b].succ_cnt; ++s) {
+                        struct basic_block *succ =
+                                &cfg->blocks[cfg->blocks[b].succ[s]];
+
+                        succ->pred[succ->pred_cnt++] = b;
+                }
+        }
+
+
+        return 0;
+}
+
+/* Passes working on one function at a time. */
+typedef int (*function_pass_t)(struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const size_t *local,
+                size_t locals_cnt);
+
+/* Number the variables of the function from 1, index 0 is shared by the
+ * dummy variable and variables of other functions. Numbers of the indexed
+ * variables are stored in var so that the indices can be cleared. */
+static size_t index_locals(const struct tac *tac, size_t first, size_t last,
+                size_t *local, size_t *var)
+{
+        size_t locals_cnt = 1;
+
+
+        for (size_t i = first; i <= last; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+                const size_t vars[3] = {
+                        instr->res_num,
+                        is_var(&instr->op1) ? instr->op1.value.num : 0,
+                        is_var(&instr->op2) ? instr->op2.value.num : 0,
+                };
+
+                for (int k = 0; k < 3; ++k) {
+                        if (vars[k] != 0 && local[vars[k]] == 0) {
+                                var[locals_cnt] = vars[k];
+                                local[vars[k]] = locals_cnt++;
+                        }
+                }
+        }
+
+        return locals_cnt;
+}
+
+/* Block following the last block of the function. */
+static size_t function_end(const struct tac *tac, const struct cfg *cfg,
+                size_t b_first)
+{
+        size_t b_end = b_first + 1;
+
+
+        while (b_end < cfg->blocks_cnt && !starts_function(
+                        &tac->instructions[cfg->blocks[b_end].first])) {
+                b_end++;
+        }
+
+        return b_end;
+}
+
+static int for_each_function(struct tac *tac, function_pass_t pass)
+{
+        struct cfg cfg;
+        const size_t vars_cnt = count_vars(tac);
+        size_t *local; //variable number to index within function
+        size_t *var; //index within function to variable number
+        size_t b_first = 0;
+        int ret = 0;
+
+
+        if (cfg_build(tac, &cfg) != 0) {
+                return 1;
+        }
+        local = calloc(vars_cnt, sizeof (size_t));
+        var = malloc(vars_cnt * sizeof (size_t));
+        if (local == NULL || var == NULL) {
+                free(local);
+                free(var);
+                cfg_free(&cfg);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        while (ret == 0 && b_first < cfg.blocks_cnt) {
+                const size_t b_end = function_end(tac, &cfg, b_first);
+                size_t locals_cnt;
+
+                locals_cnt = index_locals(tac, cfg.blocks[b_first].first,
+                                cfg.blocks[b_end - 1].last, local, var);
+
+                ret = pass(tac, &cfg, b_first, b_end, local, locals_cnt);
+                for (size_t l = 1; l < locals_cnt; ++l) {
+                        local[var[l]] = 0;
+                }
+                b_first = b_end;
+        }
+
+        free(local);
+        free(var);
+        cfg_free(&cfg);
+        tac_compact(tac);
+        return ret;
+}
+
+
+/* Sparse dataflow over the blocks of a function. Entry states are kept only
+ * for tracked variables, which are read in some block before being written
+ * there, states of other variables are known only within one block. */
+#define TRACKED_MAX (1 << 18) //entry states kept for one function
+
+struct dataflow {
+        const struct cfg *cfg;
+        size_t b_first;
+        size_t blocks_cnt;
+        const char *global; //state of the variable holds in the whole function
+        size_t *track; //index among the tracked variables + 1, by local index
+        size_t *tracked; //local indices of the tracked variables
+        size_t tracked_cnt;
+        struct const_val *in; //tracked variables at the block entries
+        const struct const_val *entry; //tracked variables at the visited block
+        struct const_val *out; //tracked variables at the end of the block
+        struct const_val *env; //variables written in the visit, by local index
+        unsigned *stamp; //visit of the last write of the variable
+        unsigned visit;
+        size_t *work; //circular queue of blocks to visit
+        size_t work_head;
+        size_t work_cnt;
+        char *queued;
+};
+
+static void dataflow_free(struct dataflow *df)
+{
+        free(df->track);
+        free(df->tracked);
+        free(df->in);
+        free(df->out);
+        free(df->env);
+        free(df->stamp);
+        free(df->work);
+        free(df->queued);
+}
+
+/* Track the candidate variables read before being written in some block, at
+ * most TRACKED_MAX entry states. All the blocks are queued. */
+static int dataflow_init(struct dataflow *df, const struct tac *tac,
+                const struct cfg *cfg, size_t b_first, size_t b_end,
+                const size_t *local, size_t locals_cnt, const char *candidate)
+{
+        size_t tracked_max;
+
+
+        memset(df, 0, sizeof (struct dataflow));
+        df->cfg = cfg;
+        df->b_first = b_first;
+        df->blocks_cnt = b_end - b_first;
+        df->track = calloc(locals_cnt, sizeof (size_t));
+        df->tracked = malloc(locals_cnt * sizeof (size_t));
+        df->env = malloc(locals_cnt * sizeof (struct const_val));
+        df->stamp = calloc(locals_cnt, sizeof (unsigned));
+        df->work = malloc(df->blocks_cnt * sizeof (size_t));
+        df->queued = malloc(df->blocks_cnt);
+        if (df->track == NULL || df->tracked == NULL || df->env == NULL ||
+            df->stamp == NULL || df->work == NULL || df->queued == NULL) {
+                dataflow_free(df);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        tracked_max = TRACKED_MAX / df->blocks_cnt;
+        for (size_t b = b_first; b < b_end; ++b) {
+                for (size_t i = cfg->blocks[b].first;
+                     i <= cfg->blocks[b].last; ++i) {
+                        const struct tac_instruction *instr =
+                                &tac->instructions[i];
+                        const struct tac_operand *ops[2] = {
+                                &instr->op1, &instr->op2
+                        };
+
+                        for (int k = 0; k < 2; ++k) {
+                                size_t l;
+
+                                if (!is_var(ops[k])) {
+                                        continue;
+                                }
+                                l = local[ops[k]->value.num];
+                                if (candidate[l] && df->track[l] == 0 &&
+                                    df->stamp[l] != b + 1 &&
+                                    df->tracked_cnt < tracked_max) {
+                                        df->tracked[df->tracked_cnt++] = l;
+                                        df->track[l] = df->tracked_cnt;
+                                }
+                        }
+                        df->stamp[local[instr->res_num]] = b + 1;
+                }
+        }
+        memset(df->stamp, 0, locals_cnt * sizeof (unsigned));
+
+        df->in = malloc((df->blocks_cnt * df->tracked_cnt + 1) *
+                        sizeof (struct const_val));
+        df->out = malloc((df->tracked_cnt + 1) * sizeof (struct const_val));
+        if (df->in == NULL || df->out == NULL) {
+                dataflow_free(df);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+        for (size_t i = 0; i < df->blocks_cnt * df->tracked_cnt; ++i) {
+                df->in[i].state = CONST_UNDEF;
+        }
+
+        for (size_t b = 0; b < df->blocks_cnt; ++b) {
+                df->work[b] = b_first + b;
+                df->queued[b] = 1;
+        }
+        df->work_cnt = df->blocks_cnt;
+
+        return 0;
+}
+
+static void dataflow_enqueue(struct dataflow *df, size_t b)
+{
+        if (!df->queued[b - df->b_first]) {
+                df->queued[b - df->b_first] = 1;
+                df->work[(df->work_head + df->work_cnt++) % df->blocks_cnt] = b;
+        }
+}
+
+static int dataflow_dequeue(struct dataflow *df, size_t *b)
+{
+        if (df->work_cnt == 0) {
+                return 0;
+        }
+        *b = df->work[df->work_head];
+        df->work_head = (df->work_head + 1) % df->blocks_cnt;
+        df->work_cnt--;
+        df->queued[*b - df->b_first] = 0;
+
+        return 1;
+}
+
+/* Start a visit of the block, no variable has been written in it yet. */
+static void dataflow_visit(struct dataflow *df, size_t b)
+{
+        df->visit++;
+        df->entry = df->in + (b - df->b_first) * df->tracked_cnt;
+}
+
+/* State of the variable at the current point of the visited block. */
+static struct const_val dataflow_get(const struct dataflow *df, size_t l)
+{
+        struct const_val cv = { CONST_VARYING, 0 };
+
+
+        if ((df->global != NULL && df->global[l]) ||
+            df->stamp[l] == df->visit) {
+                cv = df->env[l];
+        } else if (df->track[l] != 0) {
+                cv = df->entry[df->track[l] - 1];
+        }
+
+        return cv;
+}
+
+static void dataflow_set(struct dataflow *df, size_t l, struct const_val cv)
+{
+        df->env[l] = cv;
+        df->stamp[l] = df->visit;
+}
+
+static int meet(struct const_val *dst, struct const_val src)
+{
+        struct const_val old = *dst;
+
+
+        if (src.state == CONST_UNDEF || dst->state == CONST_VARYING) {
+                return 0;
+        }
+        if (dst->state == CONST_UNDEF) {
+                *dst = src;
+        } else if (src.state == CONST_VARYING || src.value != dst->value) {
+                dst->state = CONST_VARYING;
+        }
+
+        return old.state != dst->state;
+}
+
+/* Meet the states at the end of the block (filled in out) with the entry
+ * states of its successors, changed successors are queued. */
+static void dataflow_propagate(struct dataflow *df, size_t b)
+{
+        const struct basic_block *block = &df->cfg->blocks[b];
+
+
+        for (unsigned s = 0; s < block->succ_cnt; ++s) {
+                struct const_val *succ_in = df->in +
+                        (block->succ[s] - df->b_first) * df->tracked_cnt;
+                int changed = 0;
+
+                for (size_t t = 0; t < df->tracked_cnt; ++t) {
+                        changed |= meet(&succ_in[t], df->out[t]);
+                }
+                if (changed) {
+                        dataflow_enqueue(df, block->succ[s]);
+                }
+        }
+}
+
+
+/* Constant folding and propagation. */
+static int fold(operator_t operator, int a, int b, int *res)
+{
+        switch (operator) {
+        case OPERATOR_ADD:
+                *res = (int)((unsigned)a + (unsigned)b); //wraps like MIPS
+                break;
+        case OPERATOR_SUB:
+                *res = (int)((unsigned)a - (unsigned)b);
+                break;
+        case OPERATOR_MUL:
+                *res = (int)((unsigned)a * (unsigned)b);
+                break;
+        case OPERATOR_DIV:
+        case OPERATOR_MOD:
+                if (b == 0 || (a == INT_MIN && b == -1)) {
+                        return 1; //leave it to run time
+                }
+                *res = (operator == OPERATOR_DIV) ? a / b : a % b;
+                break;
+        case OPERATOR_SE:
+                *res = (a == b);
+                break;
+        case OPERATOR_SNE:
+                *res = (a != b);
+                break;
+        case OPERATOR_SLT:
+                *res = (a < b);
+                break;
+        case OPERATOR_SLET:
+                *res = (a <= b);
+                break;
+        case OPERATOR_SGT:
+                *res = (a > b);
+                break;
+        case OPERATOR_SGET:
+                *res = (a >= b);
+                break;
+        case OPERATOR_AND:
+                *res = (a && b);
+                break;
+        case OPERATOR_OR:
+                *res = (a || b);
+                break;
+        case OPERATOR_NEG:
+                *res = !a;
+                break;
+        case OPERATOR_ASSIGN:
+        case OPERATOR_CAST_CHAR_TO_INT:
+                *res = a;
+                break;
+        case OPERATOR_CAST_INT_TO_CHAR:
+                if ((a & 0xFF) > CHAR_MAX) {
+                        return 1; //character literals are sign extended
+                }
+                *res = a & 0xFF;
+                break;
+        default:
+                return 1;
+        }
+
+        return 0;
+}
+
+static struct const_val operand_const(const struct tac_instruction *instr,
+                const struct tac_operand *op, const struct dataflow *df,
+                const size_t *local)
+{
+        struct const_val cv = { CONST_VARYING, 0 };
+
+
+        if (op->type == OPERAND_TYPE_LITERAL) {
+                if (instr->data_type == DATA_TYPE_INT ||
+                    instr->data_type == DATA_TYPE_CHAR) {
+                        cv.state = CONST_VALUE;
+                        cv.value = literal_value(instr->data_type, op);
+                }
+        } else if (is_var(op)) {
+                cv = dataflow_get(df, local[op->value.num]);
+        }
+
+        return cv;
+}
+
+/* Value of the result of the instruction under the given environment. */
+static struct const_val evaluate(const struct tac_instruction *instr,
+                const struct dataflow *df, const size_t *local)
+{
+        struct const_val res = { CONST_VARYING, 0 };
+        struct const_val a = operand_const(instr, &instr->op1, df, local);
+        struct const_val b = { CONST_VALUE, 0 };
+        data_type_t res_type = result_type(instr);
+
+
+        if (res_type != DATA_TYPE_INT && res_type != DATA_TYPE_CHAR) {
+                return res; //strings are not tracked
+        }
+        if (instr->operator > _OPERATOR_BINARY) {
+                b = operand_const(instr, &instr->op2, df, local);
+        }
+
+        if (a.state == CONST_VARYING || b.state == CONST_VARYING) {
+                return res;
+        } else if (a.state == CONST_UNDEF || b.state == CONST_UNDEF) {
+                res.state = CONST_UNDEF; //optimistic, may become a constant
+        } else if (fold(instr->operator, a.value, b.value, &res.value) == 0) {
+                res.state = CONST_VALUE;
+        }
+
+        return res;
+}
+
+/* Returns 1 if the value of a variable defined only once has changed. */
+static int transfer(const struct tac_instruction *instr, struct dataflow *df,
+                const size_t *local)
+{
+        const size_t res = local[instr->res_num];
+        struct const_val val = { CONST_VARYING, 0 };
+
+
+        if (instr->res_num == 0) {
+                return 0;
+        }
+
+        if (instr->operator != OPERATOR_POP &&
+            instr->operator != OPERATOR_CALL) {
+                val = evaluate(instr, df, local);
+        }
+        if (df->global[res]) {
+                return meet(&df->env[res], val);
+        }
+        dataflow_set(df, res, val);
+        return 0;
+}
+
+/* Replace constant operands by literals and fold the instruction. */
+static void rewrite(struct tac_instruction *instr, const struct dataflow *df,
+                const size_t *local)
+{
+        const struct tac_operand orig_op1 = instr->op1;
+        struct const_val cv;
+        struct const_val res;
+
+
+        if (!accepts_literal(instr)) {
+                return;
+        }
+
+        if (is_var(&instr->op1)) {
+                cv = dataflow_get(df, local[instr->op1.value.num]);
+                if (cv.state == CONST_VALUE) {
+                        set_literal(instr->data_type, &instr->op1, cv.value);
+                }
+        }
+        if (instr->operator > _OPERATOR_BINARY && is_var(&instr->op2)) {
+                cv = dataflow_get(df, local[instr->op2.value.num]);
+                if (cv.state == CONST_VALUE) {
+                        set_literal(instr->data_type, &instr->op2, cv.value);
+                }
+        }
+
+        if (instr->operator == OPERATOR_BZERO) {
+                if (instr->op1.type != OPERAND_TYPE_LITERAL) {
+                        return;
+                } else if (instr->op1.value.int_val == 0) {
+                        instr->operator = OPERATOR_JUMP; //always taken
+                        instr->op1 = instr->op2;
+                        instr->op2.type = OPERAND_TYPE_UNUSED;
+                } else {
+                        instr->operator = OPERATOR_UNSET; //never taken
+                }
+                return;
+        }
+
+        if (instr->res_num == 0 || instr->operator == OPERATOR_ASSIGN) {
+                return;
+        }
+        res = evaluate(instr, df, local);
+        if (res.state == CONST_VALUE) {
+                instr->data_type = result_type(instr);
+                instr->operator = OPERATOR_ASSIGN;
+                set_literal(instr->data_type, &instr->op1, res.value);
+                instr->op2.type = OPERAND_TYPE_UNUSED;
+        } else if (instr->op1.type == OPERAND_TYPE_LITERAL &&
+                   instr->op2.type == OPERAND_TYPE_LITERAL) {
+                instr->op1 = orig_op1; //code generator loads one literal only
+        }
+}
+
+/* Blocks reading each variable, the variable with local index l is read in
+ * use_block[use_start[l]] to use_block[use_start[l + 1] - 1]. */
+static int use_blocks(const struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const size_t *local,
+                size_t locals_cnt, size_t **use_start, size_t **use_block)
+{
+        size_t uses_cnt = 0;
+
+
+        *use_start = calloc(locals_cnt + 1, sizeof (size_t));
+        if (*use_start == NULL) {
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+        for (size_t i = cfg->blocks[b_first].first;
+             i <= cfg->blocks[b_end - 1].last; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                if (is_var(&instr->op1)) {
+                        (*use_start)[local[instr->op1.value.num] + 1]++;
+                        uses_cnt++;
+                }
+                if (is_var(&instr->op2)) {
+                        (*use_start)[local[instr->op2.value.num] + 1]++;
+                        uses_cnt++;
+                }
+        }
+        for (size_t l = 1; l <= locals_cnt; ++l) {
+                (*use_start)[l] += (*use_start)[l - 1];
+        }
+
+        *use_block = malloc((uses_cnt + 1) * sizeof (size_t));
+        if (*use_block == NULL) {
+                free(*use_start);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+        for (size_t b = b_first; b < b_end; ++b) {
+                for (size_t i = cfg->blocks[b].first;
+                     i <= cfg->blocks[b].last; ++i) {
+                        const struct tac_instruction *instr =
+                                &tac->instructions[i];
+
+                        if (is_var(&instr->op1)) {
+                                (*use_block)[(*use_start)[
+                                        local[instr->op1.value.num]]++] = b;
+                        }
+                        if (is_var(&instr->op2)) {
+                                (*use_block)[(*use_start)[
+                                        local[instr->op2.value.num]]++] = b;
+                        }
+                }
+        }
+
+        /* Filling moved the starts to the ends of the ranges. */
+        for (size_t l = locals_cnt; l > 0; --l) {
+                (*use_start)[l] = (*use_start)[l - 1];
+        }
+        (*use_start)[0] = 0;
+
+        return 0;
+}
+
+/* Variables defined only once have the same value in the whole function,
+ * entry states are kept for the other ones. */
+static int constant_propagation_function(struct tac *tac,
+                const struct cfg *cfg, size_t b_first, size_t b_end,
+                const size_t *local, size_t locals_cnt)
+{
+        struct dataflow df;
+        char *global = calloc(locals_cnt, 1);
+        char *candidate = calloc(locals_cnt, 1); //definitions, at most 2
+        size_t *use_start;
+        size_t *use_block;
+        size_t b;
+
+
+        if (global == NULL || candidate == NULL) {
+                free(global);
+                free(candidate);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+        for (size_t i = cfg->blocks[b_first].first;
+             i <= cfg->blocks[b_end - 1].last; ++i) {
+                const size_t res = local[tac->instructions[i].res_num];
+
+                if (res != 0 && candidate[res] < 2) {
+                        candidate[res]++;
+                }
+        }
+        for (size_t l = 1; l < locals_cnt; ++l) {
+                global[l] = (candidate[l] == 1);
+                candidate[l] = (candidate[l] > 1);
+        }
+
+        if (use_blocks(tac, cfg, b_first, b_end, local, locals_cnt,
+                                &use_start, &use_block) != 0) {
+                free(global);
+                free(candidate);
+                return 1;
+        }
+        if (dataflow_init(&df, tac, cfg, b_first, b_end, local, locals_cnt,
+                                candidate) != 0) {
+                free(global);
+                free(candidate);
+                free(use_start);
+                free(use_block);
+                return 1;
+        }
+        df.global = global;
+        for (size_t l = 1; l < locals_cnt; ++l) {
+                df.env[l].state = CONST_UNDEF;
+        }
+
+        /* Iterate until the entry states and the global values are stable,
+         * blocks reading a changed global value are visited again. */
+        while (dataflow_dequeue(&df, &b)) {
+                const struct basic_block *block = &cfg->blocks[b];
+
+                dataflow_visit(&df, b);
+                for (size_t i = block->first; i <= block->last; ++i) {
+                        const size_t res = local[tac->instructions[i].res_num];
+
+                        if (transfer(&tac->instructions[i], &df, local)) {
+                                for (size_t u = use_start[res];
+                                     u < use_start[res + 1]; ++u) {
+                                        dataflow_enqueue(&df, use_block[u]);
+                                }
+                        }
+                }
+                for (size_t t = 0; t < df.tracked_cnt; ++t) {
+                        df.out[t] = dataflow_get(&df, df.tracked[t]);
+                }
+                dataflow_propagate(&df, b);
+        }
+
+        for (b = b_first; b < b_end; ++b) {
+                const struct basic_block *block = &cfg->blocks[b];
+
+                dataflow_visit(&df, b);
+                for (size_t i = block->first; i <= block->last; ++i) {
+                        struct tac_instruction orig = tac->instructions[i];
+
+                        rewrite(&tac->instructions[i], &df, local);
+                        transfer(&orig, &df, local);
+                }
+        }
+
+        dataflow_free(&df);
+        free(global);
+        free(candidate);
+        free(use_start);
+        free(use_block);
+        return 0;
+}
+
+
+/* Copy propagation, the value of a copy is the number of its source. A copy
+ * is valid while its source has not been written since the copy was made,
+ * writes are counted instead of searching for copies of the written
+ * variable. */
+struct copies {
+        struct dataflow df;
+        unsigned *writes; //writes of the variable in the visit
+        unsigned *made; //writes of the source when the copy was made
+};
+
+static unsigned writes(const struct copies *c, size_t l)
+{
+        return (c->df.stamp[l] == c->df.visit) ? c->writes[l] : 0;
+}
+
+static struct const_val copy_get(const struct copies *c, const size_t *local,
+                size_t l)
+{
+        struct const_val cv = dataflow_get(&c->df, l);
+        const unsigned made = (c->df.stamp[l] == c->df.visit) ? c->made[l] : 0;
+
+
+        if (cv.state == CONST_VALUE && writes(c, local[cv.value]) != made) {
+                cv.state = CONST_VARYING; //source written since
+        }
+
+        return cv;
+}
+
+static void copy_transfer(const struct tac_instruction *instr,
+                struct copies *c, const size_t *local)
+{
+        const size_t res = local[instr->res_num];
+        struct const_val cv = { CONST_VARYING, 0 };
+
+
+        if (instr->res_num == 0 || instr->operator == OPERATOR_UNSET) {
+                return;
+        }
+
+        c->writes[res] = writes(c, res) + 1;
+        if (instr->operator == OPERATOR_ASSIGN && is_var(&instr->op1) &&
+            instr->op1.value.num != instr->res_num) {
+                cv.state = CONST_VALUE;
+                cv.value = instr->op1.value.num;
+                c->made[res] = writes(c, local[instr->op1.value.num]);
+        }
+        dataflow_set(&c->df, res, cv);
+}
+
+static void copy_rewrite(struct tac_instruction *instr,
+                const struct copies *c, const size_t *local)
+{
+        struct const_val cv;
+
+
+        if (is_var(&instr->op1)) {
+                cv = copy_get(c, local, local[instr->op1.value.num]);
+                if (cv.state == CONST_VALUE) {
+                        instr->op1.value.num = cv.value;
+                }
+        }
+        if (is_var(&instr->op2)) {
+                cv = copy_get(c, local, local[instr->op2.value.num]);
+                if (cv.state == CONST_VALUE) {
+                        instr->op2.value.num = cv.value;
+                }
+        }
+}
+
+static int copy_propagation_function(struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const size_t *local,
+                size_t locals_cnt)
+{
+        struct copies c;
+        char *candidate = calloc(locals_cnt, 1); //results of copies
+        size_t b;
+
+
+        if (candidate == NULL) {
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+        for (size_t i = cfg->blocks[b_first].first;
+             i <= cfg->blocks[b_end - 1].last; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                if (instr->operator == OPERATOR_ASSIGN && is_var(&instr->op1)) {
+                        candidate[local[instr->res_num]] = 1;
+                }
+        }
+        candidate[0] = 0;
+
+        if (dataflow_init(&c.df, tac, cfg, b_first, b_end, local, locals_cnt,
+                                candidate) != 0) {
+                free(candidate);
+                return 1;
+        }
+        free(candidate);
+        c.writes = malloc(locals_cnt * sizeof (unsigned));
+        c.made = malloc(locals_cnt * sizeof (unsigned));
+        if (c.writes == NULL || c.made == NULL) {
+                free(c.writes);
+                free(c.made);
+                dataflow_free(&c.df);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        while (dataflow_dequeue(&c.df, &b)) {
+                const struct basic_block *block = &cfg->blocks[b];
+
+                dataflow_visit(&c.df, b);
+                for (size_t i = block->first; i <= block->last; ++i) {
+                        copy_transfer(&tac->instructions[i], &c, local);
+                }
+                for (size_t t = 0; t < c.df.tracked_cnt; ++t) {
+                        c.df.out[t] = copy_get(&c, local, c.df.tracked[t]);
+                }
+                dataflow_propagate(&c.df, b);
+        }
+
+        for (b = b_first; b < b_end; ++b) {
+                const struct basic_block *block = &cfg->blocks[b];
+
+                dataflow_visit(&c.df, b);
+                for (size_t i = block->first; i <= block->last; ++i) {
+                        struct tac_instruction orig = tac->instructions[i];
+
+                        copy_rewrite(&tac->instructions[i], &c, local);
+                        copy_transfer(&orig, &c, local);
+                }
+        }
+
+        free(c.writes);
+        free(c.made);
+        dataflow_free(&c.df);
+        return 0;
+}
+
+
+/* Let the instruction computing a temporary write directly to the variable
+ * the temporary is copied to, the copy is removed. */
+static int coalesce_copies(struct tac *tac)
+{
+        const size_t vars_cnt = count_vars(tac);
+        unsigned *reads = calloc(vars_cnt, sizeof (unsigned));
+        unsigned *defs = calloc(vars_cnt, sizeof (unsigned));
+        size_t prev = 0;
+
+
+        if (reads == NULL || defs == NULL) {
+                free(reads);
+                free(defs);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                defs[instr->res_num]++;
+                if (is_var(&instr->op1)) {
+                        reads[instr->op1.value.num]++;
+                }
+                if (is_var(&instr->op2)) {
+                        reads[instr->op2.value.num]++;
+                }
+        }
+
+        for (size_t i = 1; i < tac->instructions_cnt; ++i) {
+                struct tac_instruction *def = &tac->instructions[prev];
+                struct tac_instruction *copy = &tac->instructions[i];
+                const size_t tmp = def->res_num;
+
+                if (copy->operator == OPERATOR_ASSIGN && is_var(&copy->op1) &&
+                    copy->op1.value.num == tmp && copy->res_num != tmp &&
+                    (is_pure(def) || def->operator == OPERATOR_CALL) &&
+                    reads[tmp] == 1 && defs[tmp] == 1) {
+                        def->res_num = copy->res_num;
+                        copy->operator = OPERATOR_UNSET;
+                } else {
+                        prev = i;
+                }
+        }
+
+        free(reads);
+        free(defs);
+        tac_compact(tac);
+        return 0;
+}
+
+
+/* Local value numbering. */
+struct value_entry {
+        operator_t operator; //OPERATOR_UNSET if the entry is empty
+        data_type_t data_type;
+        unsigned a; //value number of the first operand or a literal value
+        unsigned b; //value number of the second operand
+        unsigned holder; //variable holding the value
+        unsigned vn; //value number of the value
+};
+
+struct value_table {
+        struct value_entry *entries;
+        size_t size; //power of two
+        size_t *used; //indices of used entries
+        size_t used_cnt;
+        unsigned *var_vn; //value numbers of local variables
+        size_t *var_block; //block the value number of the variable is from
+        unsigned vn_cnt;
+};
+
+struct pushed {
+        size_t index; //index of the push instruction
+        unsigned vn; //value number of the pushed value
+};
+
+static int is_commutative(operator_t operator)
+{
+        switch (operator) {
+        case OPERATOR_ADD:
+        case OPERATOR_MUL:
+        case OPERATOR_SE:
+        case OPERATOR_SNE:
+        case OPERATOR_AND:
+        case OPERATOR_OR:
+                return 1;
+        default:
+                return 0;
+        }
+}
+
+/* Value number of the variable, a new one for the first use in the block. */
+static unsigned var_vn(struct value_table *vt, size_t l, size_t b)
+{
+        if (vt->var_block[l] != b + 1) {
+                vt->var_block[l] = b + 1;
+                vt->var_vn[l] = ++vt->vn_cnt;
+        }
+
+        return vt->var_vn[l];
+}
+
+/* Entry with the given key or an empty entry where it belongs. */
+static struct value_entry * value_lookup(struct value_table *vt,
+                operator_t operator, data_type_t data_type, unsigned a,
+                unsigned b)
+{
+        size_t h = ((operator * 31u + data_type) * 31u + a) * 31u + b;
+
+
+        for (h &= vt->size - 1; ; h = (h + 1) & (vt->size - 1)) {
+                struct value_entry *e = &vt->entries[h];
+
+                if (e->operator == OPERATOR_UNSET) {
+                        e->data_type = data_type;
+                        e->a = a;
+                        e->b = b;
+                        e->holder = 0;
+                        e->vn = 0;
+                        vt->used[vt->used_cnt++] = h;
+                        return e;
+                } else if (e->operator == operator &&
+                           e->data_type == data_type && e->a == a &&
+                           e->b == b) {
+                        return e;
+                }
+        }
+}
+
+static unsigned operand_vn(struct value_table *vt,
+                const struct tac_instruction *instr,
+                const struct tac_operand *op, const size_t *local, size_t b)
+{
+        struct value_entry *e;
+
+
+        if (is_var(op)) {
+                return var_vn(vt, local[op->value.num], b);
+        }
+
+        /* Integer and character literals, key is the value itself. */
+        e = value_lookup(vt, OPERATOR_ASSIGN, instr->data_type,
+                        literal_value(instr->data_type, op), 0);
+        if (e->operator == OPERATOR_UNSET) {
+                e->operator = OPERATOR_ASSIGN;
+                e->vn = ++vt->vn_cnt;
+        }
+
+        return e->vn;
+}
+
+/* Reuse the value of the entry if its holder still has it, otherwise the
+ * result of the instruction becomes the new holder. */
+static int reuse_value(struct value_table *vt, struct value_entry *e,
+                struct tac_instruction *instr, const size_t *local, size_t b)
+{
+        const size_t res = local[instr->res_num];
+
+
+        if (e->operator != OPERATOR_UNSET &&
+            var_vn(vt, local[e->holder], b) == e->vn) {
+                instr->data_type = result_type(instr);
+                instr->operator = OPERATOR_ASSIGN;
+                instr->op1.type = OPERAND_TYPE_VARIABLE;
+                instr->op1.value.num = e->holder;
+                instr->op2.type = OPERAND_TYPE_UNUSED;
+                vt->var_vn[res] = e->vn;
+                return 1;
+        }
+
+        if (e->operator == OPERATOR_UNSET) {
+                e->vn = ++vt->vn_cnt;
+        }
+        e->holder = instr->res_num;
+        vt->var_vn[res] = e->vn;
+        return 0;
+}
+
+static void value_numbering_block(struct tac *tac, struct value_table *vt,
+                const struct basic_block *block, size_t b,
+                const size_t *local, struct pushed *pushed)
+{
+        size_t top = 0; //pushes of calls which have not been reached yet
+
+
+        for (size_t i = block->first; i <= block->last; ++i) {
+                struct tac_instruction *instr = &tac->instructions[i];
+                struct value_entry *e;
+                operator_t operator = instr->operator;
+                unsigned a;
+                unsigned c = 0;
+
+                if (instr->operator == OPERATOR_PUSH) {
+                        pushed[top].index = i;
+                        pushed[top++].vn =
+                                operand_vn(vt, instr, &instr->op1, local, b);
+                        continue;
+                } else if (instr->operator == OPERATOR_CALL) {
+                        var_vn(vt, local[instr->res_num], b);
+                        if (instr->op1.value.num != GET_AT_LABEL || top < 2) {
+                                top = 0; //arguments of other calls are unknown
+                                vt->var_vn[local[instr->res_num]] =
+                                        ++vt->vn_cnt;
+                                continue;
+                        }
+
+                        /* Characters of strings never change. */
+                        top -= 2;
+                        e = value_lookup(vt, OPERATOR_CALL, instr->data_type,
+                                        pushed[top].vn, pushed[top + 1].vn);
+                        if (reuse_value(vt, e, instr, local, b)) {
+                                remove_instruction(
+                                        &tac->instructions[pushed[top].index]);
+                                remove_instruction(&tac->instructions[
+                                                pushed[top + 1].index]);
+                        } else {
+                                e->operator = OPERATOR_CALL;
+                        }
+                        continue;
+                } else if (instr->res_num == 0) {
+                        continue;
+                }
+
+                var_vn(vt, local[instr->res_num], b); //stamp the result
+                if (instr->operator == OPERATOR_ASSIGN && is_var(&instr->op1)) {
+                        vt->var_vn[local[instr->res_num]] = var_vn(vt,
+                                        local[instr->op1.value.num], b);
+                        continue;
+                } else if (instr->operator == OPERATOR_ASSIGN &&
+                           instr->data_type != DATA_TYPE_STRING) {
+                        vt->var_vn[local[instr->res_num]] =
+                                operand_vn(vt, instr, &instr->op1, local, b);
+                        continue;
+                } else if (!is_pure(instr) ||
+                           instr->operator == OPERATOR_ASSIGN ||
+                           instr->operator == OPERATOR_CAST_CHAR_TO_STRING) {
+                        /* Every new string is a different pointer. */
+                        vt->var_vn[local[instr->res_num]] = ++vt->vn_cnt;
+                        continue;
+                }
+
+                a = operand_vn(vt, instr, &instr->op1, local, b);
+                if (instr->operator > _OPERATOR_BINARY) {
+                        c = operand_vn(vt, instr, &instr->op2, local, b);
+                }
+
+                /* Canonical form of the expression. */
+                if (operator == OPERATOR_SGT || operator == OPERATOR_SGET ||
+                    (is_commutative(operator) && a > c)) {
+                        const unsigned tmp = a;
+
+                        a = c;
+                        c = tmp;
+                        if (operator == OPERATOR_SGT) {
+                                operator = OPERATOR_SLT;
+                        } else if (operator == OPERATOR_SGET) {
+                                operator = OPERATOR_SLET;
+                        }
+                }
+
+                e = value_lookup(vt, operator, instr->data_type, a, c);
+                if (reuse_value(vt, e, instr, local, b) == 0) {
+                        e->operator = operator;
+                }
+        }
+}
+
+static int value_numbering_function(struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const size_t *local,
+                size_t locals_cnt)
+{
+        const size_t instructions_cnt = cfg->blocks[b_end - 1].last -
+                cfg->blocks[b_first].first + 1;
+        struct value_table vt = { NULL, 1, NULL, 0, NULL, NULL, 0 };
+        struct pushed *pushed;
+
+
+        /* At most three entries per instruction, table is half empty. */
+        while (vt.size < 6 * instructions_cnt) {
+                vt.size *= 2;
+        }
+        vt.entries = malloc(vt.size * sizeof (struct value_entry));
+        vt.used = malloc(3 * instructions_cnt * sizeof (size_t));
+        vt.var_vn = malloc(locals_cnt * sizeof (unsigned));
+        vt.var_block = calloc(locals_cnt, sizeof (size_t));
+        pushed = malloc(instructions_cnt * sizeof (struct pushed));
+        if (vt.entries == NULL || vt.used == NULL || vt.var_vn == NULL ||
+            vt.var_block == NULL || pushed == NULL) {
+                free(vt.entries);
+                free(vt.used);
+                free(vt.var_vn);
+                free(vt.var_block);
+                free(pushed);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+        for (size_t i = 0; i < vt.size; ++i) {
+                vt.entries[i].operator = OPERATOR_UNSET;
+        }
+
+        for (size_t b = b_first; b < b_end; ++b) {
+                value_numbering_block(tac, &vt, &cfg->blocks[b], b, local,
+                                pushed);
+
+                /* Values are not known in other blocks. */
+                while (vt.used_cnt > 0) {
+                        vt.entries[vt.used[--vt.used_cnt]].operator =
+                                OPERATOR_UNSET;
+                }
+        }
+
+        free(vt.entries);
+        free(vt.used);
+        free(vt.var_vn);
+        free(vt.var_block);
+        free(pushed);
+        return 0;
+}
+
+
+/* Liveness of variables. */
+#define WORD_BITS (sizeof (unsigned) * CHAR_BIT)
+
+static int bit_test(const unsigned *set, size_t bit)
+{
+        return (set[bit / WORD_BITS] >> (bit % WORD_BITS)) & 1u;
+}
+
+static void bit_set(unsigned *set, size_t bit)
+{
+        set[bit / WORD_BITS] |= 1u << (bit % WORD_BITS);
+}
+
+static void bit_clear(unsigned *set, size_t bit)
+{
+        set[bit / WORD_BITS] &= ~(1u << (bit % WORD_BITS));
+}
+
+/* Variables live before the instruction from those live after it. */
+static void live_transfer(const struct tac_instruction *instr, unsigned *live,
+                const size_t *local)
+{
+        if (instr->operator == OPERATOR_UNSET) {
+                return;
+        }
+
+        if (instr->res_num != 0) {
+                bit_clear(live, local[instr->res_num]);
+        }
+        if (is_var(&instr->op1)) {
+                bit_set(live, local[instr->op1.value.num]);
+        }
+        if (is_var(&instr->op2)) {
+                bit_set(live, local[instr->op2.value.num]);
+        }
+}
+
+/* Variables live at the end of the block. */
+static void live_out(const struct basic_block *block, const unsigned *live_in,
+                size_t b_first, size_t words, unsigned *live)
+{
+        memset(live, 0, words * sizeof (unsigned));
+        for (unsigned s = 0; s < block->succ_cnt; ++s) {
+                const unsigned *succ_in =
+                        live_in + (block->succ[s] - b_first) * words;
+
+                for (size_t w = 0; w < words; ++w) {
+                        live[w] |= succ_in[w];
+                }
+        }
+}
+
+/* Compute variables live at the entries of the blocks of the function. */
+static void liveness(const struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const size_t *local,
+                size_t words, unsigned *live_in, unsigned *live)
+{
+        int changed = 1;
+
+
+        memset(live_in, 0, (b_end - b_first) * words * sizeof (unsigned));
+        while (changed) {
+                changed = 0;
+                for (size_t b = b_end; b-- > b_first; ) {
+                        const struct basic_block *block = &cfg->blocks[b];
+                        unsigned *in = live_in + (b - b_first) * words;
+
+                        live_out(block, live_in, b_first, words, live);
+                        for (size_t i = block->last + 1; i-- > block->first; ) {
+                                live_transfer(&tac->instructions[i], live,
+                                                local);
+                        }
+                        if (memcmp(in, live, words * sizeof (unsigned))) {
+                                memcpy(in, live, words * sizeof (unsigned));
+                                changed = 1;
+                        }
+                }
+        }
+}
+
+
+/* Dead code elimination. */
+static int remove_dead_function(struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const size_t *local,
+                size_t locals_cnt)
+{
+        const size_t words = locals_cnt / WORD_BITS + 1;
+        unsigned *live_in;
+        unsigned *live;
+        int removed = 1;
+
+
+        live_in = malloc((b_end - b_first) * words * sizeof (unsigned));
+        live = malloc(words * sizeof (unsigned));
+        if (live_in == NULL || live == NULL) {
+                free(live_in);
+                free(live);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        /* Removal may make operands of the removed instructions dead. */
+        while (removed) {
+                liveness(tac, cfg, b_first, b_end, local, words, live_in, live);
+
+                removed = 0;
+                for (size_t b = b_first; b < b_end; ++b) {
+                        const struct basic_block *block = &cfg->blocks[b];
+
+                        live_out(block, live_in, b_first, words, live);
+                        for (size_t i = block->last + 1; i-- > block->first; ) {
+                                struct tac_instruction *instr =
+                                        &tac->instructions[i];
+
+                                if (is_pure(instr) && !bit_test(live,
+                                                        local[instr->res_num])) {
+                                        remove_instruction(instr);
+                                        removed = 1;
+                                } else {
+                                        live_transfer(instr, live, local);
+                                }
+                        }
+                }
+        }
+
+        free(live_in);
+        free(live);
+        return 0;
+}
+
+/* Remove blocks which are not reachable from the entry of their function. */
+static int remove_unreachable(struct tac *tac)
+{
+        struct cfg cfg;
+        char *reached;
+        size_t *stack;
+        size_t top = 0;
+
+
+        if (cfg_build(tac, &cfg) != 0) {
+                return 1;
+        }
+        reached = calloc(cfg.blocks_cnt, sizeof (char));
+        stack = malloc(cfg.blocks_cnt * sizeof (size_t));
+        if (reached == NULL || stack == NULL) {
+                free(reached);
+                free(stack);
+                cfg_free(&cfg);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        for (size_t b = 0; b < cfg.blocks_cnt; ++b) {
+                if (b == 0 ||
+                    starts_function(&tac->instructions[cfg.blocks[b].first])) {
+                        reached[b] = 1;
+                        stack[top++] = b;
+                }
+        }
+        while (top > 0) {
+                const struct basic_block *block = &cfg.blocks[stack[--top]];
+
+                for (unsigned s = 0; s < block->succ_cnt; ++s) {
+                        if (!reached[block->succ[s]]) {
+                                reached[block->succ[s]] = 1;
+                                stack[top++] = block->succ[s];
+                        }
+                }
+        }
+
+        for (size_t b = 0; b < cfg.blocks_cnt; ++b) {
+                if (reached[b]) {
+                        continue;
+                }
+                for (size_t i = cfg.blocks[b].first; i <= cfg.blocks[b].last;
+                     ++i) {
+                        remove_instruction(&tac->instructions[i]);
+                }
+        }
+
+        free(reached);
+        free(stack);
+        cfg_free(&cfg);
+        tac_compact(tac);
+        return 0;
+}
+
+/* Remove jumps to the label which follows them and labels nothing jumps to. */
+static int simplify_jumps(struct tac *tac)
+{
+        size_t labels_cnt = 0;
+        unsigned *refs;
+
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                if (instr->operator == OPERATOR_LABEL &&
+                    instr->op1.value.num >= labels_cnt) {
+                        labels_cnt = instr->op1.value.num + 1;
+                }
+        }
+        refs = calloc(labels_cnt + 1, sizeof (unsigned));
+        if (refs == NULL) {
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                if (instr->operator == OPERATOR_JUMP) {
+                        refs[instr->op1.value.num]++;
+                } else if (instr->operator == OPERATOR_BZERO) {
+                        refs[instr->op2.value.num]++;
+                }
+        }
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                struct tac_instruction *instr = &tac->instructions[i];
+                size_t target;
+
+                if (instr->operator == OPERATOR_JUMP) {
+                        target = instr->op1.value.num;
+                } else if (instr->operator == OPERATOR_BZERO) {
+                        target = instr->op2.value.num;
+                } else {
+                        continue;
+                }
+
+                for (size_t j = i + 1; j < tac->instructions_cnt &&
+                     tac->instructions[j].operator == OPERATOR_LABEL &&
+                     !starts_function(&tac->instructions[j]); ++j) {
+                        if (tac->instructions[j].op1.value.num == target) {
+                                instr->operator = OPERATOR_UNSET;
+                                refs[target]--;
+                                break;
+                        }
+                }
+        }
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                struct tac_instruction *instr = &tac->instructions[i];
+
+                if (instr->operator == OPERATOR_LABEL &&
+                    !starts_function(instr) &&
+                    refs[instr->op1.value.num] == 0) {
+                        instr->operator = OPERATOR_UNSET;
+                }
+        }
+
+        free(refs);
+        tac_compact(tac);
+        return 0;
+}
+
+/* Instructions to be inserted before or after an instruction. */
+struct insertion {
+        size_t pos; //index of the instruction
+        int after;
+        struct tac_instruction instr;
+};
+
+struct insertions {
+        struct insertion *list;
+        size_t cnt;
+        size_t size;
+};
+
+static int insertion_add(struct insertions *ins, size_t pos, int after,
+                struct tac_instruction instr)
+{
+        if (ins->cnt == ins->size) {
+                const size_t new_size = (ins->size == 0) ? 16 : ins->size * 2;
+                struct insertion *new_list = realloc(ins->list,
+                                new_size * sizeof (struct insertion));
+
+                if (new_list == NULL) {
+                        set_error(RET_INTERNAL, __func__, "memory exhausted");
+                        return 1;
+                }
+                ins->list = new_list;
+                ins->size = new_size;
+        }
+
+        ins->list[ins->cnt].pos = pos;
+        ins->list[ins->cnt].after = after;
+        ins->list[ins->cnt++].instr = instr;
+        return 0;
+}
+
+static int tac_insert(struct tac *tac, struct insertions *ins)
+{
+        const size_t cnt = tac->instructions_cnt + ins->cnt;
+        struct tac_instruction *instructions;
+        size_t n = 0;
+        size_t k = 0;
+
+
+        if (ins->cnt == 0) {
+                return 0;
+        }
+        instructions = malloc(cnt * sizeof (struct tac_instruction));
+        if (instructions == NULL) {
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        /* Stable, the list is already ordered by addition. */
+        for (size_t i = 1; i < ins->cnt; ++i) {
+                struct insertion x = ins->list[i];
+                size_t j = i;
+
+                while (j > 0 && (ins->list[j - 1].pos > x.pos ||
+                                        (ins->list[j - 1].pos == x.pos &&
+                                         ins->list[j - 1].after > x.after))) {
+                        ins->list[j] = ins->list[j - 1];
+                        j--;
+                }
+                ins->list[j] = x;
+        }
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                while (k < ins->cnt && ins->list[k].pos == i &&
+                       !ins->list[k].after) {
+                        instructions[n++] = ins->list[k++].instr;
+                }
+                instructions[n++] = tac->instructions[i];
+                while (k < ins->cnt && ins->list[k].pos == i) {
+                        instructions[n++] = ins->list[k++].instr;
+                }
+        }
+
+        free(tac->instructions);
+        tac->instructions = instructions;
+        tac->instructions_cnt = tac->size = cnt;
+        return 0;
+}
+
+
+/* Loop invariant code motion. */
+static void dominators(const struct cfg *cfg, size_t b_first, size_t b_end,
+                size_t words, unsigned *dom)
+{
+        int changed = 1;
+
+
+        memset(dom, 0xFF, (b_end - b_first) * words * sizeof (unsigned));
+        memset(dom, 0, words * sizeof (unsigned));
+        bit_set(dom, 0); //entry is dominated only by itself
+
+        while (changed) {
+                changed = 0;
+                for (size_t b = b_first + 1; b < b_end; ++b) {
+                        const struct basic_block *block = &cfg->blocks[b];
+                        unsigned *d = dom + (b - b_first) * words;
+
+                        for (size_t w = 0; w < words; ++w) {
+                                unsigned new = block->pred_cnt ? ~0u : 0;
+
+                                for (unsigned p = 0; p < block->pred_cnt; ++p) {
+                                        new &= dom[(block->pred[p] - b_first) *
+                                                words + w];
+                                }
+                                if (w == (b - b_first) / WORD_BITS) {
+                                        new |= 1u << ((b - b_first) % WORD_BITS);
+                                }
+                                if (new != d[w]) {
+                                        d[w] = new;
+                                        changed = 1;
+                                }
+                        }
+                }
+        }
+}
+
+/* Blocks of the natural loops of all back edges to the header. */
+static int loop_body(const struct cfg *cfg, size_t b_first, size_t header,
+                size_t words, const unsigned *dom, unsigned *body,
+                size_t *stack)
+{
+        const struct basic_block *h = &cfg->blocks[header];
+        size_t top = 0;
+
+
+        memset(body, 0, words * sizeof (unsigned));
+        bit_set(body, header - b_first);
+        for (unsigned p = 0; p < h->pred_cnt; ++p) {
+                const size_t b = h->pred[p];
+
+                if (bit_test(dom + (b - b_first) * words, header - b_first) &&
+                    !bit_test(body, b - b_first)) {
+                        bit_set(body, b - b_first); //back edge
+                        stack[top++] = b;
+                }
+        }
+        if (top == 0) {
+                return 0; //not a loop header
+        }
+
+        while (top > 0) {
+                const struct basic_block *block = &cfg->blocks[stack[--top]];
+
+                for (unsigned p = 0; p < block->pred_cnt; ++p) {
+                        if (!bit_test(body, block->pred[p] - b_first)) {
+                                bit_set(body, block->pred[p] - b_first);
+                                stack[top++] = block->pred[p];
+                        }
+                }
+        }
+
+        return 1;
+}
+
+/* Loop is entered only by falling through from the previous block, so the
+ * hoisted instructions can be placed right before the header. */
+static int has_preheader(const struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t header, const unsigned *body)
+{
+        const struct basic_block *h = &cfg->blocks[header];
+
+
+        if (header == b_first ||
+            tac->instructions[h->first].operator != OPERATOR_LABEL) {
+                return 0;
+        }
+
+        for (unsigned p = 0; p < h->pred_cnt; ++p) {
+                const struct tac_instruction *last;
+
+                if (bit_test(body, h->pred[p] - b_first)) {
+                        continue;
+                } else if (h->pred[p] != header - 1) {
+                        return 0;
+                }
+
+                last = &tac->instructions[cfg->blocks[h->pred[p]].last];
+                if (last->operator == OPERATOR_JUMP ||
+                    (last->operator == OPERATOR_BZERO &&
+                     last->op2.value.num ==
+                     tac->instructions[h->first].op1.value.num)) {
+                        return 0;
+                }
+        }
+
+        return 1;
+}
+
+static int may_hoist(const struct tac_instruction *instr)
+{
+        if (!is_pure(instr) ||
+            instr->operator == OPERATOR_CAST_CHAR_TO_STRING) {
+                return 0; //new string on every evaluation
+        } else if (instr->operator == OPERATOR_ASSIGN) {
+                return instr->op1.type == OPERAND_TYPE_VARIABLE ||
+                        instr->data_type == DATA_TYPE_STRING;
+        } else if (instr->operator == OPERATOR_DIV ||
+                   instr->operator == OPERATOR_MOD) {
+                return instr->op2.type == OPERAND_TYPE_LITERAL &&
+                        instr->op2.value.int_val != 0 &&
+                        instr->op2.value.int_val != -1;
+        }
+
+        return 1;
+}
+
+struct loop {
+        size_t header;
+        const unsigned *body;
+        const unsigned *dom;
+        const unsigned *live_in;
+        size_t bwords; //words of block sets
+        size_t vwords; //words of variable sets
+        const size_t *def_cnt; //definitions of variables in the loop
+        const size_t *def_at; //the definition if there is only one
+        size_t new_vars; //variables from here on were added by reduction
+};
+
+/* Variables added by strength reduction of an outer loop are defined only
+ * outside of the inner loops, they have no local index. */
+static int loop_var(const struct tac_operand *op, const struct loop *loop)
+{
+        return is_var(op) && op->value.num < loop->new_vars;
+}
+
+static int operand_invariant(const struct tac_operand *op,
+                const struct loop *loop, const size_t *local,
+                const size_t *hoist)
+{
+        if (!loop_var(op, loop)) {
+                return 1;
+        }
+
+        return loop->def_cnt[local[op->value.num]] == 0 ||
+                (loop->def_cnt[local[op->value.num]] == 1 &&
+                 hoist[loop->def_at[local[op->value.num]]] != 0);
+}
+
+/* Result of the instruction in block b may be computed before the loop. */
+static int result_invariant(const struct cfg *cfg, size_t b_first,
+                size_t b_end, size_t b, size_t res, const struct loop *loop)
+{
+        if (loop->def_cnt[res] != 1 || bit_test(loop->live_in +
+                                (loop->header - b_first) * loop->vwords, res)) {
+                return 0;
+        }
+
+        /* The old value must not be needed after leaving the loop. */
+        for (size_t e = b_first; e < b_end; ++e) {
+                const struct basic_block *block = &cfg->blocks[e];
+
+                if (!bit_test(loop->body, e - b_first)) {
+                        continue;
+                }
+                for (unsigned s = 0; s < block->succ_cnt; ++s) {
+                        const size_t succ = block->succ[s];
+
+                        if (!bit_test(loop->body, succ - b_first) &&
+                            !bit_test(loop->dom + (e - b_first) * loop->bwords,
+                                    b - b_first) &&
+                            bit_test(loop->live_in + (succ - b_first) *
+                                    loop->vwords, res)) {
+                                return 0;
+                        }
+                }
+        }
+
+        return 1;
+}
+
+static int find_invariants(const struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const struct loop *loop,
+                const size_t *local, size_t *hoist, struct insertions *ins)
+{
+        int changed = 1;
+
+
+        /* Instructions are hoisted in the order of their dependencies. */
+        while (changed) {
+                changed = 0;
+                for (size_t b = b_first; b < b_end; ++b) {
+                        if (!bit_test(loop->body, b - b_first)) {
+                                continue;
+                        }
+                        for (size_t i = cfg->blocks[b].first;
+                             i <= cfg->blocks[b].last; ++i) {
+                                const struct tac_instruction *instr =
+                                        &tac->instructions[i];
+
+                                if (hoist[i] == 0 && may_hoist(instr) &&
+                                    operand_invariant(&instr->op1, loop, local,
+                                            hoist) &&
+                                    operand_invariant(&instr->op2, loop, local,
+                                            hoist) &&
+                                    result_invariant(cfg, b_first, b_end, b,
+                                            local[instr->res_num], loop)) {
+                                        hoist[i] = loop->header + 1;
+                                        changed = 1;
+                                        if (insertion_add(ins, cfg->blocks[
+                                                        loop->header].first, 0,
+                                                        *instr) != 0) {
+                                                return 1;
+                                        }
+                                }
+                        }
+                }
+        }
+
+        return 0;
+}
+
+/* Step of the basic induction variable incremented by the instruction. */
+static int induction_step(const struct tac_instruction *instr, int *step)
+{
+        const struct tac_operand *op1 = &instr->op1;
+        const struct tac_operand *op2 = &instr->op2;
+
+
+        if (instr->data_type != DATA_TYPE_INT) {
+                return 0;
+        } else if (instr->operator == OPERATOR_ADD && is_var(op1) &&
+                   op1->value.num == instr->res_num &&
+                   op2->type == OPERAND_TYPE_LITERAL) {
+                *step = op2->value.int_val;
+                return 1;
+        } else if (instr->operator == OPERATOR_ADD && is_var(op2) &&
+                   op2->value.num == instr->res_num &&
+                   op1->type == OPERAND_TYPE_LITERAL) {
+                *step = op1->value.int_val;
+                return 1;
+        } else if (instr->operator == OPERATOR_SUB && is_var(op1) &&
+                   op1->value.num == instr->res_num &&
+                   op2->type == OPERAND_TYPE_LITERAL) {
+                *step = (int)(0u - (unsigned)op2->value.int_val);
+                return 1;
+        }
+
+        return 0;
+}
+
+/* Replace multiplications of a basic induction variable by a literal with a
+ * new variable, which is incremented together with the induction variable. */
+static int reduce_strength(struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const struct loop *loop,
+                const size_t *local, const size_t *hoist,
+                struct insertions *ins, size_t *vars_cnt)
+{
+        for (size_t b = b_first; b < b_end; ++b) {
+                if (!bit_test(loop->body, b - b_first)) {
+                        continue;
+                }
+                for (size_t i = cfg->blocks[b].first; i <= cfg->blocks[b].last;
+                     ++i) {
+                        struct tac_instruction *instr = &tac->instructions[i];
+                        struct tac_instruction init, update, delta;
+                        const struct tac_operand *iv, *factor;
+                        size_t l;
+                        int step;
+
+                        if (hoist[i] != 0 ||
+                            instr->operator != OPERATOR_MUL ||
+                            instr->data_type != DATA_TYPE_INT) {
+                                continue;
+                        } else if (loop_var(&instr->op1, loop) &&
+                                   loop->def_cnt[local[instr->op1.value.num]]
+                                   == 1 && operand_invariant(&instr->op2,
+                                           loop, local, hoist)) {
+                                iv = &instr->op1;
+                                factor = &instr->op2;
+                        } else if (loop_var(&instr->op2, loop) &&
+                                   loop->def_cnt[local[instr->op2.value.num]]
+                                   == 1 && operand_invariant(&instr->op1,
+                                           loop, local, hoist)) {
+                                iv = &instr->op2;
+                                factor = &instr->op1;
+                        } else {
+                                continue;
+                        }
+
+                        l = local[iv->value.num];
+                        if (iv->value.num == instr->res_num ||
+                            !induction_step(&tac->instructions[loop->def_at[l]],
+                                    &step)) {
+                                continue;
+                        }
+
+                        /* New = iv * factor before the loop. */
+                        memset(&init, 0, sizeof (struct tac_instruction));
+                        init.data_type = DATA_TYPE_INT;
+                        init.res_num = (*vars_cnt)++;
+                        init.operator = OPERATOR_MUL;
+                        init.op1 = *iv;
+                        init.op2 = *factor;
+
+                        /* New = new + step * factor after the increment. */
+                        memset(&update, 0, sizeof (struct tac_instruction));
+                        update.data_type = DATA_TYPE_INT;
+                        update.res_num = init.res_num;
+                        update.operator = OPERATOR_ADD;
+                        update.op1.type = OPERAND_TYPE_VARIABLE;
+                        update.op1.value.num = init.res_num;
+                        if (factor->type == OPERAND_TYPE_LITERAL) {
+                                update.op2.type = OPERAND_TYPE_LITERAL;
+                                update.op2.value.int_val = (int)((unsigned)step
+                                                * (unsigned)factor->value.int_val);
+                        } else {
+                                /* Invariant factor, compute the step once. */
+                                memset(&delta, 0,
+                                                sizeof (struct tac_instruction));
+                                delta.data_type = DATA_TYPE_INT;
+                                delta.res_num = (*vars_cnt)++;
+                                delta.operator = OPERATOR_MUL;
+                                delta.op1 = *factor;
+                                delta.op2.type = OPERAND_TYPE_LITERAL;
+                                delta.op2.value.int_val = step;
+                                if (insertion_add(ins,
+                                            cfg->blocks[loop->header].first, 0,
+                                            delta) != 0) {
+                                        return 1;
+                                }
+                                update.op2.type = OPERAND_TYPE_VARIABLE;
+                                update.op2.value.num = delta.res_num;
+                        }
+
+                        if (insertion_add(ins, cfg->blocks[loop->header].first,
+                                                0, init) != 0 ||
+                            insertion_add(ins, loop->def_at[l], 1,
+                                    update) != 0) {
+                                return 1;
+                        }
+
+                        instr->operator = OPERATOR_ASSIGN;
+                        instr->op1 = update.op1;
+                        instr->op2.type = OPERAND_TYPE_UNUSED;
+                }
+        }
+
+        return 0;
+}
+
+static int optimize_loops_function(struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const size_t *local,
+                size_t locals_cnt, size_t *hoist, struct insertions *ins,
+                size_t *vars_cnt)
+{
+        const size_t blocks_cnt = b_end - b_first;
+        struct loop loop;
+        unsigned *dom, *live_in, *live, *body;
+        size_t *def_cnt, *def_at, *stack;
+        int ret = 0;
+
+
+        loop.bwords = blocks_cnt / WORD_BITS + 1;
+        loop.vwords = locals_cnt / WORD_BITS + 1;
+        dom = malloc(blocks_cnt * loop.bwords * sizeof (unsigned));
+        live_in = malloc(blocks_cnt * loop.vwords * sizeof (unsigned));
+        live = malloc(loop.vwords * sizeof (unsigned));
+        body = malloc(loop.bwords * sizeof (unsigned));
+        def_cnt = malloc(locals_cnt * sizeof (size_t));
+        def_at = malloc(locals_cnt * sizeof (size_t));
+        stack = malloc(blocks_cnt * sizeof (size_t));
+        if (dom == NULL || live_in == NULL || live == NULL || body == NULL ||
+            def_cnt == NULL || def_at == NULL || stack == NULL) {
+                free(dom);
+                free(live_in);
+                free(live);
+                free(body);
+                free(def_cnt);
+                free(def_at);
+                free(stack);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        dominators(cfg, b_first, b_end, loop.bwords, dom);
+        liveness(tac, cfg, b_first, b_end, local, loop.vwords, live_in, live);
+        loop.body = body;
+        loop.dom = dom;
+        loop.live_in = live_in;
+        loop.def_cnt = def_cnt;
+        loop.def_at = def_at;
+        loop.new_vars = *vars_cnt;
+
+        /* Outer loops come first, they take everything invariant in them. */
+        for (size_t h = b_first + 1; ret == 0 && h < b_end; ++h) {
+                if (!loop_body(cfg, b_first, h, loop.bwords, dom, body,
+                                        stack) ||
+                    !has_preheader(tac, cfg, b_first, h, body)) {
+                        continue;
+                }
+                loop.header = h;
+
+                memset(def_cnt, 0, locals_cnt * sizeof (size_t));
+                for (size_t b = b_first; b < b_end; ++b) {
+                        if (!bit_test(body, b - b_first)) {
+                                continue;
+                        }
+                        for (size_t i = cfg->blocks[b].first;
+                             i <= cfg->blocks[b].last; ++i) {
+                                const size_t res =
+                                        local[tac->instructions[i].res_num];
+
+                                if (res != 0 && hoist[i] == 0) {
+                                        def_cnt[res]++;
+                                        def_at[res] = i;
+                                }
+                        }
+                }
+
+                ret = find_invariants(tac, cfg, b_first, b_end, &loop, local,
+                                hoist, ins);
+                if (ret == 0) {
+                        ret = reduce_strength(tac, cfg, b_first, b_end, &loop,
+                                        local, hoist, ins, vars_cnt);
+                }
+        }
+
+        free(dom);
+        free(live_in);
+        free(live);
+        free(body);
+        free(def_cnt);
+        free(def_at);
+        free(stack);
+        return ret;
+}
+
+/* Move instructions invariant in a loop right before its header and reduce
+ * the strength of multiplications by induction variables. */
+static int optimize_loops(struct tac *tac)
+{
+        struct cfg cfg;
+        const size_t old_vars_cnt = count_vars(tac);
+        size_t vars_cnt = old_vars_cnt; //new variables are numbered from here
+        size_t *local = calloc(old_vars_cnt, sizeof (size_t));
+        size_t *var = malloc(old_vars_cnt * sizeof (size_t));
+        size_t *hoist = calloc(tac->instructions_cnt, sizeof (size_t));
+        struct insertions ins = { NULL, 0, 0 };
+        int ret = 0;
+
+
+        if (local == NULL || var == NULL || hoist == NULL) {
+                free(local);
+                free(var);
+                free(hoist);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+        if (cfg_build(tac, &cfg) != 0) {
+                free(local);
+                free(var);
+                free(hoist);
+                return 1;
+        }
+
+        for (size_t b_first = 0; ret == 0 && b_first < cfg.blocks_cnt; ) {
+                const size_t b_end = function_end(tac, &cfg, b_first);
+                const size_t locals_cnt = index_locals(tac,
+                                cfg.blocks[b_first].first,
+                                cfg.blocks[b_end - 1].last, local, var);
+
+                ret = optimize_loops_function(tac, &cfg, b_first, b_end, local,
+                                locals_cnt, hoist, &ins, &vars_cnt);
+                for (size_t l = 1; l < locals_cnt; ++l) {
+                        local[var[l]] = 0;
+                }
+                b_first = b_end;
+        }
+
+        /* Hoisted instructions were copied to the insertions. */
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                if (hoist[i] != 0) {
+                        tac->instructions[i].operator = OPERATOR_UNSET;
+                }
+        }
+        if (ret == 0) {
+                ret = tac_insert(tac, &ins);
+        }
+        tac_compact(tac);
+
+        free(ins.list);
+        cfg_free(&cfg);
+        free(local);
+        free(var);
+        free(hoist);
+        return ret;
+}
+
+
+/* Unrolling of loops with a known trip count. */
+#define UNROLL_MAX_SIZE 256 //instructions added by unrolling of one loop
+
+struct counted_loop {
+        size_t label; //index of the header label
+        size_t jump; //index of the jump back to the header
+        unsigned trips; //iterations of the loop
+        unsigned copies; //copies of the body in the unrolled loop
+        unsigned peeled; //copies of the body before the loop
+};
+
+/* Iterations of while (i rel n), 0 if unknown or if the loop never ends. */
+static unsigned trip_count(operator_t rel, long long i, long long n,
+                long long step)
+{
+        long long trips;
+
+
+        if (rel == OPERATOR_SLET) {
+                rel = OPERATOR_SLT;
+                n++;
+        } else if (rel == OPERATOR_SGET) {
+                rel = OPERATOR_SGT;
+                n--;
+        }
+
+        if (rel == OPERATOR_SLT && step > 0 && i < n) {
+                trips = (n - i + step - 1) / step;
+        } else if (rel == OPERATOR_SGT && step < 0 && i > n) {
+                trips = (i - n - step - 1) / -step;
+        } else if (rel == OPERATOR_SNE && step != 0 && (n - i) % step == 0 &&
+                   (n - i) / step > 0) {
+                trips = (n - i) / step;
+        } else {
+                return 0;
+        }
+
+        /* The induction variable must not overflow. */
+        if (i + trips * step > INT_MAX || i + trips * step < INT_MIN ||
+            trips > UINT_MAX) {
+                return 0;
+        }
+        return trips;
+}
+
+/* Relation with swapped operands. */
+static operator_t swap_relation(operator_t rel)
+{
+        switch (rel) {
+        case OPERATOR_SLT:
+                return OPERATOR_SGT;
+        case OPERATOR_SLET:
+                return OPERATOR_SGET;
+        case OPERATOR_SGT:
+                return OPERATOR_SLT;
+        case OPERATOR_SGET:
+                return OPERATOR_SLET;
+        default:
+                return rel;
+        }
+}
+
+/* Loop "LABEL h; t = i rel n; BZERO t, e; body; JUMP h; LABEL e" where the
+ * body increments i once in every iteration and n is a literal. */
+static int counted_loop(const struct tac *tac, size_t jump,
+                const unsigned *label_refs, const size_t *label_at,
+                const unsigned *reads, struct counted_loop *loop)
+{
+        const struct tac_instruction *cond, *branch;
+        const struct tac_operand *var, *limit;
+        operator_t rel;
+        unsigned body_refs = 0;
+        unsigned body_jumps = 0;
+        size_t increment = 0;
+        size_t last_target = 0; //last label jumped to before the increment
+        int step = 0;
+        int init = 0;
+
+
+        loop->label = label_at[tac->instructions[jump].op1.value.num];
+        loop->jump = jump;
+        if (loop->label >= jump || loop->label + 3 > jump ||
+            jump + 1 >= tac->instructions_cnt ||
+            label_refs[tac->instructions[jump].op1.value.num] != 1) {
+                return 0;
+        }
+
+        /* Header. */
+        cond = &tac->instructions[loop->label + 1];
+        branch = &tac->instructions[loop->label + 2];
+        if (cond->operator < OPERATOR_SNE || cond->operator > OPERATOR_SGET ||
+            cond->data_type != DATA_TYPE_INT ||
+            branch->operator != OPERATOR_BZERO || !is_var(&branch->op1) ||
+            branch->op1.value.num != cond->res_num ||
+            reads[cond->res_num] != 1 ||
+            tac->instructions[jump + 1].operator != OPERATOR_LABEL ||
+            tac->instructions[jump + 1].op1.value.num !=
+            branch->op2.value.num) {
+                return 0;
+        }
+        if (is_var(&cond->op1) && cond->op2.type == OPERAND_TYPE_LITERAL) {
+                rel = cond->operator;
+                var = &cond->op1;
+                limit = &cond->op2;
+        } else if (is_var(&cond->op2) &&
+                   cond->op1.type == OPERAND_TYPE_LITERAL) {
+                rel = swap_relation(cond->operator);
+                var = &cond->op2;
+                limit = &cond->op1;
+        } else {
+                return 0;
+        }
+
+        /* Body may only branch forward within itself. */
+        for (size_t p = loop->label + 3; p < jump; ++p) {
+                const struct tac_instruction *instr = &tac->instructions[p];
+                size_t target;
+
+                if (instr->operator == OPERATOR_LABEL) {
+                        body_refs += label_refs[instr->op1.value.num];
+                        continue;
+                } else if (instr->operator == OPERATOR_JUMP ||
+                           instr->operator == OPERATOR_BZERO) {
+                        target = label_at[(instr->operator == OPERATOR_JUMP) ?
+                                instr->op1.value.num : instr->op2.value.num];
+                        if (target <= p || target >= jump) {
+                                return 0;
+                        }
+                        body_jumps++;
+                        if (increment == 0 && target > last_target) {
+                                last_target = target;
+                        }
+                } else if (instr->operator == OPERATOR_POP) {
+                        return 0;
+                }
+
+                if (instr->res_num == var->value.num) {
+                        if (increment != 0 || last_target > p ||
+                            !induction_step(instr, &step)) {
+                                return 0; //not once in every iteration
+                        }
+                        increment = p;
+                }
+        }
+        if (increment == 0 || body_refs != body_jumps) {
+                return 0;
+        }
+
+        /* Initial value is assigned in the block before the loop. */
+        for (size_t p = loop->label; ; --p) {
+                const struct tac_instruction *instr;
+
+                if (p == 0) {
+                        return 0;
+                }
+                instr = &tac->instructions[p - 1];
+                if (instr->operator == OPERATOR_LABEL || ends_block(instr)) {
+                        return 0;
+                } else if (instr->res_num == var->value.num) {
+                        if (instr->operator != OPERATOR_ASSIGN ||
+                            instr->op1.type != OPERAND_TYPE_LITERAL) {
+                                return 0;
+                        }
+                        init = instr->op1.value.int_val;
+                        break;
+                }
+        }
+
+        loop->trips = trip_count(rel, init, limit->value.int_val, step);
+        return loop->trips != 0;
+}
+
+/* Copy the instructions, string literals are duplicated. Labels defined by
+ * them are renamed unless next_label is NULL. */
+static int copy_instructions(const struct tac_instruction *src, size_t cnt,
+                struct tac_instruction *dst, unsigned *next_label,
+                unsigned *label_map)
+{
+        size_t labels_cnt = 0;
+
+
+        for (size_t i = 0; next_label != NULL && i < cnt; ++i) {
+                if (src[i].operator == OPERATOR_LABEL) {
+                        label_map[2 * labels_cnt] = src[i].op1.value.num;
+                        label_map[2 * labels_cnt++ + 1] = (*next_label)++;
+                }
+        }
+
+        for (size_t i = 0; i < cnt; ++i) {
+                struct tac_operand *label = NULL;
+
+                dst[i] = src[i];
+                if (dst[i].data_type == DATA_TYPE_STRING &&
+                    dst[i].op1.type == OPERAND_TYPE_LITERAL) {
+                        dst[i].op1.value.string_val =
+                                strdup(src[i].op1.value.string_val);
+                        if (dst[i].op1.value.string_val == NULL) {
+                                dst[i].op1.type = OPERAND_TYPE_UNUSED;
+                                set_error(RET_INTERNAL, __func__,
+                                                "memory exhausted");
+                                return 1;
+                        }
+                }
+
+                if (dst[i].operator == OPERATOR_LABEL ||
+                    dst[i].operator == OPERATOR_JUMP) {
+                        label = &dst[i].op1;
+                } else if (dst[i].operator == OPERATOR_BZERO) {
+                        label = &dst[i].op2;
+                }
+                for (size_t l = 0; label != NULL && l < labels_cnt; ++l) {
+                        if (label->value.num == label_map[2 * l]) {
+                                label->value.num = label_map[2 * l + 1];
+                                break;
+                        }
+                }
+        }
+
+        return 0;
+}
+
+static int unroll_loops(struct tac *tac, unsigned factor)
+{
+        const size_t vars_cnt = count_vars(tac);
+        size_t labels_cnt = 0;
+        unsigned *label_refs = NULL;
+        size_t *label_at = NULL;
+        unsigned *reads = NULL;
+        unsigned *label_map = NULL;
+        struct counted_loop *loops = NULL;
+        size_t loops_cnt = 0;
+        struct tac_instruction *instructions = NULL;
+        size_t cnt = tac->instructions_cnt;
+        size_t n = 0;
+        unsigned next_label;
+
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                if (instr->operator == OPERATOR_LABEL &&
+                    instr->op1.value.num >= labels_cnt) {
+                        labels_cnt = instr->op1.value.num + 1;
+                }
+        }
+        next_label = labels_cnt;
+
+        label_refs = calloc(labels_cnt, sizeof (unsigned));
+        label_at = malloc(labels_cnt * sizeof (size_t));
+        reads = calloc(vars_cnt, sizeof (unsigned));
+        loops = malloc(tac->instructions_cnt * sizeof (struct counted_loop));
+        label_map = malloc(2 * UNROLL_MAX_SIZE * sizeof (unsigned));
+        if (label_refs == NULL || label_at == NULL || reads == NULL ||
+            loops == NULL || label_map == NULL) {
+                goto memory_exhausted;
+        }
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                if (instr->operator == OPERATOR_LABEL) {
+                        label_at[instr->op1.value.num] = i;
+                } else if (instr->operator == OPERATOR_JUMP) {
+                        label_refs[instr->op1.value.num]++;
+                } else if (instr->operator == OPERATOR_BZERO) {
+                        label_refs[instr->op2.value.num]++;
+                }
+                if (is_var(&instr->op1)) {
+                        reads[instr->op1.value.num]++;
+                }
+                if (is_var(&instr->op2)) {
+                        reads[instr->op2.value.num]++;
+                }
+        }
+
+        /* Innermost loops only, their bodies branch only forward. */
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                struct counted_loop *loop = &loops[loops_cnt];
+                size_t body_cnt;
+
+                if (tac->instructions[i].operator != OPERATOR_JUMP ||
+                    !counted_loop(tac, i, label_refs, label_at, reads, loop)) {
+                        continue;
+                }
+
+                body_cnt = i - loop->label - 3;
+                if (loop->trips <= factor) {
+                        loop->copies = loop->trips; //no loop is left
+                        loop->peeled = 0;
+                } else {
+                        loop->copies = factor;
+                        loop->peeled = loop->trips % factor;
+                }
+                if (body_cnt * (loop->copies + loop->peeled) >
+                    UNROLL_MAX_SIZE) {
+                        continue;
+                }
+
+                cnt += body_cnt * (loop->copies + loop->peeled - 1);
+                if (loop->trips <= factor) {
+                        cnt -= 4; //header and the jump back
+                }
+                loops_cnt++;
+        }
+        if (loops_cnt == 0) {
+                goto cleanup;
+        }
+
+        /* The new code owns copies of all strings, the old one is freed. */
+        instructions = calloc(cnt, sizeof (struct tac_instruction));
+        if (instructions == NULL) {
+                goto memory_exhausted;
+        }
+        for (size_t i = 0, l = 0; i < tac->instructions_cnt; ++i) {
+                const struct counted_loop *loop = &loops[l];
+                const struct tac_instruction *body;
+                size_t body_cnt;
+
+                if (l == loops_cnt || i != loop->label) {
+                        if (copy_instructions(&tac->instructions[i], 1,
+                                                instructions + n++, NULL,
+                                                NULL) != 0) {
+                                goto copy_failed;
+                        }
+                        continue;
+                }
+                body = &tac->instructions[loop->label + 3];
+                body_cnt = loop->jump - loop->label - 3;
+
+                /* Remaining iterations are a multiple of the copies. */
+                for (unsigned c = 0; c < loop->peeled; ++c) {
+                        if (copy_instructions(body, body_cnt, instructions + n,
+                                                &next_label, label_map) != 0) {
+                                goto copy_failed;
+                        }
+                        n += body_cnt;
+                }
+                if (loop->copies < loop->trips) { //header stays
+                        if (copy_instructions(&tac->instructions[loop->label],
+                                                3, instructions + n, NULL,
+                                                NULL) != 0) {
+                                goto copy_failed;
+                        }
+                        n += 3;
+                }
+                for (unsigned c = 0; c < loop->copies; ++c) {
+                        if (copy_instructions(body, body_cnt, instructions + n,
+                                                (c == 0) ? NULL : &next_label,
+                                                label_map) != 0) {
+                                goto copy_failed;
+                        }
+                        n += body_cnt;
+                }
+                if (loop->copies < loop->trips) {
+                        instructions[n++] = tac->instructions[loop->jump];
+                }
+
+                i = loop->jump;
+                l++;
+        }
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                remove_instruction(&tac->instructions[i]);
+        }
+        free(tac->instructions);
+        tac->instructions = instructions;
+        tac->instructions_cnt = tac->size = cnt;
+
+cleanup:
+        free(label_refs);
+        free(label_at);
+        free(reads);
+        free(loops);
+        free(label_map);
+        return 0;
+
+copy_failed:
+        for (size_t i = 0; i < cnt; ++i) {
+                remove_instruction(&instructions[i]);
+        }
+        free(instructions);
+        goto failed;
+
+memory_exhausted:
+        set_error(RET_INTERNAL, __func__, "memory exhausted");
+failed:
+        free(label_refs);
+        free(label_at);
+        free(reads);
+        free(loops);
+        free(label_map);
+        return 1;
+}
+
+
+/* Inlining of small functions. */
+#define INLINE_ONCE_FACTOR 4 //size limit of functions called once, x threshold
+#define INLINE_GROWTH_FACTOR 16 //growth limit of small callers, x threshold
+
+extern const struct function builtins[]; //builtin functions
+extern const size_t builtins_cnt;
+
+struct function_info {
+        int defined; //label starts a function
+        size_t first; //index of the label
+        size_t params; //number of pops after the label
+        size_t size; //instructions of the body
+        size_t calls; //call sites
+        int leaf; //calls builtin functions only
+        int inlined; //calls may be replaced by the body
+        size_t growth; //instructions added to the function by inlining
+};
+
+static const struct function * builtin(unsigned label)
+{
+        for (size_t i = 0; i < builtins_cnt; ++i) {
+                if (builtins[i].tac_num == label) {
+                        return &builtins[i];
+                }
+        }
+
+        return NULL;
+}
+
+/* Number of pushes consumed by a call of the function, except print. */
+static size_t call_params(const struct function_info *fn, unsigned label)
+{
+        return (builtin(label) != NULL) ? builtin(label)->params_cnt :
+                fn[label].params;
+}
+
+/* Number of pushes consumed by the call, print records its own count. The
+ * function infos may be NULL for builtins. */
+static size_t call_args(const struct function_info *fn,
+                const struct tac_instruction *call)
+{
+        if (call->op1.value.num == PRINT_LABEL) {
+                return call->op2.value.int_val;
+        }
+        return call_params(fn, call->op1.value.num);
+}
+
+/* Number of function infos, they are kept also for the called builtins. */
+static size_t count_labels(const struct tac *tac)
+{
+        size_t labels_cnt = 0;
+
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                if ((instr->operator == OPERATOR_LABEL ||
+                     instr->operator == OPERATOR_CALL) &&
+                    instr->op1.value.num >= labels_cnt) {
+                        labels_cnt = instr->op1.value.num + 1;
+                }
+        }
+
+        return labels_cnt;
+}
+
+/* Gather the functions and count calls of each of them. */
+static void function_infos(const struct tac *tac, struct function_info *fn)
+{
+        struct function_info *curr = NULL;
+
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+
+                if (starts_function(instr)) {
+                        curr = &fn[instr->op1.value.num];
+                        curr->defined = 1;
+                        curr->first = i;
+                        curr->leaf = 1;
+                        continue;
+                } else if (curr == NULL) {
+                        continue;
+                }
+
+                if (instr->operator == OPERATOR_POP) {
+                        curr->params++;
+                } else {
+                        curr->size++;
+                }
+                if (instr->operator == OPERATOR_CALL) {
+                        fn[instr->op1.value.num].calls++;
+                        if (builtin(instr->op1.value.num) == NULL) {
+                                curr->leaf = 0;
+                        }
+                }
+        }
+}
+
+/* Variable of the inlined copy standing for the variable of the callee. */
+static unsigned copy_var(size_t *var_map, size_t *next_var, unsigned var)
+{
+        if (var_map[var] == 0) {
+                var_map[var] = (*next_var)++;
+        }
+
+        return var_map[var];
+}
+
+/* Replace the call by the body of the function. Pushes of the arguments
+ * become assignments to the copies of the parameters, returns become
+ * assignments to the result of the call and jumps behind the body. The
+ * body is appended at index n of dst, the new count is returned. */
+static size_t expand_call(const struct tac_instruction *call,
+                const struct function_info *callee,
+                struct tac_instruction *body, struct tac_instruction *dst,
+                size_t n, const size_t *pushes, size_t *var_map,
+                size_t *next_var, unsigned end_label)
+{
+        const size_t cnt = callee->params + callee->size;
+
+
+        /* Every copy gets its own variables. */
+        for (size_t i = 0; i < cnt; ++i) {
+                struct tac_instruction *instr = &body[i];
+
+                if (instr->res_num != 0) {
+                        instr->res_num = copy_var(var_map, next_var,
+                                        instr->res_num);
+                }
+                if (is_var(&instr->op1)) {
+                        instr->op1.value.num = copy_var(var_map, next_var,
+                                        instr->op1.value.num);
+                }
+                if (is_var(&instr->op2)) {
+                        instr->op2.value.num = copy_var(var_map, next_var,
+                                        instr->op2.value.num);
+                }
+        }
+
+        /* The first pop gets the last pushed argument. */
+        for (size_t p = 0; p < callee->params; ++p) {
+                struct tac_instruction *push =
+                        &dst[pushes[callee->params - 1 - p]];
+
+                push->operator = OPERATOR_ASSIGN;
+                push->res_num = body[p].res_num;
+        }
+
+        for (size_t i = callee->params; i < cnt; ++i) {
+                if (body[i].operator != OPERATOR_RETURN) {
+                        dst[n++] = body[i];
+                        continue;
+                }
+
+                if (call->data_type != DATA_TYPE_VOID) {
+                        dst[n] = body[i];
+                        dst[n].operator = OPERATOR_ASSIGN;
+                        dst[n++].res_num = call->res_num;
+                } else {
+                        remove_instruction(&body[i]);
+                }
+                memset(&dst[n], 0, sizeof (struct tac_instruction));
+                dst[n].operator = OPERATOR_JUMP;
+                dst[n].op1.type = OPERAND_TYPE_LABEL;
+                dst[n++].op1.value.num = end_label;
+        }
+
+        memset(&dst[n], 0, sizeof (struct tac_instruction));
+        dst[n].operator = OPERATOR_LABEL;
+        dst[n].op1.type = OPERAND_TYPE_LABEL;
+        dst[n++].op1.value.num = end_label;
+
+        return n;
+}
+
+/* Inline calls of leaf functions not larger than the threshold, or called
+ * only once and not larger than INLINE_ONCE_FACTOR times the threshold. A
+ * caller grows at most by its own size or by INLINE_GROWTH_FACTOR times the
+ * threshold, whichever is bigger. Functions with no calls left are removed. */
+static int inline_functions(struct tac *tac, unsigned threshold)
+{
+        const size_t vars_cnt = count_vars(tac);
+        size_t labels_cnt = 0;
+        struct function_info *fn = NULL;
+        size_t *pushes = NULL;
+        size_t pushes_cnt = 0;
+        size_t *var_map = NULL;
+        unsigned *label_map = NULL;
+        struct tac_instruction *body = NULL;
+        struct tac_instruction *instructions = NULL;
+        size_t cnt = tac->instructions_cnt;
+        size_t max_body = 0;
+        size_t n = 0;
+        size_t next_var = vars_cnt;
+        unsigned next_label;
+        struct function_info *caller = NULL;
+        size_t budget = 0; //growth allowed to the caller
+        int inlined = 0;
+
+
+        labels_cnt = count_labels(tac);
+        next_label = labels_cnt;
+
+        fn = calloc(labels_cnt, sizeof (struct function_info));
+        if (fn == NULL) {
+                goto memory_exhausted;
+        }
+        function_infos(tac, fn);
+
+        /* Size of a copy is at most twice the body because of the returns. */
+        for (size_t l = 0; l < labels_cnt; ++l) {
+                struct function_info *f = &fn[l];
+
+                f->inlined = f->defined && l != MAIN_LABEL && f->leaf &&
+                        f->calls > 0 && (f->size <= threshold ||
+                        (f->calls == 1 &&
+                         f->size <= INLINE_ONCE_FACTOR * threshold));
+                if (f->inlined) {
+                        cnt += f->calls * (2 * f->size + 1);
+                        if (f->params + f->size > max_body) {
+                                max_body = f->params + f->size;
+                        }
+                        inlined = 1;
+                }
+        }
+        if (!inlined) {
+                goto cleanup;
+        }
+
+        pushes = malloc(tac->instructions_cnt * sizeof (size_t));
+        var_map = calloc(vars_cnt, sizeof (size_t));
+        label_map = malloc(2 * max_body * sizeof (unsigned));
+        body = malloc(max_body * sizeof (struct tac_instruction));
+        instructions = calloc(cnt, sizeof (struct tac_instruction));
+        if (pushes == NULL || var_map == NULL || label_map == NULL ||
+            body == NULL || instructions == NULL) {
+                goto memory_exhausted;
+        }
+
+        /* The new code owns copies of all strings, the old one is freed. */
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+                const struct function_info *callee;
+                size_t params;
+
+                if (starts_function(instr)) {
+                        caller = &fn[instr->op1.value.num];
+                        budget = caller->size;
+                        if (budget < INLINE_GROWTH_FACTOR * threshold) {
+                                budget = INLINE_GROWTH_FACTOR * threshold;
+                        }
+                }
+                if (instr->operator == OPERATOR_PUSH) {
+                        pushes[pushes_cnt++] = n;
+                }
+                if (instr->operator != OPERATOR_CALL) {
+                        if (copy_instructions(instr, 1, instructions + n++,
+                                                NULL, NULL) != 0) {
+                                goto copy_failed;
+                        }
+                        continue;
+                }
+
+                callee = &fn[instr->op1.value.num];
+                params = call_args(fn, instr);
+
+                if (!callee->inlined || caller == NULL ||
+                    caller->growth + callee->size > budget) {
+                        instructions[n++] = *instr;
+                        pushes_cnt -= params;
+                        continue;
+                }
+                caller->growth += callee->size;
+
+                memset(body, 0, max_body * sizeof (struct tac_instruction));
+                if (copy_instructions(&tac->instructions[callee->first + 1],
+                                        callee->params + callee->size, body,
+                                        &next_label, label_map) != 0) {
+                        for (size_t b = 0; b < max_body; ++b) {
+                                remove_instruction(&body[b]);
+                        }
+                        goto copy_failed;
+                }
+                pushes_cnt -= params;
+                n = expand_call(instr, callee, body, instructions, n,
+                                pushes + pushes_cnt, var_map, &next_var,
+                                next_label++);
+
+                /* Clear the map for the next copy. */
+                for (size_t k = 1; k <= callee->params + callee->size; ++k) {
+                        const struct tac_instruction *orig =
+                                &tac->instructions[callee->first + k];
+
+                        var_map[orig->res_num] = 0;
+                        if (is_var(&orig->op1)) {
+                                var_map[orig->op1.value.num] = 0;
+                        }
+                        if (is_var(&orig->op2)) {
+                                var_map[orig->op2.value.num] = 0;
+                        }
+                }
+        }
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                remove_instruction(&tac->instructions[i]);
+        }
+        free(tac->instructions);
+        tac->instructions = instructions;
+        tac->instructions_cnt = n;
+        tac->size = cnt;
+
+        /* Remove functions which are not called anymore. */
+        memset(fn, 0, labels_cnt * sizeof (struct function_info));
+        function_infos(tac, fn);
+        for (size_t i = 0, remove = 0; i < tac->instructions_cnt; ++i) {
+                struct tac_instruction *instr = &tac->instructions[i];
+
+                if (starts_function(instr)) {
+                        const unsigned l = instr->op1.value.num;
+
+                        remove = l != MAIN_LABEL && fn[l].calls == 0;
+                }
+                if (remove) {
+                        remove_instruction(instr);
+                }
+        }
+        tac_compact(tac);
+
+cleanup:
+        free(fn);
+        free(pushes);
+        free(var_map);
+        free(label_map);
+        free(body);
+        return 0;
+
+copy_failed:
+        for (size_t i = 0; i < n; ++i) {
+                remove_instruction(&instructions[i]);
+        }
+        free(instructions);
+        goto failed;
+
+memory_exhausted:
+        set_error(RET_INTERNAL, __func__, "memory exhausted");
+        free(instructions);
+failed:
+        free(fn);
+        free(pushes);
+        free(var_map);
+        free(label_map);
+        free(body);
+        return 1;
+}
+
+
+/* Tail recursion elimination. */
+/* Result of the call is returned right away. */
+static int tail_call(const struct tac *tac, size_t i)
+{
+        const struct tac_instruction *call = &tac->instructions[i];
+        const struct tac_instruction *ret = call + 1;
+
+
+        if (i + 1 == tac->instructions_cnt ||
+            ret->operator != OPERATOR_RETURN) {
+                return 0;
+        }
+
+        return (call->data_type == DATA_TYPE_VOID) ?
+                ret->data_type == DATA_TYPE_VOID :
+                is_var(&ret->op1) && ret->op1.value.num == call->res_num;
+}
+
+/* Self recursive calls whose result is returned right away become
+ * assignments to the parameters and a jump behind the pops. */
+static int eliminate_tail_recursion(struct tac *tac)
+{
+        size_t next_var = count_vars(tac);
+        size_t labels_cnt = 0;
+        struct function_info *fn = NULL;
+        struct insertions ins = { NULL, 0, 0 };
+        size_t *pushes = NULL;
+        size_t pushes_cnt = 0;
+        size_t func = 0;
+        unsigned entry = 0;
+        unsigned next_label;
+
+
+        labels_cnt = count_labels(tac);
+        next_label = labels_cnt;
+
+        fn = calloc(labels_cnt, sizeof (struct function_info));
+        pushes = malloc(tac->instructions_cnt * sizeof (size_t));
+        if (fn == NULL || pushes == NULL) {
+                goto memory_exhausted;
+        }
+        function_infos(tac, fn);
+
+        for (size_t i = 0; i < tac->instructions_cnt; ++i) {
+                struct tac_instruction *instr = &tac->instructions[i];
+                const struct function_info *f;
+                struct tac_instruction jump;
+                size_t params;
+
+                if (starts_function(instr)) {
+                        func = i;
+                        entry = 0;
+                        pushes_cnt = 0;
+                        continue;
+                } else if (instr->operator == OPERATOR_PUSH) {
+                        pushes[pushes_cnt++] = i;
+                        continue;
+                } else if (instr->operator != OPERATOR_CALL) {
+                        continue;
+                }
+
+                params = call_args(fn, instr);
+                pushes_cnt -= params;
+                if (instr->op1.value.num !=
+                                tac->instructions[func].op1.value.num ||
+                    !tail_call(tac, i)) {
+                        continue;
+                }
+                f = &fn[instr->op1.value.num];
+
+                /* Arguments may read the parameters, they are kept in new
+                 * variables until all of them are evaluated. The first pop
+                 * gets the last pushed argument. */
+                for (size_t p = 0; p < f->params; ++p) {
+                        struct tac_instruction *push =
+                                &tac->instructions[pushes[pushes_cnt +
+                                f->params - 1 - p]];
+                        struct tac_instruction assign;
+
+                        push->operator = OPERATOR_ASSIGN;
+                        push->res_num = next_var++;
+
+                        assign = *push;
+                        assign.res_num =
+                                tac->instructions[func + 1 + p].res_num;
+                        assign.op1.type = OPERAND_TYPE_VARIABLE;
+                        assign.op1.value.num = push->res_num;
+                        if (insertion_add(&ins, i, 0, assign) != 0) {
+                                goto failed;
+                        }
+                }
+
+                if (entry == 0) {
+                        struct tac_instruction label;
+
+                        memset(&label, 0, sizeof (struct tac_instruction));
+                        label.operator = OPERATOR_LABEL;
+                        label.op1.type = OPERAND_TYPE_LABEL;
+                        label.op1.value.num = entry = next_label++;
+                        if (insertion_add(&ins, func + f->params, 1,
+                                                label) != 0) {
+                                goto failed;
+                        }
+                }
+
+                memset(&jump, 0, sizeof (struct tac_instruction));
+                jump.operator = OPERATOR_JUMP;
+                jump.op1.type = OPERAND_TYPE_LABEL;
+                jump.op1.value.num = entry;
+                if (insertion_add(&ins, i, 0, jump) != 0) {
+                        goto failed;
+                }
+                remove_instruction(instr);
+                remove_instruction(&tac->instructions[i + 1]);
+        }
+
+        if (tac_insert(tac, &ins) != 0) {
+                goto failed;
+        }
+        tac_compact(tac);
+
+        free(fn);
+        free(pushes);
+        free(ins.list);
+        return 0;
+
+memory_exhausted:
+        set_error(RET_INTERNAL, __func__, "memory exhausted");
+failed:
+        free(fn);
+        free(pushes);
+        free(ins.list);
+        return 1;
+}
+
+
+/* In-place update of unshared strings. */
+enum site { //set_at whose result replaces the string it changes
+        SITE_NONE,
+        SITE_UNSHARED, //nothing else refers to the string
+        SITE_SHARED,
+};
+
+struct unshared { //variables holding the only reference to their string
+        size_t b_first;
+        size_t b_end;
+        size_t words; //words of variable sets
+        unsigned *in; //unshared at the block entries
+        unsigned *copied; //made unshared by a copy at the block ends
+        unsigned *curr;
+        size_t *pushed; //pushes of calls which have not been reached yet
+        size_t first; //index of the first instruction of the function
+        enum site *sites; //kind of each instruction of the function
+};
+
+/* Result is a string nothing else refers to, a new one or the unshared
+ * argument of the in-place set_at. */
+static int creates_string(const struct tac_instruction *instr)
+{
+        if (instr->operator == OPERATOR_CAST_CHAR_TO_STRING) {
+                return 1;
+        }
+
+        return instr->operator == OPERATOR_CALL &&
+                (instr->op1.value.num == READ_STRING_LABEL ||
+                 instr->op1.value.num == SET_AT_LABEL ||
+                 instr->op1.value.num == STRCAT_LABEL ||
+                 instr->op1.value.num == SET_AT_IN_PLACE_LABEL);
+}
+
+/* String pushed first for set_at is replaced by the result and it is not
+ * pushed for an outer call, which would see the change. */
+static int replaces_argument(const size_t *pushed, size_t top, size_t res)
+{
+        if (pushed[top] != res) {
+                return 0;
+        }
+        for (size_t k = 0; k < top; ++k) {
+                if (pushed[k] == res) {
+                        return 0;
+                }
+        }
+
+        return 1;
+}
+
+/* A string stops being unshared when it is copied, returned or passed to a
+ * function other than a builtin one, builtins only read their arguments.
+ * Pushes of calls not reached in the block are treated as passed to an
+ * unknown function. If sites are given, set_at calls replacing their
+ * argument are recorded there. */
+static void unshared_transfer(const struct tac *tac, struct unshared *u,
+                size_t b, const struct basic_block *block, const size_t *local,
+                enum site *sites)
+{
+        const unsigned *copied = u->copied + (b - u->b_first) * u->words;
+        size_t top = 0;
+
+
+        for (size_t i = block->first; i <= block->last; ++i) {
+                const struct tac_instruction *instr = &tac->instructions[i];
+                const struct function *f;
+
+                if (instr->operator == OPERATOR_PUSH) {
+                        u->pushed[top++] = is_var(&instr->op1) ?
+                                local[instr->op1.value.num] : 0;
+                        continue;
+                } else if (instr->operator == OPERATOR_ASSIGN ||
+                           instr->operator == OPERATOR_RETURN) {
+                        if (is_var(&instr->op1)) {
+                                bit_clear(u->curr, local[instr->op1.value.num]);
+                        }
+                } else if (instr->operator == OPERATOR_CALL) {
+                        f = builtin(instr->op1.value.num);
+                        if (f == NULL) {
+                                while (top > 0) {
+                                        bit_clear(u->curr, u->pushed[--top]);
+                                }
+                        } else if (top < call_args(NULL, instr)) {
+                                top = 0;
+                        } else {
+                                top -= call_args(NULL, instr);
+                                if (sites != NULL && instr->op1.value.num ==
+                                                SET_AT_LABEL &&
+                                    replaces_argument(u->pushed, top,
+                                            local[instr->res_num])) {
+                                        sites[i - u->first] = bit_test(u->curr,
+                                                        local[instr->res_num]) ?
+                                                SITE_UNSHARED : SITE_SHARED;
+                                }
+                        }
+                }
+
+                if (instr->res_num != 0 && creates_string(instr)) {
+                        bit_set(u->curr, local[instr->res_num]);
+                } else if (instr->res_num != 0) {
+                        bit_clear(u->curr, local[instr->res_num]);
+                }
+        }
+
+        while (top > 0) {
+                bit_clear(u->curr, u->pushed[--top]);
+        }
+        for (size_t w = 0; w < u->words; ++w) {
+                u->curr[w] |= copied[w];
+        }
+}
+
+/* Compute unshared variables at the entries of the blocks of the function
+ * and record the set_at calls which may change their argument. */
+static void unshared_analysis(const struct tac *tac, const struct cfg *cfg,
+                struct unshared *u, const size_t *local)
+{
+        const size_t blocks_cnt = u->b_end - u->b_first;
+        const size_t size = cfg->blocks[u->b_end - 1].last - u->first + 1;
+        int changed = 1;
+
+
+        /* Nothing is known about the parameters, the other blocks start with
+         * all variables unshared until a path shows otherwise. */
+        memset(u->in, 0xFF, blocks_cnt * u->words * sizeof (unsigned));
+        memset(u->in, 0, u->words * sizeof (unsigned));
+        while (changed) {
+                changed = 0;
+                for (size_t b = u->b_first; b < u->b_end; ++b) {
+                        const struct basic_block *block = &cfg->blocks[b];
+
+                        memcpy(u->curr, u->in + (b - u->b_first) * u->words,
+                                        u->words * sizeof (unsigned));
+                        unshared_transfer(tac, u, b, block, local, NULL);
+                        for (unsigned s = 0; s < block->succ_cnt; ++s) {
+                                unsigned *succ_in = u->in +
+                                        (block->succ[s] - u->b_first) *
+                                        u->words;
+
+                                for (size_t w = 0; w < u->words; ++w) {
+                                        changed |= (succ_in[w] & u->curr[w]) !=
+                                                succ_in[w];
+                                        succ_in[w] &= u->curr[w];
+                                }
+                        }
+                }
+        }
+
+        memset(u->sites, 0, size * sizeof (enum site));
+        for (size_t b = u->b_first; b < u->b_end; ++b) {
+                memcpy(u->curr, u->in + (b - u->b_first) * u->words,
+                                u->words * sizeof (unsigned));
+                unshared_transfer(tac, u, b, &cfg->blocks[b], local, u->sites);
+        }
+}
+
+static void unshared_free(struct unshared *u)
+{
+        free(u->in);
+        free(u->copied);
+        free(u->curr);
+        free(u->pushed);
+        free(u->sites);
+}
+
+static int unshared_init(struct unshared *u, const struct cfg *cfg,
+                size_t b_first, size_t b_end, size_t locals_cnt)
+{
+        const size_t blocks_cnt = b_end - b_first;
+        size_t size;
+
+
+        u->b_first = b_first;
+        u->b_end = b_end;
+        u->words = locals_cnt / WORD_BITS + 1;
+        u->first = cfg->blocks[b_first].first;
+        size = cfg->blocks[b_end - 1].last - u->first + 1;
+
+        u->in = malloc(blocks_cnt * u->words * sizeof (unsigned));
+        u->copied = calloc(blocks_cnt * u->words, sizeof (unsigned));
+        u->curr = malloc(u->words * sizeof (unsigned));
+        u->pushed = malloc(size * sizeof (size_t));
+        u->sites = malloc(size * sizeof (enum site));
+        if (u->in == NULL || u->copied == NULL || u->curr == NULL ||
+            u->pushed == NULL || u->sites == NULL) {
+                unshared_free(u);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        return 0;
+}
+
+/* Block is executed in every iteration of the loop. */
+static int every_iteration(const struct cfg *cfg, size_t b_first,
+                size_t header, size_t b, size_t bwords, const unsigned *dom,
+                const unsigned *body)
+{
+        const struct basic_block *h = &cfg->blocks[header];
+
+
+        for (unsigned p = 0; p < h->pred_cnt; ++p) {
+                if (bit_test(body, h->pred[p] - b_first) &&
+                    !bit_test(dom + (h->pred[p] - b_first) * bwords,
+                            b - b_first)) {
+                        return 0;
+                }
+        }
+
+        return 1;
+}
+
+/* Insert var = strcat(var, "") before the instruction. */
+static int copy_string(struct insertions *ins, size_t pos, unsigned var,
+                size_t *vars_cnt)
+{
+        struct tac_instruction instr;
+        const unsigned empty = (*vars_cnt)++;
+
+
+        memset(&instr, 0, sizeof (struct tac_instruction));
+        instr.data_type = DATA_TYPE_STRING;
+        instr.res_num = empty;
+        instr.operator = OPERATOR_ASSIGN;
+        instr.op1.type = OPERAND_TYPE_LITERAL;
+        instr.op1.value.string_val = strdup("");
+        if (instr.op1.value.string_val == NULL) {
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        } else if (insertion_add(ins, pos, 0, instr) != 0) {
+                free(instr.op1.value.string_val);
+                return 1;
+        }
+
+        memset(&instr, 0, sizeof (struct tac_instruction));
+        instr.data_type = DATA_TYPE_STRING;
+        instr.operator = OPERATOR_PUSH;
+        instr.op1.type = OPERAND_TYPE_VARIABLE;
+        instr.op1.value.num = var;
+        if (insertion_add(ins, pos, 0, instr) != 0) {
+                return 1;
+        }
+        instr.op1.value.num = empty;
+        if (insertion_add(ins, pos, 0, instr) != 0) {
+                return 1;
+        }
+
+        instr.res_num = var;
+        instr.operator = OPERATOR_CALL;
+        instr.op1.type = OPERAND_TYPE_LABEL;
+        instr.op1.value.num = STRCAT_LABEL;
+        return insertion_add(ins, pos, 0, instr);
+}
+
+/* String changed by set_at in every iteration of a loop, but shared when
+ * the loop is entered, would be copied by the first set_at of every
+ * iteration. It is copied once before the loop instead, if that makes any
+ * of the set_at calls in the loop unshared. */
+static int copy_before_loops_function(struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const size_t *local,
+                size_t locals_cnt, struct insertions *ins, size_t *vars_cnt)
+{
+        const size_t blocks_cnt = b_end - b_first;
+        const size_t bwords = blocks_cnt / WORD_BITS + 1;
+        struct unshared u;
+        unsigned *dom, *body;
+        size_t *stack, *loop_of; //header of the loop the site is copied for
+        size_t size;
+        int copies = 0;
+        int ret = 0;
+
+
+        if (unshared_init(&u, cfg, b_first, b_end, locals_cnt) != 0) {
+                return 1;
+        }
+        size = cfg->blocks[b_end - 1].last - u.first + 1;
+        dom = malloc(blocks_cnt * bwords * sizeof (unsigned));
+        body = malloc(bwords * sizeof (unsigned));
+        stack = malloc(blocks_cnt * sizeof (size_t));
+        loop_of = calloc(size, sizeof (size_t));
+        if (dom == NULL || body == NULL || stack == NULL || loop_of == NULL) {
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                ret = 1;
+                goto cleanup;
+        }
+
+        unshared_analysis(tac, cfg, &u, local);
+        dominators(cfg, b_first, b_end, bwords, dom);
+        for (size_t h = b_first + 1; h < b_end; ++h) {
+                unsigned *copied = u.copied + (h - 1 - b_first) * u.words;
+
+                if (!loop_body(cfg, b_first, h, bwords, dom, body, stack) ||
+                    !has_preheader(tac, cfg, b_first, h, body)) {
+                        continue;
+                }
+                for (size_t b = b_first; b < b_end; ++b) {
+                        if (!bit_test(body, b - b_first) ||
+                            !every_iteration(cfg, b_first, h, b, bwords, dom,
+                                    body)) {
+                                continue;
+                        }
+                        for (size_t i = cfg->blocks[b].first;
+                             i <= cfg->blocks[b].last; ++i) {
+                                if (u.sites[i - u.first] != SITE_SHARED) {
+                                        continue;
+                                }
+                                bit_set(copied,
+                                        local[tac->instructions[i].res_num]);
+                                loop_of[i - u.first] = h;
+                                copies = 1;
+                        }
+                }
+        }
+        if (!copies) {
+                goto cleanup;
+        }
+
+        /* Keep the copies which helped, each one only once. */
+        unshared_analysis(tac, cfg, &u, local);
+        memset(u.copied, 0, blocks_cnt * u.words * sizeof (unsigned));
+        for (size_t i = u.first; ret == 0 && i < u.first + size; ++i) {
+                const size_t h = loop_of[i - u.first];
+                const unsigned var = tac->instructions[i].res_num;
+                unsigned *copied = u.copied + (h - 1 - b_first) * u.words;
+
+                if (h == 0 || u.sites[i - u.first] != SITE_UNSHARED ||
+                    bit_test(copied, local[var])) {
+                        continue;
+                }
+                bit_set(copied, local[var]);
+                ret = copy_string(ins, cfg->blocks[h].first, var, vars_cnt);
+        }
+
+cleanup:
+        unshared_free(&u);
+        free(dom);
+        free(body);
+        free(stack);
+        free(loop_of);
+        return ret;
+}
+
+static int copy_before_loops(struct tac *tac)
+{
+        struct cfg cfg;
+        const size_t old_vars_cnt = count_vars(tac);
+        size_t vars_cnt = old_vars_cnt; //new variables are numbered from here
+        size_t *local = calloc(old_vars_cnt, sizeof (size_t));
+        size_t *var = malloc(old_vars_cnt * sizeof (size_t));
+        struct insertions ins = { NULL, 0, 0 };
+        int ret = 0;
+
+
+        if (local == NULL || var == NULL) {
+                free(local);
+                free(var);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+        if (cfg_build(tac, &cfg) != 0) {
+                free(local);
+                free(var);
+                return 1;
+        }
+
+        for (size_t b_first = 0; ret == 0 && b_first < cfg.blocks_cnt; ) {
+                const size_t b_end = function_end(tac, &cfg, b_first);
+                const size_t locals_cnt = index_locals(tac,
+                                cfg.blocks[b_first].first,
+                                cfg.blocks[b_end - 1].last, local, var);
+
+                ret = copy_before_loops_function(tac, &cfg, b_first, b_end,
+                                local, locals_cnt, &ins, &vars_cnt);
+                for (size_t l = 1; l < locals_cnt; ++l) {
+                        local[var[l]] = 0;
+                }
+                b_first = b_end;
+        }
+        if (ret == 0) {
+                ret = tac_insert(tac, &ins);
+        } else {
+                for (size_t k = 0; k < ins.cnt; ++k) {
+                        remove_instruction(&ins.list[k].instr);
+                }
+        }
+
+        free(ins.list);
+        cfg_free(&cfg);
+        free(local);
+        free(var);
+        return ret;
+}
+
+/* set_at of an unshared string replaced by the result changes it in place. */
+static int update_in_place_function(struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const size_t *local,
+                size_t locals_cnt)
+{
+        struct unshared u;
+
+
+        if (unshared_init(&u, cfg, b_first, b_end, locals_cnt) != 0) {
+                return 1;
+        }
+
+        unshared_analysis(tac, cfg, &u, local);
+        for (size_t i = u.first; i <= cfg->blocks[b_end - 1].last; ++i) {
+                if (u.sites[i - u.first] == SITE_UNSHARED) {
+                        tac->instructions[i].op1.value.num =
+                                SET_AT_IN_PLACE_LABEL;
+                }
+        }
+
+        unshared_free(&u);
+        return 0;
+}
+
+
+/* Folding of literal strings. */
+#define FOLD_LENGTH_MAX 1024 //longer strings are built at run time
+
+/* Text of the literal the push stands for, NULL if it is not known. Known
+ * holds for every variable the index + 1 of its literal assignment, which is
+ * valid only inside the block starting with instruction first. */
+static const char * pushed_literal(const struct tac *tac,
+                const struct tac_instruction *push, const size_t *known,
+                const size_t *local, size_t first, char *buf)
+{
+        size_t def;
+
+
+        if (push->op1.type == OPERAND_TYPE_LITERAL) {
+                switch (push->data_type) {
+                case DATA_TYPE_STRING:
+                        return push->op1.value.string_val;
+                case DATA_TYPE_INT:
+                        sprintf(buf, "%d", push->op1.value.int_val);
+                        return buf;
+                case DATA_TYPE_CHAR:
+                        buf[0] = push->op1.value.char_val;
+                        buf[1] = '\0';
+                        return (buf[0] != '\0') ? buf : NULL; //would end it
+                default:
+                        return NULL;
+                }
+        }
+
+        def = is_var(&push->op1) ? known[local[push->op1.value.num]] : 0;
+        if (push->data_type != DATA_TYPE_STRING || def <= first) {
+                return NULL;
+        }
+        return tac->instructions[def - 1].op1.value.string_val;
+}
+
+/* Concatenation of the literals of the pushes, NULL if it is too long. */
+static int concat_literals(const struct tac *tac, const size_t *pushes,
+                size_t cnt, const size_t *known, const size_t *local,
+                size_t first, char **str)
+{
+        char buf[16];
+        size_t len = 0;
+
+
+        for (size_t k = 0; k < cnt; ++k) {
+                len += strlen(pushed_literal(tac, &tac->instructions[pushes[k]],
+                                        known, local, first, buf));
+        }
+        if (len > FOLD_LENGTH_MAX) {
+                *str = NULL;
+                return 0;
+        }
+
+        *str = malloc(len + 1);
+        if (*str == NULL) {
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+        (*str)[0] = '\0';
+        for (size_t k = 0; k < cnt; ++k) {
+                strcat(*str, pushed_literal(tac, &tac->instructions[pushes[k]],
+                                        known, local, first, buf));
+        }
+        return 0;
+}
+
+/* Adjacent literal arguments of print are printed as one string pushed by
+ * the last of them. Only the arguments pushed in the block are known. */
+static int coalesce_print(struct tac *tac, struct tac_instruction *call,
+                const size_t *pushes, size_t cnt, const size_t *known,
+                const size_t *local, size_t first)
+{
+        char buf[16];
+        size_t k = 0;
+
+
+        while (k < cnt) {
+                struct tac_instruction *last;
+                size_t e = k;
+                char *str;
+
+                while (e < cnt && pushed_literal(tac,
+                                        &tac->instructions[pushes[e]], known,
+                                        local, first, buf) != NULL) {
+                        e++;
+                }
+                if (e - k < 2) {
+                        k = e + 1;
+                        continue;
+                }
+
+                if (concat_literals(tac, pushes + k, e - k, known, local,
+                                        first, &str) != 0) {
+                        return 1;
+                } else if (str == NULL) {
+                        k = e;
+                        continue;
+                }
+                for (size_t j = k; j + 1 < e; ++j) {
+                        remove_instruction(&tac->instructions[pushes[j]]);
+                }
+                last = &tac->instructions[pushes[e - 1]];
+                remove_instruction(last);
+                last->operator = OPERATOR_PUSH;
+                last->data_type = DATA_TYPE_STRING;
+                last->op1.type = OPERAND_TYPE_LITERAL;
+                last->op1.value.string_val = str;
+                call->op2.value.int_val -= e - k - 1;
+                k = e;
+        }
+
+        return 0;
+}
+
+/* Call of strcat with two literal arguments becomes their concatenation. */
+static int fold_strcat(struct tac *tac, struct tac_instruction *call,
+                const size_t *pushes, const size_t *known, const size_t *local,
+                size_t first)
+{
+        char buf[16];
+        char *str;
+
+
+        if (pushed_literal(tac, &tac->instructions[pushes[0]], known, local,
+                                first, buf) == NULL ||
+            pushed_literal(tac, &tac->instructions[pushes[1]], known, local,
+                                first, buf) == NULL) {
+                return 0;
+        }
+        if (concat_literals(tac, pushes, 2, known, local, first, &str) != 0) {
+                return 1;
+        } else if (str == NULL) {
+                return 0;
+        }
+
+        remove_instruction(&tac->instructions[pushes[0]]);
+        remove_instruction(&tac->instructions[pushes[1]]);
+        call->operator = OPERATOR_ASSIGN;
+        call->op1.type = OPERAND_TYPE_LITERAL;
+        call->op1.value.string_val = str;
+        return 0;
+}
+
+/* Print arguments which are literals are merged and strcat of two literals
+ * is replaced by the concatenated literal. */
+static int fold_literals_function(struct tac *tac, const struct cfg *cfg,
+                size_t b_first, size_t b_end, const size_t *local,
+                size_t locals_cnt)
+{
+        size_t *known = calloc(locals_cnt, sizeof (size_t));
+        size_t *pushes = malloc((tac->instructions_cnt + 1) * sizeof (size_t));
+        int ret = 0;
+
+
+        if (known == NULL || pushes == NULL) {
+                free(known);
+                free(pushes);
+                set_error(RET_INTERNAL, __func__, "memory exhausted");
+                return 1;
+        }
+
+        for (size_t b = b_first; ret == 0 && b < b_end; ++b) {
+                const size_t first = cfg->blocks[b].first;
+                size_t top = 0;
+
+                for (size_t i = first; ret == 0 && i <= cfg->blocks[b].last;
+                     ++i) {
+                        struct tac_instruction *instr = &tac->instructions[i];
+                        const struct function *f;
+                        size_t def = 0;
+                        size_t cnt;
+
+                        if (instr->operator == OPERATOR_PUSH) {
+                                pushes[top++] = i;
+                                continue;
+                        } else if (instr->operator == OPERATOR_CALL &&
+                                   instr->op1.value.num == PRINT_LABEL) {
+                                cnt = call_args(NULL, instr);
+                                cnt = (cnt < top) ? cnt : top;
+                                top -= cnt;
+                                ret = coalesce_print(tac, instr, pushes + top,
+                                                cnt, known, local, first);
+                        } else if (instr->operator == OPERATOR_CALL &&
+                                   instr->op1.value.num == STRCAT_LABEL &&
+                                   top >= 2) {
+                                top -= 2;
+                                ret = fold_strcat(tac, instr, pushes + top,
+                                                known, local, first);
+                        } else if (instr->operator == OPERATOR_CALL) {
+                                f = builtin(instr->op1.value.num);
+                                if (f == NULL || f->params_cnt > top) {
+                                        top = 0; //pops of others are unknown
+                                } else {
+                                        top -= f->params_cnt;
+                                }
+                        }
+
+                        if (instr->res_num == 0) {
+                                continue;
+                        }
+
+                        /* Literal assignments and copies of them. */
+                        if (instr->operator == OPERATOR_ASSIGN &&
+                            instr->data_type == DATA_TYPE_STRING) {
+                                if (instr->op1.type == OPERAND_TYPE_LITERAL) {
+                                        def = i + 1;
+                                } else if (is_var(&instr->op1) &&
+                                           known[local[instr->op1.value.num]] >
+                                           first) {
+                                        def = known[local[
+                                                instr->op1.value.num]];
+                                }
+                        }
+                        known[local[instr->res_num]] = def;
+                }
+        }
+
+        free(known);
+        free(pushes);
+        return ret;
+}
+
+
+/* Scalar optimizations of the whole code. */
+static int optimize_scalars(struct tac *tac)
+{
+        if (for_each_function(tac, constant_propagation_function) != 0) {
+                return 1;
+        }
+        if (remove_unreachable(tac) != 0) {
+                return 1;
+        }
+        if (for_each_function(tac, value_numbering_function) != 0) {
+                return 1;
+        }
+        if (coalesce_copies(tac) != 0) {
+                return 1;
+        }
+        if (for_each_function(tac, copy_propagation_function) != 0) {
+                return 1;
+        }
+        if (for_each_function(tac, fold_literals_function) != 0) {
+                return 1;
+        }
+        return for_each_function(tac, remove_dead_function);
+}
+
+
+int tac_optimize(struct tac *tac, const struct tac_opt_params *params)
+{
+        assert(tac != NULL && params != NULL);
+
+        if (tac->instructions_cnt == 0) {
+                return 0;
+        }
+
+        if (eliminate_tail_recursion(tac) != 0) {
+                return 1;
+        }
+        if (params->inline_threshold > 0 &&
+            inline_functions(tac, params->inline_threshold) != 0) {
+                return 1;
+        }
+        if (optimize_scalars(tac) != 0) {
+                return 1;
+        }
+        if (optimize_loops(tac) != 0) {
+                return 1;
+        }
+        if (params->unroll_factor > 1 &&
+            unroll_loops(tac, params->unroll_factor) != 0) {
+                return 1;
+        }
+
+        /* Loop transformations leave copies and constants behind. */
+        if (optimize_scalars(tac) != 0) {
+                return 1;
+        }
+        if (simplify_jumps(tac) != 0) {
+                return 1;
+        }
+
+        /* The in-place set_at is not known to the passes above. */
+        if (copy_before_loops(tac) != 0) {
+                return 1;
+        }
+        return for_each_function(tac, update_in_place_function);
+}
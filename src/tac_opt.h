@@ -0,0 +1,27 @@
+/*
+ * project: VYPe15 programming language compiler
+ * author: Jan Wrona <xwrona00@stud.fit.vutbr.cz>
+ * author: Katerina Zmolikova <xzmoli02@stud.fit.vutbr.cz>
+ * date: 2015
+ */
+#ifndef TAC_OPT_H
+#define TAC_OPT_H
+
+
+#include "tac.h"
+
+
+#define UNROLL_FACTOR_DEFAULT 4
+#define INLINE_THRESHOLD_DEFAULT 16
+
+
+struct tac_opt_params {
+        unsigned unroll_factor; //copies of the body of counted loops, 1 is off
+        unsigned inline_threshold; //max. size of inlined functions, 0 is off
+};
+
+
+int tac_optimize(struct tac *tac, const struct tac_opt_params *params);
+
+
+#endif //TAC_OPT_H
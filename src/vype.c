@@ -6,12 +6,17 @@
  */
 #include "common.h"
 #include "tac.h"
+#include "tac_opt.h"
 #include "gen_code.h"
+#include "peephole.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
 
 
 #define DEFAULT_OUTPUT_FILE "out.asm"
@@ -29,16 +34,71 @@ int main(int argc, char **argv)
 {
         const char *input_file_name;
         const char *output_file_name;
+        struct tac_opt_params opt_params = {
+                UNROLL_FACTOR_DEFAULT, INLINE_THRESHOLD_DEFAULT
+        };
+        struct gen_code_params gen_params = {
+                0, RUNTIME_THRESHOLD_DEFAULT
+        };
+        int print_stats = 0;
+        int opt;
         int yyret;
+        struct timespec start, end;
+
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+
+        /* Handle command line options and arguments. */
+        while ((opt = getopt(argc, argv, "i:lr:su:")) != -1) {
+                char *end;
+
+                switch (opt) {
+                case 'i':
+                        opt_params.inline_threshold = strtoul(optarg, &end,
+                                        10);
+                        if (*optarg == '\0' || *end != '\0') {
+                                print_error(RET_INTERNAL, optarg,
+                                                "bad inline threshold");
+                                return RET_INTERNAL;
+                        }
+                        break;
+                case 'l':
+                        gen_params.length_prefix = 1;
+                        break;
+                case 'r':
+                        gen_params.runtime_threshold = strtoul(optarg, &end,
+                                        10);
+                        if (*optarg == '\0' || *end != '\0') {
+                                print_error(RET_INTERNAL, optarg,
+                                                "bad runtime threshold");
+                                return RET_INTERNAL;
+                        }
+                        break;
+                case 's':
+                        print_stats = 1;
+                        break;
+                case 'u':
+                        opt_params.unroll_factor = strtoul(optarg, &end, 10);
+                        if (*optarg == '\0' || *end != '\0' ||
+                            opt_params.unroll_factor == 0) {
+                                print_error(RET_INTERNAL, optarg,
+                                                "bad unroll factor");
+                                return RET_INTERNAL;
+                        }
+                        break;
+                default:
+                        print_error(RET_INTERNAL, NULL, "bad option");
+                        return RET_INTERNAL;
+                }
+        }
 
-
-        /* Handle command line arguments. */
-        if (argc == 2) {
-                input_file_name = argv[1];
+        if (argc - optind == 1) {
+                input_file_name = argv[optind];
                 output_file_name = DEFAULT_OUTPUT_FILE;
-        } else if (argc == 3) {
-                input_file_name = argv[1];
-                output_file_name = argv[2];
+        } else if (argc - optind == 2) {
+                input_file_name = argv[optind];
+                output_file_name = argv[optind + 1];
         } else {
                 print_error(RET_INTERNAL, NULL, "bad argument count");
                 return RET_INTERNAL;
@@ -68,6 +128,11 @@ int main(int argc, char **argv)
 
 
         if (return_code == RET_OK && yyret == 0) { //parsing was successfull
+                /* Machine independent optimizations of TAC. */
+                if (tac_optimize(tac, &opt_params) != 0) {
+                        tac_free(tac);
+                        return return_code;
+                }
                 //tac_print(tac);
                 FILE * fout = fopen(output_file_name, "w");
                 if (fout == NULL) {
@@ -76,7 +141,21 @@ int main(int argc, char **argv)
                         return RET_INTERNAL;
                 }
 
-                generate_code(tac, fout);
+                /* Code generation and peephole optimizations of the code. */
+                FILE *fasm = tmpfile();
+                if (fasm == NULL) {
+                        print_error(RET_INTERNAL, "tmpfile", strerror(errno));
+                        return RET_INTERNAL;
+                }
+                generate_code(tac, fasm, &gen_params);
+                rewind(fasm);
+                if (peephole(fasm, fout, print_stats ? stderr : NULL) < 0) {
+                        print_error(RET_INTERNAL, __func__,
+                                        "memory exhausted");
+                        return_code = RET_INTERNAL;
+                }
+                fclose(fasm);
+
                 if (fclose(fout) != 0) {
                         print_error(RET_INTERNAL, output_file_name,
                                         strerror(errno));
@@ -90,6 +169,19 @@ int main(int argc, char **argv)
                 return_code = RET_SYNTACTIC;
         }
 
+        /* Compilation time and memory, read by the benchmarks. */
+        if (print_stats && return_code == RET_OK) {
+                struct rusage usage;
+
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                getrusage(RUSAGE_SELF, &usage);
+                fprintf(stderr, "compile %-16s %ld\n", "wall us",
+                                (end.tv_sec - start.tv_sec) * 1000000L +
+                                (end.tv_nsec - start.tv_nsec) / 1000);
+                fprintf(stderr, "compile %-16s %ld\n", "peak rss kb",
+                                usage.ru_maxrss);
+        }
+
         if (return_code != RET_OK) {
                 fprintf(stderr, "\nexiting with error (%d)\n", return_code);
         }